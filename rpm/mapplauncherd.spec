@@ -76,6 +76,8 @@ rm -f %{buildroot}/usr/share/fala_images/fala_qml_helloworld
 
 mkdir -p %{buildroot}/usr/lib/systemd/user/user-session.target.wants || true
 ln -s ../booster-generic.service %{buildroot}/usr/lib/systemd/user/user-session.target.wants/
+mkdir -p %{buildroot}/usr/lib/systemd/user/pre-user-session.target.wants || true
+ln -s ../booster-generic.socket %{buildroot}/usr/lib/systemd/user/pre-user-session.target.wants/
 # << install post
 
 %post -p /sbin/ldconfig
@@ -87,9 +89,12 @@ ln -s ../booster-generic.service %{buildroot}/usr/lib/systemd/user/user-session.
 %{_bindir}/invoker
 %{_bindir}/single-instance
 %{_libdir}/libapplauncherd.so*
+%{_libdir}/libinvoker.so*
 %{_libexecdir}/mapplauncherd/booster-generic
 %{_libdir}/systemd/user/booster-generic.service
 %{_libdir}/systemd/user/user-session.target.wants/booster-generic.service
+%{_libdir}/systemd/user/booster-generic.socket
+%{_libdir}/systemd/user/pre-user-session.target.wants/booster-generic.socket
 # >> files
 # << files
 
@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+
+# Stand-in for the window activation service of single instance launches
+# (org.nemomobile.lipstick /WindowModel local.Lipstick.WindowModel
+# launchProcess). Run it on a session bus without the real home screen
+# to measure how long a repeated "invoker --single-instance" launch of a
+# running application takes to reach the service.
+#
+# The application is started once, then invoked COUNT more times. For
+# every invocation the time from starting the invoker until the request
+# arrives and until the invoker exits is measured. Requires jeepney.
+#
+# Example: activation-benchmark.py --type=e --count=50 /usr/bin/myApp [ARGS]
+
+import argparse
+import subprocess
+import sys
+import threading
+import time
+
+from jeepney import MessageType, HeaderFields, new_method_return
+from jeepney.bus_messages import message_bus
+from jeepney.io.blocking import open_dbus_connection
+
+SERVICE   = "org.nemomobile.lipstick"
+INTERFACE = "local.Lipstick.WindowModel"
+METHOD    = "launchProcess"
+
+NO_REPLY_EXPECTED = 1
+
+
+class Service(object):
+    def __init__(self):
+        self.conn = open_dbus_connection(bus="SESSION")
+        reply = self.conn.send_and_get_reply(message_bus.RequestName(SERVICE))
+        if reply.body[0] != 1:
+            sys.exit("%s is already owned on the session bus" % SERVICE)
+
+        self.arrived = threading.Event()
+        self.arrival = None
+
+    def serve(self, stop):
+        while not stop.is_set():
+            try:
+                msg = self.conn.receive(timeout=0.1)
+            except TimeoutError:
+                continue
+
+            fields = msg.header.fields
+            if (msg.header.message_type != MessageType.method_call or
+                    fields.get(HeaderFields.interface) != INTERFACE or
+                    fields.get(HeaderFields.member) != METHOD):
+                continue
+
+            self.arrival = time.monotonic()
+            self.arrived.set()
+
+            if not msg.header.flags & NO_REPLY_EXPECTED:
+                self.conn.send(new_method_return(msg))
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def summary(name, values):
+    print("%-12s min %7.2f  median %7.2f  p90 %7.2f  max %7.2f ms" % (
+        name, min(values), percentile(values, 50), percentile(values, 90), max(values)))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure single instance activation latency")
+    parser.add_argument("--invoker", default="/usr/bin/invoker")
+    parser.add_argument("--type", default="e")
+    parser.add_argument("--count", type=int, default=20)
+    parser.add_argument("application")
+    parser.add_argument("arguments", nargs=argparse.REMAINDER)
+    args = parser.parse_args()
+
+    service = Service()
+    stop = threading.Event()
+    server = threading.Thread(target=service.serve, args=(stop,))
+    server.start()
+
+    invoke = [args.invoker, "--single-instance", "--type=" + args.type, args.application] + args.arguments
+    first = None
+    try:
+        first = subprocess.Popen(invoke)
+        time.sleep(2)
+
+        activation = []
+        invoker = []
+        for i in range(args.count):
+            service.arrived.clear()
+            start = time.monotonic()
+            status = subprocess.call(invoke)
+            exited = time.monotonic()
+
+            if status != 0:
+                print("invoker exited with %d" % status)
+            if not service.arrived.wait(5):
+                print("activation %d did not arrive" % i)
+                continue
+
+            activation.append((service.arrival - start) * 1000)
+            invoker.append((exited - start) * 1000)
+
+        if activation:
+            summary("activation", activation)
+            summary("invoker", invoker)
+    finally:
+        stop.set()
+        server.join()
+        if first:
+            first.terminate()
+
+
+if __name__ == "__main__":
+    main()
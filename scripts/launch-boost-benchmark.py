@@ -0,0 +1,120 @@
+#!/usr/bin/env python3
+
+# Measure what the launch boost (applauncherd --launch-boost=MS) buys a
+# launched application under CPU contention. Run it once against a
+# launcher started with --launch-boost and once against one started
+# without it, and compare.
+#
+# A probe application is built from the source below with CC. It records
+# when main() was entered and then spins for a second, like an application
+# initializing itself, while LOAD busy loops compete for the CPUs. For
+# every launch the time from starting the invoker to main() and the share
+# of the first second the probe got on a CPU are reported.
+#
+# Example: launch-boost-benchmark.py --type=generic --count=20 --load=4
+
+import argparse
+import os
+import subprocess
+import sys
+import tempfile
+import time
+
+PROBE_SOURCE = r"""
+#include <stdio.h>
+#include <time.h>
+
+static long long ns(clockid_t clock)
+{
+    struct timespec t;
+    clock_gettime(clock, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+__attribute__((visibility("default"))) int main(void)
+{
+    const long long start = ns(CLOCK_MONOTONIC);
+    const long long cpu   = ns(CLOCK_PROCESS_CPUTIME_ID);
+
+    while (ns(CLOCK_MONOTONIC) - start < 1000000000LL)
+        ;
+
+    printf("%lld %lld\n", start, ns(CLOCK_PROCESS_CPUTIME_ID) - cpu);
+    fflush(stdout);
+    return 0;
+}
+"""
+
+BUSY_LOOP = "while True: pass"
+
+
+def build_probe(cc, directory):
+    source = os.path.join(directory, "probe.c")
+    probe  = os.path.join(directory, "launch-boost-probe")
+    with open(source, "w") as f:
+        f.write(PROBE_SOURCE)
+
+    # Boosters dlopen() the application. A shared object exporting main()
+    # can be loaded also by C libraries that refuse to load executables,
+    # but it can't be executed if the invoker falls back to exec().
+    subprocess.check_call([cc, "-O2", "-fPIC", "-shared", source, "-o", probe])
+    return probe
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def summary(name, unit, values):
+    print("%-14s min %7.2f  median %7.2f  p90 %7.2f  max %7.2f %s" % (
+        name, min(values), percentile(values, 50), percentile(values, 90), max(values), unit))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Measure time-to-main and first second CPU share")
+    parser.add_argument("--invoker", default="/usr/bin/invoker")
+    parser.add_argument("--type", default="generic")
+    parser.add_argument("--count", type=int, default=10)
+    parser.add_argument("--load", type=int, default=os.cpu_count(),
+                        help="number of competing busy loops (default: number of CPUs)")
+    parser.add_argument("--interval", type=float, default=4,
+                        help="seconds between launches, enough for the booster to respawn")
+    parser.add_argument("--cc", default="cc")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory() as directory:
+        probe = build_probe(args.cc, directory)
+
+        load = [subprocess.Popen([sys.executable, "-c", BUSY_LOOP]) for i in range(args.load)]
+        try:
+            to_main = []
+            share   = []
+            for i in range(args.count):
+                time.sleep(args.interval)
+
+                start  = time.monotonic_ns()
+                output = subprocess.run([args.invoker, "--wait-term", "--type=" + args.type, probe],
+                                        stdout=subprocess.PIPE, universal_newlines=True).stdout
+
+                # The invoker may print to the same output
+                report = [line.split() for line in output.splitlines()
+                          if len(line.split()) == 2 and line.replace(" ", "").isdigit()]
+                if not report:
+                    print("launch %d did not report" % i)
+                    continue
+
+                to_main.append((int(report[0][0]) - start) / 1e6)
+                share.append(int(report[0][1]) / 1e7)
+
+            if to_main:
+                summary("time-to-main", "ms", to_main)
+                summary("cpu share", "%", share)
+        finally:
+            for process in load:
+                process.kill()
+                process.wait()
+
+
+if __name__ == "__main__":
+    main()
@@ -48,6 +48,10 @@ int EBooster::launchProcess()
 
     dummyArgv[argc] = NULL;
 
+    // The launcher ends the launch boost of the pid, which the
+    // executed binary keeps
+    sendLaunchReport();
+
     // Exec the binary (execv returns only in case of an error).
     execv(appData()->fileName().c_str(), dummyArgv);
 
@@ -60,6 +64,12 @@ int EBooster::launchProcess()
     return EXIT_FAILURE;
 }
 
+extern "C" DECL_EXPORT Booster * createBooster()
+{
+    return new EBooster;
+}
+
+#ifndef BOOSTER_PLUGIN
 int main(int argc, char **argv)
 {
     EBooster *booster = new EBooster;
@@ -67,4 +77,5 @@ int main(int argc, char **argv)
     Daemon d(argc, argv);
     d.run(booster);
 }
+#endif
 
@@ -0,0 +1,81 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef BOOSTERSTATUS_H
+#define BOOSTERSTATUS_H
+
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * The launcher publishes the readiness of the booster listening on
+ * "<socket>" in the file "<socket>" BOOSTER_STATUS_SUFFIX next to it. The
+ * file holds a struct booster_status shared by the launcher, the booster
+ * and the invokers mapping it.
+ *
+ * An invoker connecting to a booster that is still sleeping before its
+ * preload, or preloading, blocks until the booster accepts. The invoker
+ * reads ready_at_ms to decide whether to execute the application directly
+ * instead. The fields are advisory and may be read torn.
+ *
+ * Interactive invokers count themselves in interactive while they connect
+ * to the booster; background launches are not given the booster while it
+ * is non-zero. Invokers add their launches to the statistics of their
+ * class, BOOSTER_CLASS_*.
+ *
+ * Until coalesce_until_ms a launch of the type started recently and an
+ * identical launch may share it. Invokers ask the launcher only then.
+ */
+#define BOOSTER_STATUS_SUFFIX  ".status"
+#define BOOSTER_STATUS_VERSION 3
+
+#define BOOSTER_CLASS_INTERACTIVE 0
+#define BOOSTER_CLASS_BACKGROUND  1
+#define BOOSTER_CLASS_COUNT       2
+
+struct booster_class_stats
+{
+    uint32_t launches;        /* launches taken by a booster */
+    uint32_t max_latency_ms;  /* longest time until a booster took a launch */
+    uint64_t latency_us;      /* total time until a booster took the launches */
+    uint32_t fallbacks;       /* launches executed directly */
+    uint32_t reserved;
+};
+
+struct booster_status
+{
+    uint32_t version;
+    uint32_t ready;        /* non-zero while a booster waits for invokers */
+    int64_t  ready_at_ms;  /* estimated CLOCK_MONOTONIC time of readiness */
+    uint32_t preload_ms;   /* duration of the last booster initialization */
+    uint32_t fallbacks;    /* invokers that executed the application directly */
+    uint32_t interactive;  /* interactive invokers connecting to the booster */
+    struct booster_class_stats classes[BOOSTER_CLASS_COUNT];
+    int64_t  coalesce_until_ms;  /* CLOCK_MONOTONIC end of the coalescing window */
+};
+
+/* CLOCK_MONOTONIC time in milliseconds */
+static inline int64_t booster_status_now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+#endif /* BOOSTERSTATUS_H */
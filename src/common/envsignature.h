@@ -0,0 +1,59 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef ENVSIGNATURE_H
+#define ENVSIGNATURE_H
+
+#include <stdint.h>
+
+/*
+ * Environment signatures identify the values of the environment variables
+ * that affect library initialization. The launcher keeps boosters preloaded
+ * under different signatures and the invoker connects to the booster
+ * matching its own environment.
+ *
+ * The launcher lists the variables, one per line, in this file in the
+ * booster socket directory. Boosters for a signature listen on
+ * "<type>.<signature>" where signature is printed with ENV_SIGNATURE_FORMAT.
+ */
+#define ENV_SIGNATURE_VARS_FILE "env-signature-vars"
+#define ENV_SIGNATURE_FORMAT    "%08x"
+#define ENV_SIGNATURE_INIT      2166136261u
+
+/* Fold one variable into a signature (FNV-1a). value is NULL if unset. */
+static inline uint32_t env_signature_add(uint32_t sig, const char *name, const char *value)
+{
+    const char *p;
+
+    for (p = name; *p; p++)
+        sig = (sig ^ (unsigned char)*p) * 16777619u;
+
+    /* Distinguish unset from empty */
+    sig = (sig ^ (value ? '=' : '\1')) * 16777619u;
+
+    if (value)
+    {
+        for (p = value; *p; p++)
+            sig = (sig ^ (unsigned char)*p) * 16777619u;
+    }
+
+    return (sig ^ '\0') * 16777619u;
+}
+
+#endif /* ENVSIGNATURE_H */
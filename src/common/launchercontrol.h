@@ -0,0 +1,214 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef LAUNCHERCONTROL_H
+#define LAUNCHERCONTROL_H
+
+#include <stdint.h>
+
+/*
+ * Requests served by the launcher itself rather than by a booster. The
+ * launcher listens on LAUNCHER_CONTROL_SOCKET in the booster socket
+ * directory. The socket is a SOCK_SEQPACKET socket: every request and
+ * reply is one packet starting with a struct launcher_control_header.
+ */
+#define LAUNCHER_CONTROL_SOCKET  "launcher.control"
+#define LAUNCHER_CONTROL_MAX_MSG 65536
+
+/* Request types */
+#define LAUNCHER_CONTROL_INSTANCE 1   /* application name follows */
+#define LAUNCHER_CONTROL_ACTIVATE 2   /* struct launcher_activate_request follows */
+#define LAUNCHER_CONTROL_BATCH    3   /* struct launcher_batch_request follows */
+#define LAUNCHER_CONTROL_COALESCE 4   /* struct launcher_coalesce_request follows */
+#define LAUNCHER_CONTROL_LAUNCHED 5   /* struct launcher_launched_report follows */
+#define LAUNCHER_CONTROL_ADMIT    6   /* struct launcher_admit_request follows */
+
+struct launcher_control_header
+{
+    uint32_t type;
+};
+
+/*
+ * Reply to LAUNCHER_CONTROL_INSTANCE. If the launcher answers
+ * LAUNCHER_INSTANCE_START the name is reserved for the asking process,
+ * which launches the application through a booster without taking the
+ * lock file of the instance; the launcher tracks the instance until it
+ * exits. A process that executes the application itself, like the
+ * single-instance binary, sends a launcher_launched_report on the same
+ * connection before it does, and the launcher tracks the process as the
+ * instance. The reply is delayed while the instance is being launched
+ * for another process.
+ *
+ * Without a plugin that activates instances without blocking the
+ * launcher relies on the lock files: it answers
+ * LAUNCHER_INSTANCE_START_LOCK instead of LAUNCHER_INSTANCE_START, and
+ * the launch takes the lock as well. With LAUNCHER_INSTANCE_CHECK_LOCK
+ * the instance runs and the existing instance is activated after failing
+ * to take the lock. Lock files are also used if the launcher can't be
+ * asked.
+ */
+#define LAUNCHER_INSTANCE_START             0
+#define LAUNCHER_INSTANCE_ACTIVATED         1
+#define LAUNCHER_INSTANCE_ACTIVATION_FAILED 2
+#define LAUNCHER_INSTANCE_CHECK_LOCK        3
+#define LAUNCHER_INSTANCE_START_LOCK        4
+
+struct launcher_instance_reply
+{
+    struct launcher_control_header header;
+    int32_t status;
+    int32_t pid;       /* running instance, 0 if it is still starting */
+};
+
+/*
+ * LAUNCHER_CONTROL_ACTIVATE launches an application through a booster on
+ * behalf of an activator, e.g. a D-Bus or systemd activation helper. The
+ * request is followed by argc + envc + 3 '\0' terminated strings: the
+ * application id, the booster type, the executable path, the arguments
+ * and the environment. Up to three descriptors passed with SCM_RIGHTS
+ * become the standard input, output and error of the application.
+ *
+ * An application id that is not empty is tracked, activating it again
+ * while it runs answers LAUNCHER_ACTIVATE_RUNNING with its pid.
+ */
+struct launcher_activate_request
+{
+    struct launcher_control_header header;
+    uint32_t options;  /* INVOKER_OPTION_* of libinvoker.h */
+    int32_t priority;
+    uint32_t argc;
+    uint32_t envc;
+};
+
+#define LAUNCHER_ACTIVATE_LAUNCHED 0
+#define LAUNCHER_ACTIVATE_RUNNING  1
+
+struct launcher_activate_reply
+{
+    struct launcher_control_header header;
+    int32_t status;    /* LAUNCHER_ACTIVATE_* or -errno */
+    int32_t pid;
+};
+
+/*
+ * LAUNCHER_CONTROL_BATCH launches several applications that share one
+ * environment and I/O, e.g. on session start. The request is followed by
+ * envc environment strings and count applications, each a struct
+ * launcher_batch_app followed by argc + 3 '\0' terminated strings like in
+ * LAUNCHER_CONTROL_ACTIVATE. Descriptors are passed like there as well.
+ *
+ * The launcher hands the applications to boosters as these become ready
+ * and answers each application with a struct launcher_batch_reply once
+ * it is launched, so the replies may come in any order. Applications
+ * that don't get a booster within LAUNCHER_BATCH_MAX_WAIT_MS are
+ * answered with -EAGAIN.
+ */
+#define LAUNCHER_BATCH_MAX_WAIT_MS 10000
+
+struct launcher_batch_request
+{
+    struct launcher_control_header header;
+    uint32_t count;
+    uint32_t envc;
+    int32_t priority;
+};
+
+struct launcher_batch_app
+{
+    uint32_t options;  /* INVOKER_OPTION_* of libinvoker.h */
+    uint32_t argc;
+};
+
+struct launcher_batch_reply
+{
+    struct launcher_control_header header;
+    uint32_t index;    /* of the application in the request */
+    int32_t status;    /* LAUNCHER_ACTIVATE_* or -errno */
+    int32_t pid;
+};
+
+/*
+ * LAUNCHER_CONTROL_COALESCE is sent before launching an application
+ * through a booster while the status page of the booster type shows a
+ * launch within the coalescing window, see coalesce_until_ms in
+ * boosterstatus.h. The request is followed by argc + 1 '\0' terminated
+ * strings: the executable path and the arguments.
+ *
+ * If the same user launched the same executable with the same arguments
+ * within the coalescing window of the launcher, the launcher answers
+ * LAUNCHER_COALESCE_JOINED and the asking process shares that launch. The
+ * launcher then sends the pid and the wait status of the application on
+ * the connection the way a booster does, as an INVOKER_MSG_PID and an
+ * INVOKER_MSG_EXIT packet each followed by a packet with the value. It
+ * closes the connection instead if the shared launch fails.
+ *
+ * Otherwise the launcher answers LAUNCHER_COALESCE_LAUNCH. The asking
+ * process launches the application and sends a launcher_launched_report
+ * on the same connection once the booster has taken it or the launch
+ * failed.
+ */
+#define LAUNCHER_COALESCE_LAUNCH 0
+#define LAUNCHER_COALESCE_JOINED 1
+
+struct launcher_coalesce_request
+{
+    struct launcher_control_header header;
+    uint32_t argc;
+};
+
+struct launcher_coalesce_reply
+{
+    struct launcher_control_header header;
+    int32_t status;    /* LAUNCHER_COALESCE_* */
+};
+
+struct launcher_launched_report
+{
+    struct launcher_control_header header;
+    int32_t status;    /* 0 or -errno */
+};
+
+/*
+ * LAUNCHER_CONTROL_ADMIT is sent by a background launch, e.g. of a daemon,
+ * before connecting to a booster. The request is followed by the booster
+ * socket id. The launcher queues the request and answers
+ * LAUNCHER_ADMIT_GRANTED once the booster is ready and no interactive
+ * launch is connecting to it or waiting for it. If that doesn't happen
+ * within max_wait_ms, the launcher answers LAUNCHER_ADMIT_TIMEOUT and the
+ * application is executed directly. A max_wait_ms of 0 waits up to
+ * LAUNCHER_ADMIT_MAX_WAIT_MS and is then granted the booster anyway.
+ */
+#define LAUNCHER_ADMIT_MAX_WAIT_MS 10000
+
+#define LAUNCHER_ADMIT_GRANTED 0
+#define LAUNCHER_ADMIT_TIMEOUT 1
+
+struct launcher_admit_request
+{
+    struct launcher_control_header header;
+    uint32_t max_wait_ms;
+};
+
+struct launcher_admit_reply
+{
+    struct launcher_control_header header;
+    int32_t status;    /* LAUNCHER_ADMIT_* */
+};
+
+#endif /* LAUNCHERCONTROL_H */
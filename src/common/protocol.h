@@ -33,6 +33,9 @@ const uint32_t INVOKER_MSG_MAGIC_OPTION_SINGLE_INSTANCE   = 0x00000008;
 /* 0x00000010 was INVOKER_MSG_MAGIC_OPTION_SPLASH_SCREEN */
 const uint32_t INVOKER_MSG_MAGIC_OPTION_OOM_ADJ_DISABLE   = 0x00000020;
 /* 0x00000040 was INVOKER_MSG_MAGIC_OPTION_LANDSCAPE_SPLASH_SCREEN */
+// INVOKER_MSG_EXIT carries the wait status and the invoker is not killed
+// when the application dies of a signal
+const uint32_t INVOKER_MSG_MAGIC_OPTION_WAIT_STATUS       = 0x00000080;
 
 
 const uint32_t INVOKER_MSG_MASK               = 0xffff0000;
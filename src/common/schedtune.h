@@ -0,0 +1,160 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef SCHEDTUNE_H
+#define SCHEDTUNE_H
+
+#include <errno.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+/*
+ * Scheduling settings the launcher changes for launched applications and
+ * boosters that don't have C library wrappers.
+ *
+ * Utilization clamps of a thread (Linux 5.3+) are set with sched_setattr(2).
+ * The scheduling policy and its parameters are kept.
+ */
+
+/* struct sched_attr of sched_setattr(2) */
+struct util_clamp_attr
+{
+    uint32_t size;
+    uint32_t policy;
+    uint64_t flags;
+    int32_t  nice;
+    uint32_t priority;
+    uint64_t runtime;
+    uint64_t deadline;
+    uint64_t period;
+    uint32_t util_min;
+    uint32_t util_max;
+};
+
+#define UTIL_CLAMP_KEEP_POLICY 0x08
+#define UTIL_CLAMP_KEEP_PARAMS 0x10
+#define UTIL_CLAMP_MIN         0x20
+#define UTIL_CLAMP_MAX         0x40
+
+/* Set the clamps of tid (0 is the calling thread), -1 leaves a clamp as it
+ * is. Returns 0 on success, -1 with errno set on failure. */
+static inline int util_clamp_set(pid_t tid, int min, int max)
+{
+#ifdef SYS_sched_setattr
+    struct util_clamp_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size  = sizeof(attr);
+    attr.flags = UTIL_CLAMP_KEEP_POLICY | UTIL_CLAMP_KEEP_PARAMS;
+
+    if (min >= 0)
+    {
+        attr.flags   |= UTIL_CLAMP_MIN;
+        attr.util_min = min;
+    }
+
+    if (max >= 0)
+    {
+        attr.flags   |= UTIL_CLAMP_MAX;
+        attr.util_max = max;
+    }
+
+    return syscall(SYS_sched_setattr, tid, &attr, 0) == -1 ? -1 : 0;
+#else
+    (void)tid;
+    (void)min;
+    (void)max;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+/*
+ * With autogroups every session is scheduled as a group (Linux 2.6.38+), so
+ * the nice value of a process only matters within its session. Boosters
+ * start their own sessions, the nice value of the autogroup is what counts
+ * against other processes.
+ */
+
+/* Return the nice value of the autogroup of pid (0 is the calling process)
+ * or INT_MIN if autogroups are not in use. */
+static inline int autogroup_nice(pid_t pid)
+{
+    char path[64];
+    int enabled = 0;
+    int nice = INT_MIN;
+    FILE *f = fopen("/proc/sys/kernel/sched_autogroup_enabled", "r");
+
+    if (!f)
+        return INT_MIN;
+
+    if (fscanf(f, "%d", &enabled) != 1)
+        enabled = 0;
+    fclose(f);
+
+    if (!enabled)
+        return INT_MIN;
+
+    if (pid)
+        snprintf(path, sizeof(path), "/proc/%d/autogroup", (int)pid);
+    else
+        snprintf(path, sizeof(path), "/proc/self/autogroup");
+
+    /* "/autogroup-<id> nice <nice>" */
+    f = fopen(path, "r");
+    if (!f)
+        return INT_MIN;
+
+    if (fscanf(f, "%*s nice %d", &nice) != 1)
+        nice = INT_MIN;
+    fclose(f);
+
+    return nice;
+}
+
+/* Set the nice value of the autogroup of pid (0 is the calling process).
+ * Returns 0 on success, -1 with errno set on failure. */
+static inline int autogroup_set_nice(pid_t pid, int nice)
+{
+    char path[64];
+    FILE *f;
+    int ok;
+
+    if (pid)
+        snprintf(path, sizeof(path), "/proc/%d/autogroup", (int)pid);
+    else
+        snprintf(path, sizeof(path), "/proc/self/autogroup");
+
+    f = fopen(path, "w");
+    if (!f)
+        return -1;
+
+    ok = fprintf(f, "%d", nice) > 0;
+    if (fclose(f) != 0)
+        ok = 0;
+
+    return ok ? 0 : -1;
+}
+
+#endif /* SCHEDTUNE_H */
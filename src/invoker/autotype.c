@@ -0,0 +1,398 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <glob.h>
+#include <limits.h>
+#include <link.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "report.h"
+#include "autotype.h"
+
+#define DEFAULT_TYPE    "generic"
+#define PRELOAD_SUFFIX  ".preload"
+#define CACHE_FILE      "auto-type.cache"
+#define MAX_CACHE_SIZE  (64 * 1024)
+#define MAX_NEEDED      256
+#define MAX_TYPE_LEN    64
+
+#if __WORDSIZE == 64
+#define NATIVE_CLASS ELFCLASS64
+#else
+#define NATIVE_CLASS ELFCLASS32
+#endif
+
+static char g_type[MAX_TYPE_LEN];
+
+// Directory of the booster sockets and the preload sets published by boosters
+static void socket_dir(char *dir, size_t size)
+{
+    const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
+    if (!runtimeDir || !*runtimeDir)
+        runtimeDir = "/tmp";
+
+    snprintf(dir, size, "%s/mapplauncherd/", runtimeDir);
+}
+
+// Translates a virtual address of the ELF image to a file offset
+static bool vaddr_to_offset(const ElfW(Phdr) *phdr, int phnum, ElfW(Addr) vaddr, size_t *offset)
+{
+    int i;
+    for (i = 0; i < phnum; i++)
+    {
+        if (phdr[i].p_type == PT_LOAD &&
+            vaddr >= phdr[i].p_vaddr && vaddr < phdr[i].p_vaddr + phdr[i].p_filesz)
+        {
+            *offset = vaddr - phdr[i].p_vaddr + phdr[i].p_offset;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Reads the DT_NEEDED entries of a mapped position independent ELF object.
+// Returns the number of entries or -1 if the object can't be boosted.
+static int parse_needed(const char *image, size_t size, char *needed[], int max)
+{
+    const ElfW(Ehdr) *ehdr = (const ElfW(Ehdr) *)image;
+
+    // Non-ELF, foreign and non-PIE (ET_EXEC) binaries are exec'd
+    if (size < sizeof(ElfW(Ehdr)) ||
+        memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+        ehdr->e_ident[EI_CLASS] != NATIVE_CLASS ||
+        ehdr->e_type != ET_DYN ||
+        ehdr->e_phoff + (size_t)ehdr->e_phnum * sizeof(ElfW(Phdr)) > size)
+    {
+        return -1;
+    }
+
+    const ElfW(Phdr) *phdr = (const ElfW(Phdr) *)(image + ehdr->e_phoff);
+    const ElfW(Dyn) *dyn = NULL;
+    size_t dyncount = 0;
+
+    int i;
+    for (i = 0; i < ehdr->e_phnum; i++)
+    {
+        if (phdr[i].p_type == PT_DYNAMIC &&
+            phdr[i].p_offset + phdr[i].p_filesz <= size)
+        {
+            dyn = (const ElfW(Dyn) *)(image + phdr[i].p_offset);
+            dyncount = phdr[i].p_filesz / sizeof(ElfW(Dyn));
+        }
+    }
+
+    if (!dyn)
+        return -1;
+
+    ElfW(Addr) strtab = 0;
+    size_t strsz = 0;
+    size_t j;
+    for (j = 0; j < dyncount && dyn[j].d_tag != DT_NULL; j++)
+    {
+        if (dyn[j].d_tag == DT_STRTAB)
+            strtab = dyn[j].d_un.d_ptr;
+        else if (dyn[j].d_tag == DT_STRSZ)
+            strsz = dyn[j].d_un.d_val;
+    }
+
+    size_t stroff;
+    if (!strtab || !vaddr_to_offset(phdr, ehdr->e_phnum, strtab, &stroff) ||
+        stroff + strsz > size)
+    {
+        return -1;
+    }
+
+    int count = 0;
+    for (j = 0; j < dyncount && dyn[j].d_tag != DT_NULL && count < max; j++)
+    {
+        if (dyn[j].d_tag == DT_NEEDED && dyn[j].d_un.d_val < strsz)
+        {
+            const char *name = image + stroff + dyn[j].d_un.d_val;
+            needed[count++] = strndup(name, strsz - dyn[j].d_un.d_val);
+        }
+    }
+
+    return count;
+}
+
+// Reads the DT_NEEDED entries of a file.
+// Returns the number of entries or -1 if the file can't be boosted.
+static int read_needed(const char *path, char *needed[], int max)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1)
+        return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size == 0)
+    {
+        close(fd);
+        return -1;
+    }
+
+    const char *image = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (image == MAP_FAILED)
+        return -1;
+
+    int count = parse_needed(image, st.st_size, needed, max);
+
+    munmap((void *)image, st.st_size);
+    return count;
+}
+
+// Counts how many of the needed libraries are in the preload set file.
+// The number of libraries in the set is returned in set_size.
+static int match_preload_set(const char *path, char *needed[], int count, int *set_size)
+{
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return -1;
+
+    int matches = 0;
+    char line[PATH_MAX];
+
+    *set_size = 0;
+    while (fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\n")] = '\0';
+        if (!*line)
+            continue;
+
+        (*set_size)++;
+
+        int i;
+        for (i = 0; i < count; i++)
+        {
+            if (needed[i] && !strcmp(needed[i], line))
+            {
+                matches++;
+
+                // Count every needed library only once
+                free(needed[i]);
+                needed[i] = NULL;
+            }
+        }
+    }
+
+    fclose(file);
+    return matches;
+}
+
+// Fingerprint of the published preload sets. Cached results are only
+// valid as long as the set of booster types and their preloads are the same.
+static void preload_sets_stamp(glob_t *sets, char *stamp, size_t size)
+{
+    time_t newest = 0;
+    size_t i;
+
+    for (i = 0; i < sets->gl_pathc; i++)
+    {
+        struct stat st;
+        if (stat(sets->gl_pathv[i], &st) == 0 && st.st_mtime > newest)
+            newest = st.st_mtime;
+    }
+
+    snprintf(stamp, size, "preloads %lu %ld", (unsigned long)sets->gl_pathc, (long)newest);
+}
+
+static bool cache_lookup(const char *cache_path, const char *stamp,
+                         const char *prog_name, const struct stat *prog_st)
+{
+    FILE *cache = fopen(cache_path, "r");
+    if (!cache)
+        return false;
+
+    bool found = false;
+    char line[PATH_MAX + 128];
+
+    if (fgets(line, sizeof(line), cache) && !strncmp(line, stamp, strlen(stamp)) &&
+        line[strlen(stamp)] == '\n')
+    {
+        while (!found && fgets(line, sizeof(line), cache))
+        {
+            long mtime;
+            char type[MAX_TYPE_LEN];
+            int pos;
+
+            line[strcspn(line, "\n")] = '\0';
+            if (sscanf(line, "%ld %63s %n", &mtime, type, &pos) == 2 &&
+                mtime == (long)prog_st->st_mtime && !strcmp(line + pos, prog_name))
+            {
+                strcpy(g_type, type);
+                found = true;
+            }
+        }
+    }
+
+    fclose(cache);
+    return found;
+}
+
+static void cache_store(const char *cache_path, const char *stamp,
+                        const char *prog_name, const struct stat *prog_st)
+{
+    // Start a new cache if the preload sets have changed or it has grown too big
+    bool restart = true;
+
+    FILE *cache = fopen(cache_path, "r");
+    if (cache)
+    {
+        char line[PATH_MAX + 128];
+        struct stat st;
+
+        if (fgets(line, sizeof(line), cache) && !strncmp(line, stamp, strlen(stamp)) &&
+            line[strlen(stamp)] == '\n' && fstat(fileno(cache), &st) == 0 &&
+            st.st_size < MAX_CACHE_SIZE)
+        {
+            restart = false;
+        }
+
+        fclose(cache);
+    }
+
+    int fd = open(cache_path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC | (restart ? O_TRUNC : 0), 0600);
+    if (fd == -1)
+        return;
+
+    char entry[PATH_MAX + 128];
+    int len = 0;
+
+    if (restart)
+        len = snprintf(entry, sizeof(entry), "%s\n", stamp);
+
+    len += snprintf(entry + len, sizeof(entry) - len, "%ld %s %s\n",
+                    (long)prog_st->st_mtime, g_type, prog_name);
+
+    // Single write keeps concurrent invokers from interleaving entries
+    if (len < (int)sizeof(entry) && write(fd, entry, len) != len)
+        warning("Failed to write %s\n", cache_path);
+
+    close(fd);
+}
+
+const char *auto_select_type(const char *prog_name)
+{
+    char dir[PATH_MAX];
+    socket_dir(dir, sizeof(dir));
+
+    strcpy(g_type, DEFAULT_TYPE);
+
+    struct stat prog_st;
+    if (stat(prog_name, &prog_st) == -1)
+        return g_type;
+
+    // Paths that don't fit are not looked at, DEFAULT_TYPE is used
+    char pattern[PATH_MAX];
+    if (snprintf(pattern, sizeof(pattern), "%s*" PRELOAD_SUFFIX, dir) >= (int)sizeof(pattern))
+        return g_type;
+
+    glob_t sets;
+    if (glob(pattern, 0, NULL, &sets) != 0)
+    {
+        globfree(&sets);
+        return g_type;
+    }
+
+    char stamp[64];
+    preload_sets_stamp(&sets, stamp, sizeof(stamp));
+
+    char cache_path[PATH_MAX];
+    if (snprintf(cache_path, sizeof(cache_path), "%s" CACHE_FILE, dir) >= (int)sizeof(cache_path))
+    {
+        globfree(&sets);
+        return g_type;
+    }
+
+    if (cache_lookup(cache_path, stamp, prog_name, &prog_st))
+    {
+        debug("Cached booster type for %s: %s\n", prog_name, g_type);
+        globfree(&sets);
+        return g_type;
+    }
+
+    char *needed[MAX_NEEDED];
+    int count = read_needed(prog_name, needed, MAX_NEEDED);
+
+    int best_matches = 0;
+    int best_size = 0;
+    size_t i;
+
+    for (i = 0; i < sets.gl_pathc && count > 0; i++)
+    {
+        const char *path = sets.gl_pathv[i];
+        const char *name = path + strlen(dir);
+        size_t name_len = strlen(name) - strlen(PRELOAD_SUFFIX);
+
+        if (name_len == 0 || name_len >= MAX_TYPE_LEN)
+            continue;
+
+        // Only consider types that have a booster socket
+        char socket_path[PATH_MAX];
+        struct stat st;
+        snprintf(socket_path, sizeof(socket_path), "%.*s", (int)(strlen(path) - strlen(PRELOAD_SUFFIX)), path);
+        if (stat(socket_path, &st) == -1 || !S_ISSOCK(st.st_mode))
+            continue;
+
+        // match_preload_set() consumes matched entries, use a copy
+        char *left[MAX_NEEDED];
+        int j;
+        for (j = 0; j < count; j++)
+            left[j] = strdup(needed[j]);
+
+        int size = 0;
+        int matches = match_preload_set(path, left, count, &size);
+
+        for (j = 0; j < count; j++)
+            free(left[j]);
+
+        debug("Booster type %.*s preloads %d of %d needed libraries\n", (int)name_len, name, matches, count);
+
+        // Prefer the type with most matches and on a tie the smaller preload
+        if (matches > best_matches || (matches == best_matches && matches > 0 && size < best_size))
+        {
+            best_matches = matches;
+            best_size = size;
+            snprintf(g_type, sizeof(g_type), "%.*s", (int)name_len, name);
+        }
+    }
+
+    int j;
+    for (j = 0; j < count; j++)
+        free(needed[j]);
+
+    globfree(&sets);
+
+    debug("Selected booster type for %s: %s\n", prog_name, g_type);
+    cache_store(cache_path, stamp, prog_name, &prog_st);
+
+    return g_type;
+}
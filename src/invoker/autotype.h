@@ -0,0 +1,32 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef AUTOTYPE_H
+#define AUTOTYPE_H
+
+/*
+ * Returns the booster type whose preloaded libraries best match the
+ * libraries the program depends on (DT_NEEDED). Programs that are not
+ * position independent ELF objects, and programs none of the running
+ * booster types fit, get the exec-style "generic" booster.
+ * Results are cached by path and modification time.
+ */
+const char *auto_select_type(const char *prog_name);
+
+#endif
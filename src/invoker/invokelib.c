@@ -17,19 +17,78 @@
 **
 ****************************************************************************/
 
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdarg.h>
 #include <stdint.h>
 #include <stdbool.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <unistd.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <syslog.h>
 
-#include "report.h"
+#include "protocol.h"
+#include "envsignature.h"
+#include "boosterstatus.h"
+#include "launchercontrol.h"
 #include "invokelib.h"
+#include "libinvoker.h"
+
+// Environment
+extern char ** environ;
+
+// Receiver of the messages of the library, the library is silent
+// unless the program sets one
+static invoker_report_func g_report = NULL;
+
+void invoker_set_report(invoker_report_func func)
+{
+    g_report = func;
+}
 
-void invoke_send_msg(int fd, uint32_t msg)
+static void invoker_report(int priority, const char *msg, ...)
+{
+    if (!g_report)
+        return;
+
+    // The caller may still look at errno
+    const int saved_errno = errno;
+
+    char str[400];
+    va_list arg;
+    va_start(arg, msg);
+    vsnprintf(str, sizeof(str), msg, arg);
+    va_end(arg);
+
+    g_report(priority, str);
+    errno = saved_errno;
+}
+
+#ifndef DEBUG_LOGGING_DISABLED
+#define debug(msg, ...) invoker_report(LOG_DEBUG, msg, ##__VA_ARGS__)
+#else
+#define debug(...)
+#endif
+
+#define warning(msg, ...) invoker_report(LOG_WARNING, msg, ##__VA_ARGS__)
+#define error(msg, ...) invoker_report(LOG_ERR, msg, ##__VA_ARGS__)
+
+bool invoke_send_msg(int fd, uint32_t msg)
 {
     debug("%s: %08x\n", __FUNCTION__, msg);
-    write(fd, &msg, sizeof(msg));
+    return send(fd, &msg, sizeof(msg), MSG_NOSIGNAL) == sizeof(msg);
 }
 
 bool invoke_recv_msg(int fd, uint32_t *msg)
@@ -58,7 +117,7 @@ bool invoke_recv_msg(int fd, uint32_t *msg)
     }
 }
 
-void invoke_send_str(int fd, char *str)
+bool invoke_send_str(int fd, const char *str)
 {
     if (str)
     {
@@ -66,12 +125,1149 @@ void invoke_send_str(int fd, char *str)
 
         /* Send size. */
         size = strlen(str) + 1;
-        invoke_send_msg(fd, size);
+        if (!invoke_send_msg(fd, size))
+            return false;
 
         debug("%s: '%s'\n", __FUNCTION__, str);
 
         /* Send the string. */
-        write(fd, str, size);
+        return send(fd, str, size, MSG_NOSIGNAL) == (ssize_t)size;
+    }
+
+    return true;
+}
+
+// Returns the directory of the launcher sockets
+static const char *invoker_runtime_dir(void)
+{
+    const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
+    return runtimeDir && *runtimeDir ? runtimeDir : "/tmp";
+}
+
+// Inits a socket connection for the given application type. With a
+// timeout_ms connecting, sending and receiving fail with EAGAIN after it.
+static int invoker_init(const char *app_type, unsigned int timeout_ms)
+{
+    struct sockaddr_un sun;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+
+    if (strchr(app_type, '/') ||
+        snprintf(sun.sun_path, sizeof(sun.sun_path), "%s/mapplauncherd/%s",
+                 invoker_runtime_dir(), app_type) >= (int)sizeof(sun.sun_path))
+    {
+        error("Invalid type of application: %s\n", app_type);
+        errno = EINVAL;
+        return -1;
+    }
+
+    int fd = socket(PF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        error("Failed to open invoker socket.\n");
+        return -1;
+    }
+
+    if (timeout_ms)
+    {
+        struct timeval timeout;
+        timeout.tv_sec  = timeout_ms / 1000;
+        timeout.tv_usec = (timeout_ms % 1000) * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    }
+
+    if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0)
+    {
+        int err = errno;
+        debug("Failed to initiate connect on the socket %s.\n", sun.sun_path);
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    return fd;
+}
+
+// Finds the booster preloaded under the same values of the environment
+// variables the launcher keys boosters by. Returns false if there is none.
+static bool invoker_signature_type(const char *app_type, char **envp, char *sig_type, size_t size)
+{
+    const char *runtimeDir = invoker_runtime_dir();
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/mapplauncherd/%s", runtimeDir, ENV_SIGNATURE_VARS_FILE);
+
+    FILE *vars = fopen(path, "re");
+    if (!vars)
+        return false;
+
+    uint32_t sig = ENV_SIGNATURE_INIT;
+    char name[256];
+    while (fgets(name, sizeof(name), vars))
+    {
+        name[strcspn(name, "\n")] = '\0';
+        if (!*name)
+            continue;
+
+        // Look the variable up in the environment of the application
+        const char *value = NULL;
+        size_t len = strlen(name);
+        for (char **env = envp; *env; env++)
+        {
+            if (!strncmp(*env, name, len) && (*env)[len] == '=')
+            {
+                value = *env + len + 1;
+                break;
+            }
+        }
+
+        sig = env_signature_add(sig, name, value);
+    }
+
+    fclose(vars);
+
+    if (snprintf(sig_type, size, "%s." ENV_SIGNATURE_FORMAT, app_type, sig) >= (int)size)
+        return false;
+
+    // Socket path must fit into sun_path
+    struct sockaddr_un sun;
+    if (snprintf(path, sizeof(path), "%s/mapplauncherd/%s", runtimeDir, sig_type) >= (int)sizeof(sun.sun_path))
+        return false;
+
+    return access(path, F_OK) == 0;
+}
+
+// Maps the readiness status the launcher publishes for the booster
+// listening on the socket of app_type. Returns NULL if there is none.
+static struct booster_status *invoker_map_status(const char *app_type)
+{
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/mapplauncherd/%s" BOOSTER_STATUS_SUFFIX,
+                 invoker_runtime_dir(), app_type) >= (int)sizeof(path))
+        return NULL;
+
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    struct stat st;
+    void *page = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= (off_t)sizeof(struct booster_status))
+        page = mmap(NULL, sizeof(struct booster_status), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    close(fd);
+
+    if (page == MAP_FAILED)
+        return NULL;
+
+    struct booster_status *status = page;
+    if (status->version != BOOSTER_STATUS_VERSION)
+    {
+        munmap(page, sizeof(struct booster_status));
+        return NULL;
+    }
+
+    return status;
+}
+
+// Counts a launch of the class that executes the application directly
+static void invoker_count_fallback(struct booster_status *status, int launch_class)
+{
+    if (status)
+    {
+        __sync_fetch_and_add(&status->fallbacks, 1);
+        __sync_fetch_and_add(&status->classes[launch_class].fallbacks, 1);
+    }
+}
+
+// Returns true if the booster with the status is not expected to accept
+// within max_wait milliseconds. Unknown readiness counts as ready.
+static bool invoker_booster_late(struct booster_status *status, unsigned int max_wait, int launch_class)
+{
+    if (!max_wait || !status)
+        return false;
+
+    int64_t wait = status->ready ? 0 : status->ready_at_ms - booster_status_now_ms();
+    bool late = wait > (int64_t)max_wait;
+    if (late)
+        invoker_count_fallback(status, launch_class);
+
+    return late;
+}
+
+// Returns CLOCK_MONOTONIC time in microseconds
+static int64_t invoker_now_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+// Adds a launch taken by the booster to the statistics of its class
+static void invoker_count_launch(struct booster_status *status, int launch_class, int64_t start_us)
+{
+    if (!status)
+        return;
+
+    struct booster_class_stats *stats = &status->classes[launch_class];
+    int64_t latency = invoker_now_us() - start_us;
+
+    __sync_fetch_and_add(&stats->launches, 1);
+    __sync_fetch_and_add(&stats->latency_us, (uint64_t)latency);
+    if (latency / 1000 > stats->max_latency_ms)
+        stats->max_latency_ms = latency / 1000;
+}
+
+// Stops counting an interactive launch as connecting and unmaps the status
+static void invoker_release_status(struct booster_status *status, int launch_class)
+{
+    if (!status)
+        return;
+
+    if (launch_class == BOOSTER_CLASS_INTERACTIVE)
+        __sync_fetch_and_sub(&status->interactive, 1);
+
+    munmap(status, sizeof(struct booster_status));
+}
+
+// Connects to the launcher control socket. Returns the connection or -1.
+static int control_connect(void)
+{
+    struct sockaddr_un sun;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    if (snprintf(sun.sun_path, sizeof(sun.sun_path), "%s/mapplauncherd/" LAUNCHER_CONTROL_SOCKET,
+                 invoker_runtime_dir()) >= (int)sizeof(sun.sun_path))
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+
+    int fd = socket(PF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+
+    if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0)
+    {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    return fd;
+}
+
+// Request packet for the launcher control socket
+struct control_packet
+{
+    char data[LAUNCHER_CONTROL_MAX_MSG];
+    size_t size;
+    bool overflow;
+};
+
+static void packet_add(struct control_packet *packet, const void *data, size_t len)
+{
+    if (packet->overflow || len > sizeof(packet->data) - packet->size)
+    {
+        packet->overflow = true;
+        return;
+    }
+
+    memcpy(packet->data + packet->size, data, len);
+    packet->size += len;
+}
+
+static void packet_add_str(struct control_packet *packet, const char *str)
+{
+    packet_add(packet, str, strlen(str) + 1);
+}
+
+// Adds the id, type, executable and arguments of an application
+static void packet_add_app(struct control_packet *packet, const struct invoker_params *params, const char *app_id)
+{
+    packet_add_str(packet, app_id ? app_id : "");
+    packet_add_str(packet, params->type);
+    packet_add_str(packet, params->exec);
+    for (int i = 0; i < params->argc; i++)
+        packet_add_str(packet, params->argv[i]);
+}
+
+static bool params_valid(const struct invoker_params *params)
+{
+    return params->type && params->exec && params->argc >= 1 && params->argv;
+}
+
+// Sends the packet with the I/O descriptors of params to the launcher.
+// Returns the connection for reading the replies or -1.
+static int control_send(struct control_packet *packet, const struct invoker_params *params)
+{
+    if (packet->overflow)
+    {
+        errno = E2BIG;
+        return -1;
+    }
+
+    int fd = control_connect();
+    if (fd < 0)
+        return -1;
+
+    struct iovec iov;
+    iov.iov_base = packet->data;
+    iov.iov_len  = packet->size;
+
+    char buf[CMSG_SPACE(3 * sizeof(int))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = buf;
+    msg.msg_controllen = sizeof(buf);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_len   = CMSG_LEN(3 * sizeof(int));
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type  = SCM_RIGHTS;
+    memcpy(CMSG_DATA(cmsg), params->io, 3 * sizeof(int));
+
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) < 0)
+    {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+
+    return fd;
+}
+
+// Asks the launcher whether the single instance application name is
+// already running. The launcher activates the running instance, or
+// reserves the name for this process. Returns the LAUNCHER_INSTANCE_*
+// status or -1 if the launcher doesn't answer.
+static int invoker_check_instance(const char *name)
+{
+    size_t name_len = strlen(name);
+    struct launcher_control_header header = { LAUNCHER_CONTROL_INSTANCE };
+    if (sizeof(header) + name_len > LAUNCHER_CONTROL_MAX_MSG)
+        return -1;
+
+    int fd = control_connect();
+    if (fd < 0)
+        return -1;
+
+    struct iovec iov[2];
+    iov[0].iov_base = &header;
+    iov[0].iov_len  = sizeof(header);
+    iov[1].iov_base = (void *)name;
+    iov[1].iov_len  = name_len;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 2;
+
+    struct launcher_instance_reply reply;
+    int status = -1;
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) >= 0 &&
+        recv(fd, &reply, sizeof(reply), 0) == sizeof(reply) &&
+        reply.header.type == LAUNCHER_CONTROL_INSTANCE)
+    {
+        status = reply.status;
+        if (status != LAUNCHER_INSTANCE_START)
+        {
+            debug("%s is already running (pid %d)\n", name, reply.pid);
+        }
+    }
+
+    close(fd);
+    return status;
+}
+
+// Asks the launcher to give the booster of app_type to a background
+// launch once no interactive launch wants it. Returns false if that
+// didn't happen within max_wait milliseconds. Returns true if the
+// launcher doesn't answer.
+static bool invoker_admit(const char *app_type, unsigned int max_wait)
+{
+    size_t type_len = strlen(app_type);
+    struct launcher_admit_request request;
+    memset(&request, 0, sizeof(request));
+    request.header.type = LAUNCHER_CONTROL_ADMIT;
+    request.max_wait_ms = max_wait;
+    if (sizeof(request) + type_len > LAUNCHER_CONTROL_MAX_MSG)
+        return true;
+
+    int fd = control_connect();
+    if (fd < 0)
+        return true;
+
+    struct iovec iov[2];
+    iov[0].iov_base = &request;
+    iov[0].iov_len  = sizeof(request);
+    iov[1].iov_base = (void *)app_type;
+    iov[1].iov_len  = type_len;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 2;
+
+    struct launcher_admit_reply reply;
+    bool granted = true;
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) >= 0 &&
+        recv(fd, &reply, sizeof(reply), 0) == sizeof(reply) &&
+        reply.header.type == LAUNCHER_CONTROL_ADMIT)
+    {
+        granted = reply.status == LAUNCHER_ADMIT_GRANTED;
+        if (!granted)
+        {
+            debug("Booster %s is kept for interactive launches\n", app_type);
+        }
+    }
+
+    close(fd);
+    return granted;
+}
+
+// Returns true if a launch of the application type started within the
+// coalescing window of the launcher, so that this launch may share it
+static bool invoker_coalescing(const char *app_type)
+{
+    struct booster_status *page = invoker_map_status(app_type);
+    if (!page)
+        return false;
+
+    bool coalescing = page->coalesce_until_ms > booster_status_now_ms();
+    munmap(page, sizeof(struct booster_status));
+    return coalescing;
+}
+
+// Asks the launcher whether the same application with the same arguments
+// is being launched. Returns LAUNCHER_COALESCE_JOINED if this launch
+// shares it or LAUNCHER_COALESCE_LAUNCH if this process launches it, with
+// the connection to the launcher in fd. Returns -1 if the launcher doesn't
+// answer.
+static int invoker_coalesce(const struct invoker_params *params, int *fd)
+{
+    struct launcher_coalesce_request request;
+    memset(&request, 0, sizeof(request));
+    request.header.type = LAUNCHER_CONTROL_COALESCE;
+    request.argc        = params->argc;
+
+    struct control_packet *packet = calloc(1, sizeof(*packet));
+    if (!packet)
+        return -1;
+
+    packet_add(packet, &request, sizeof(request));
+    packet_add_str(packet, params->exec);
+    for (int i = 0; i < params->argc; i++)
+        packet_add_str(packet, params->argv[i]);
+
+    int conn = packet->overflow ? -1 : control_connect();
+    bool sent = conn >= 0 && send(conn, packet->data, packet->size, MSG_NOSIGNAL) >= 0;
+    free(packet);
+
+    struct launcher_coalesce_reply reply;
+    if (!sent ||
+        recv(conn, &reply, sizeof(reply), 0) != sizeof(reply) ||
+        reply.header.type != LAUNCHER_CONTROL_COALESCE)
+    {
+        if (conn >= 0)
+            close(conn);
+        return -1;
+    }
+
+    if (reply.status == LAUNCHER_COALESCE_JOINED)
+    {
+        debug("%s is being launched already, sharing the launch\n", params->exec);
+    }
+
+    *fd = conn;
+    return reply.status;
+}
+
+// Tells the launcher the result of a launch it let this process do and
+// closes the connection. Keeps errno.
+static void invoker_report_launch(int fd, int status)
+{
+    int err = errno;
+
+    struct launcher_launched_report report;
+    memset(&report, 0, sizeof(report));
+    report.header.type = LAUNCHER_CONTROL_LAUNCHED;
+    report.status      = status;
+
+    send(fd, &report, sizeof(report), MSG_NOSIGNAL);
+    close(fd);
+
+    errno = err;
+}
+
+// Receive ACK
+static bool invoke_recv_ack(int fd)
+{
+    uint32_t action;
+
+    if (!invoke_recv_msg(fd, &action) || action != INVOKER_MSG_ACK)
+    {
+        error("Received wrong ack (%08x)\n", action);
+        return false;
+    }
+
+    return true;
+}
+
+// Receives pid of the invoked process.
+// Invoker doesn't know it, because the launcher daemon
+// is the one who forks.
+static bool invoker_recv_pid(int fd, pid_t *pid)
+{
+    // Receive action.
+    uint32_t action;
+    if (!invoke_recv_msg(fd, &action) || action != INVOKER_MSG_PID)
+    {
+        error("Received a bad message id (%08x)\n", action);
+        return false;
+    }
+
+    // Receive pid.
+    uint32_t value = 0;
+    if (!invoke_recv_msg(fd, &value) || value == 0)
+    {
+        error("Received a zero pid \n");
+        return false;
+    }
+
+    *pid = value;
+    return true;
+}
+
+// Sends magic number / protocol version
+static bool invoker_send_magic(int fd, uint32_t options)
+{
+    // Send magic.
+    return invoke_send_msg(fd, INVOKER_MSG_MAGIC | INVOKER_MSG_MAGIC_VERSION | options);
+}
+
+// Sends the process name to be invoked.
+static bool invoker_send_name(int fd, const char *name)
+{
+    return invoke_send_msg(fd, INVOKER_MSG_NAME) &&
+           invoke_send_str(fd, name);
+}
+
+static bool invoker_send_exec(int fd, const char *exec)
+{
+    return invoke_send_msg(fd, INVOKER_MSG_EXEC) &&
+           invoke_send_str(fd, exec);
+}
+
+static bool invoker_send_args(int fd, int argc, char **argv)
+{
+    int i;
+
+    if (!invoke_send_msg(fd, INVOKER_MSG_ARGS) ||
+        !invoke_send_msg(fd, argc))
+        return false;
+
+    for (i = 0; i < argc; i++)
+    {
+        debug("param %d %s \n", i, argv[i]);
+        if (!invoke_send_str(fd, argv[i]))
+            return false;
     }
+
+    return true;
+}
+
+static bool invoker_send_prio(int fd, int prio)
+{
+    return invoke_send_msg(fd, INVOKER_MSG_PRIO) &&
+           invoke_send_msg(fd, prio);
+}
+
+// Sends booster respawn delay
+static bool invoker_send_delay(int fd, int delay)
+{
+    return invoke_send_msg(fd, INVOKER_MSG_DELAY) &&
+           invoke_send_msg(fd, delay);
 }
 
+// Sends UID and GID
+static bool invoker_send_ids(int fd, int uid, int gid)
+{
+    return invoke_send_msg(fd, INVOKER_MSG_IDS) &&
+           invoke_send_msg(fd, uid) &&
+           invoke_send_msg(fd, gid);
+}
+
+// Sends the environment variables
+static bool invoker_send_env(int fd, char **envp)
+{
+    int i, n_vars;
+
+    // Count environment variables.
+    for (n_vars = 0; envp[n_vars] != NULL; n_vars++) ;
+
+    if (!invoke_send_msg(fd, INVOKER_MSG_ENV) ||
+        !invoke_send_msg(fd, n_vars))
+        return false;
+
+    for (i = 0; i < n_vars; i++)
+    {
+        if (!invoke_send_str(fd, envp[i]))
+            return false;
+    }
+
+    return true;
+}
+
+// Sends I/O descriptors
+static bool invoker_send_io(int fd, const int io[3])
+{
+    struct msghdr msg;
+    struct cmsghdr *cmsg = NULL;
+    char buf[CMSG_SPACE(3 * sizeof(int))];
+    struct iovec iov;
+    int dummy = 0;
+
+    memset(&msg, 0, sizeof(struct msghdr));
+
+    iov.iov_base = &dummy;
+    iov.iov_len = 1;
+
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = buf;
+    msg.msg_controllen = sizeof(buf);
+
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_len = CMSG_LEN(3 * sizeof(int));
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+
+    memcpy(CMSG_DATA(cmsg), io, 3 * sizeof(int));
+
+    msg.msg_controllen = cmsg->cmsg_len;
+
+    if (!invoke_send_msg(fd, INVOKER_MSG_IO))
+        return false;
+
+    if (sendmsg(fd, &msg, MSG_NOSIGNAL) < 0)
+    {
+        warning("sendmsg failed in invoker_send_io: %s \n", strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+// Sends the END message
+static bool invoker_send_end(int fd)
+{
+    return invoke_send_msg(fd, INVOKER_MSG_END) &&
+           invoke_recv_ack(fd);
+}
+
+// Connects to the booster of the application type. The booster preloaded
+// under the same environment is preferred. Interactive launches count
+// themselves in the status of the booster until the caller releases it,
+// background launches wait for the launcher to admit them.
+static int invoker_connect(const struct invoker_params *params, char **envp, unsigned int max_wait,
+                           int launch_class, struct booster_status **status)
+{
+    char sig_type[256];
+    const char *types[2];
+    int count = 0;
+
+    if (invoker_signature_type(params->type, envp, sig_type, sizeof(sig_type)))
+    {
+        debug("Using booster for environment signature: %s\n", sig_type);
+        types[count++] = sig_type;
+    }
+
+    types[count++] = params->type;
+
+    // A caller that must not block doesn't wait for a booster that is
+    // still preloading, even if it is expected to be ready already
+    bool timeout = params->options & INVOKER_OPTION_TIMEOUT;
+
+    for (int i = 0; i < count; i++)
+    {
+        bool last = i == count - 1;
+        struct booster_status *page = invoker_map_status(types[i]);
+
+        bool late = invoker_booster_late(page, max_wait, launch_class) ||
+                    (timeout && page && !page->ready);
+        bool denied = !late && launch_class == BOOSTER_CLASS_BACKGROUND && !invoker_admit(types[i], max_wait);
+        if (late || denied)
+        {
+            if (late)
+            {
+                debug("Booster %s is expected to be ready in %lld ms\n", types[i],
+                      (long long)(page->ready_at_ms - booster_status_now_ms()));
+            }
+
+            if (denied && last)
+                invoker_count_fallback(page, launch_class);
+            if (page)
+                munmap(page, sizeof(struct booster_status));
+            if (last)
+                errno = EAGAIN;
+            continue;
+        }
+
+        if (page && launch_class == BOOSTER_CLASS_INTERACTIVE)
+            __sync_fetch_and_add(&page->interactive, 1);
+
+        int fd = invoker_init(types[i], timeout ? max_wait : 0);
+        if (fd != -1)
+        {
+            *status = page;
+            return fd;
+        }
+
+        invoker_release_status(page, launch_class);
+    }
+
+    return -1;
+}
+
+// Sends the application to a booster. Returns the connection to it or -1.
+static int invoker_send_to_booster(const struct invoker_params *params, char **envp,
+                                   uint32_t magic_options, unsigned int max_wait,
+                                   bool wait, pid_t *pid)
+{
+    int64_t start_us = invoker_now_us();
+    int launch_class = params->options & INVOKER_OPTION_BACKGROUND ?
+        BOOSTER_CLASS_BACKGROUND : BOOSTER_CLASS_INTERACTIVE;
+
+    struct booster_status *status = NULL;
+    int fd = invoker_connect(params, envp, max_wait, launch_class, &status);
+    if (fd == -1)
+        return -1;
+
+    // Connection with launcher process is established,
+    // send the data.
+    if (!invoker_send_magic(fd, magic_options) ||
+        !invoker_send_name(fd, params->argv[0]) ||
+        !invoker_send_exec(fd, params->exec) ||
+        !invoker_send_args(fd, params->argc, params->argv) ||
+        !invoker_send_prio(fd, params->priority) ||
+        !invoker_send_delay(fd, params->respawn_delay) ||
+        !invoker_send_ids(fd, getuid(), getgid()) ||
+        !invoker_send_io(fd, params->io) ||
+        !invoker_send_env(fd, envp) ||
+        !invoker_send_end(fd) ||
+        (wait && !invoker_recv_pid(fd, pid)))
+    {
+        const bool timed_out = (params->options & INVOKER_OPTION_TIMEOUT) &&
+            (errno == EAGAIN || errno == EWOULDBLOCK);
+        invoker_release_status(status, launch_class);
+        close(fd);
+        errno = timed_out ? ETIMEDOUT : EPROTO;
+        return -1;
+    }
+
+    invoker_count_launch(status, launch_class, start_us);
+    invoker_release_status(status, launch_class);
+    return fd;
+}
+
+// Sends the application to a booster. Returns the connection to it, -1
+// on error or -2 if the running single instance was activated.
+static int invoker_send_application(const struct invoker_params *params, bool wait, pid_t *pid)
+{
+    if (!params->type || !params->exec || params->argc < 1 || !params->argv)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    char **envp = params->envp ? params->envp : environ;
+    unsigned int max_wait = params->max_wait;
+    uint32_t magic_options = 0;
+
+    if (params->options & INVOKER_OPTION_GLOBAL_SYMS)
+        magic_options |= INVOKER_MSG_MAGIC_OPTION_DLOPEN_GLOBAL;
+    if (params->options & INVOKER_OPTION_DEEP_SYMS)
+        magic_options |= INVOKER_MSG_MAGIC_OPTION_DLOPEN_DEEP;
+    if (params->options & INVOKER_OPTION_DAEMON_MODE)
+        magic_options |= INVOKER_MSG_MAGIC_OPTION_OOM_ADJ_DISABLE;
+
+    // The pid is sent only to waiting invokers. These get the wait status
+    // instead of the launcher killing them with the signal that killed
+    // the application.
+    if (wait)
+        magic_options |= INVOKER_MSG_MAGIC_OPTION_WAIT | INVOKER_MSG_MAGIC_OPTION_WAIT_STATUS;
+
+    if (params->options & INVOKER_OPTION_SINGLE_INSTANCE)
+    {
+        // Executing directly would defeat the single instance check
+        max_wait = 0;
+
+        // The launcher tracks single instance applications it has
+        // launched, ask it before taking a booster
+        switch (invoker_check_instance(params->argv[0]))
+        {
+        case LAUNCHER_INSTANCE_ACTIVATED:
+            return -2;
+
+        case LAUNCHER_INSTANCE_ACTIVATION_FAILED:
+            error("Can't activate existing instance of %s\n", params->argv[0]);
+            errno = EEXIST;
+            return -1;
+
+        case LAUNCHER_INSTANCE_START:
+            // The launcher's reservation is all the booster needs
+            break;
+
+        default:
+            // The booster locks the instance, or activates it if it
+            // is locked
+            magic_options |= INVOKER_MSG_MAGIC_OPTION_SINGLE_INSTANCE;
+            break;
+        }
+    }
+
+    // Interactive launches share an identical launch in flight. The
+    // launcher is asked only if the status of the booster shows one.
+    int coalesce_fd = -1;
+    if (!(params->options & (INVOKER_OPTION_NO_COALESCE | INVOKER_OPTION_SINGLE_INSTANCE |
+                             INVOKER_OPTION_BACKGROUND)) &&
+        invoker_coalescing(params->type) &&
+        invoker_coalesce(params, &coalesce_fd) == LAUNCHER_COALESCE_JOINED)
+    {
+        // The launcher reports the application of the identical launch on
+        // the connection. It closes the connection if that launch fails.
+        uint32_t action = 0;
+        uint32_t value = 0;
+        if (!wait ||
+            (invoke_recv_msg(coalesce_fd, &action) && action == INVOKER_MSG_PID &&
+             invoke_recv_msg(coalesce_fd, &value) && value != 0))
+        {
+            if (wait)
+                *pid = value;
+            return coalesce_fd;
+        }
+
+        debug("Shared launch of %s failed, launching it\n", params->exec);
+        close(coalesce_fd);
+        coalesce_fd = -1;
+    }
+
+    int fd = invoker_send_to_booster(params, envp, magic_options, max_wait, wait, pid);
+    if (coalesce_fd != -1)
+        invoker_report_launch(coalesce_fd, fd < 0 ? -(errno ? errno : EPROTO) : 0);
+
+    return fd;
+}
+
+void invoker_params_init(struct invoker_params *params)
+{
+    memset(params, 0, sizeof(*params));
+
+    // Get process priority
+    errno = 0;
+    params->priority = getpriority(PRIO_PROCESS, 0);
+    if (errno && params->priority < 0)
+        params->priority = 0;
+
+    params->respawn_delay = INVOKER_DEFAULT_RESPAWN_DELAY;
+    params->max_wait = INVOKER_DEFAULT_MAX_WAIT;
+    params->io[0] = STDIN_FILENO;
+    params->io[1] = STDOUT_FILENO;
+    params->io[2] = STDERR_FILENO;
+}
+
+int invoker_launch(const struct invoker_params *params, pid_t *pid)
+{
+    pid_t launched = 0;
+    int fd = invoker_send_application(params, pid != NULL, &launched);
+    if (fd < 0)
+        return fd == -2 ? 1 : -1;
+
+    // The launcher reports the exit to nobody
+    close(fd);
+
+    if (pid)
+        *pid = launched;
+
+    return 0;
+}
+
+int invoker_launch_async(const struct invoker_params *params, pid_t *pid, int *fd)
+{
+    pid_t launched = 0;
+    int conn = invoker_send_application(params, true, &launched);
+    if (conn < 0)
+        return conn == -2 ? 1 : -1;
+
+    if (pid)
+        *pid = launched;
+
+    *fd = conn;
+    return 0;
+}
+
+int invoker_launch_finish(int fd, int *status)
+{
+    uint32_t action = 0;
+    uint32_t value = 0;
+
+    // The launcher closes the connection without the exit message if
+    // it exits before the application
+    bool received = invoke_recv_msg(fd, &action) &&
+                    action == INVOKER_MSG_EXIT &&
+                    invoke_recv_msg(fd, &value);
+
+    close(fd);
+
+    if (!received)
+    {
+        errno = EPIPE;
+        return -1;
+    }
+
+    if (status)
+        *status = value;
+
+    return 0;
+}
+
+int invoker_activate(const struct invoker_params *params, const char *app_id, pid_t *pid)
+{
+    if (!params_valid(params))
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    char **envp = params->envp ? params->envp : environ;
+    int envc;
+    for (envc = 0; envp[envc]; envc++) ;
+
+    struct launcher_activate_request request;
+    memset(&request, 0, sizeof(request));
+    request.header.type = LAUNCHER_CONTROL_ACTIVATE;
+    request.options     = params->options;
+    request.priority    = params->priority;
+    request.argc        = params->argc;
+    request.envc        = envc;
+
+    struct control_packet *packet = calloc(1, sizeof(*packet));
+    if (!packet)
+        return -1;
+
+    packet_add(packet, &request, sizeof(request));
+    packet_add_app(packet, params, app_id);
+    for (int i = 0; i < envc; i++)
+        packet_add_str(packet, envp[i]);
+
+    int fd = control_send(packet, params);
+    free(packet);
+    if (fd < 0)
+        return -1;
+
+    struct launcher_activate_reply reply;
+    bool answered = recv(fd, &reply, sizeof(reply), 0) == sizeof(reply) &&
+                    reply.header.type == LAUNCHER_CONTROL_ACTIVATE;
+
+    close(fd);
+
+    if (!answered)
+    {
+        errno = EPROTO;
+        return -1;
+    }
+
+    if (reply.status < 0)
+    {
+        errno = -reply.status;
+        return -1;
+    }
+
+    if (pid)
+        *pid = reply.pid;
+
+    return reply.status == LAUNCHER_ACTIVATE_RUNNING ? 1 : 0;
+}
+
+// Applications of a batch sent in one request
+struct batch_part
+{
+    int fd;
+    int first;
+    int count;
+};
+
+int invoker_launch_batch(const struct invoker_params *params, const char *const *app_ids,
+                         int count, pid_t *pids, int *errors)
+{
+    if (count < 1)
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        if (!params_valid(&params[i]))
+        {
+            errno = EINVAL;
+            return -1;
+        }
+    }
+
+    char **envp = params[0].envp ? params[0].envp : environ;
+    int envc;
+    for (envc = 0; envp[envc]; envc++) ;
+
+    struct launcher_batch_request request;
+    memset(&request, 0, sizeof(request));
+    request.header.type = LAUNCHER_CONTROL_BATCH;
+    request.envc        = envc;
+    request.priority    = params[0].priority;
+
+    struct control_packet *packet = calloc(1, sizeof(*packet));
+    struct batch_part *parts = calloc(count, sizeof(*parts));
+    if (!packet || !parts)
+    {
+        free(packet);
+        free(parts);
+        return -1;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        pids[i]   = 0;
+        errors[i] = EPROTO;
+    }
+
+    // A batch too big for one request is sent in parts, each with the
+    // environment and over its own connection. All parts are sent before
+    // waiting for the replies.
+    int part_count = 0;
+    int first = 0;
+    while (first < count)
+    {
+        packet->size     = 0;
+        packet->overflow = false;
+
+        packet_add(packet, &request, sizeof(request));
+        for (int i = 0; i < envc; i++)
+            packet_add_str(packet, envp[i]);
+
+        const bool env_fits = !packet->overflow;
+
+        int n = 0;
+        while (env_fits && first + n < count)
+        {
+            size_t size = packet->size;
+
+            struct launcher_batch_app app;
+            app.options = params[first + n].options;
+            app.argc    = params[first + n].argc;
+            packet_add(packet, &app, sizeof(app));
+            packet_add_app(packet, &params[first + n], app_ids ? app_ids[first + n] : NULL);
+
+            if (packet->overflow)
+            {
+                packet->size     = size;
+                packet->overflow = false;
+                break;
+            }
+
+            n++;
+        }
+
+        int fd = -1;
+        if (n)
+        {
+            request.count = n;
+            memcpy(packet->data, &request, sizeof(request));
+            fd = control_send(packet, &params[0]);
+        }
+        else
+        {
+            errno = E2BIG;
+        }
+
+        if (fd < 0)
+        {
+            // Fail as a whole if nothing could be sent
+            if (!part_count && (!env_fits || n))
+                break;
+
+            // The rest of the batch fails the same way, an application
+            // too big alone fails by itself
+            int failed = n ? n : env_fits ? 1 : count - first;
+            for (int i = first; i < first + failed; i++)
+                errors[i] = errno;
+
+            first += failed;
+            continue;
+        }
+
+        parts[part_count].fd    = fd;
+        parts[part_count].first = first;
+        parts[part_count].count = n;
+        part_count++;
+
+        first += n;
+    }
+
+    int err = errno;
+    free(packet);
+
+    if (!part_count)
+    {
+        free(parts);
+        errno = err;
+        return -1;
+    }
+
+    // The replies come as the applications are launched
+    int launched = 0;
+    for (int p = 0; p < part_count; p++)
+    {
+        struct batch_part *part = &parts[p];
+        for (int i = 0; i < part->count; i++)
+        {
+            struct launcher_batch_reply reply;
+            if (recv(part->fd, &reply, sizeof(reply), 0) != sizeof(reply) ||
+                reply.header.type != LAUNCHER_CONTROL_BATCH ||
+                reply.index >= (uint32_t)part->count)
+                break;
+
+            int index = part->first + reply.index;
+            if (reply.status < 0)
+            {
+                errors[index] = -reply.status;
+            }
+            else
+            {
+                errors[index] = 0;
+                pids[index]   = reply.pid;
+                launched++;
+            }
+        }
+
+        close(part->fd);
+    }
+
+    free(parts);
+    return launched;
+}
+
+int invoker_launch_wait(const struct invoker_params *params, pid_t *pid, int *status)
+{
+    int fd = -1;
+    int ret = invoker_launch_async(params, pid, &fd);
+    if (ret != 0)
+        return ret;
+
+    return invoker_launch_finish(fd, status);
+}
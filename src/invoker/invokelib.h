@@ -21,11 +21,14 @@
 #define INVOKELIB_H
 
 #include <stdint.h>
+#include <stdbool.h>
 
-void invoke_send_msg(int fd, uint32_t msg);
+// Protocol helpers of libinvoker, not exported
+
+bool invoke_send_msg(int fd, uint32_t msg);
 bool invoke_recv_msg(int fd, uint32_t *msg);
 
-void invoke_send_str(int fd, char *str);
+bool invoke_send_str(int fd, const char *str);
 
 // Existence of the test mode control file is checked
 // to enable test mode.
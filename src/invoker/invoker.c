@@ -38,11 +38,13 @@
 #include <limits.h>
 #include <getopt.h>
 #include <fcntl.h>
+#include <syslog.h>
 
 #include "report.h"
-#include "protocol.h"
+#include "libinvoker.h"
 #include "invokelib.h"
 #include "search.h"
+#include "autotype.h"
 
 // Delay before exit.
 static const unsigned int EXIT_DELAY     = 0;
@@ -51,10 +53,16 @@ static const unsigned int MAX_EXIT_DELAY = 86400;
 
 // Delay before a new booster is started. This will
 // be sent to the launcher daemon.
-static const unsigned int RESPAWN_DELAY     = 3;
+static const unsigned int RESPAWN_DELAY     = INVOKER_DEFAULT_RESPAWN_DELAY;
 static const unsigned int MIN_RESPAWN_DELAY = 0;
 static const unsigned int MAX_RESPAWN_DELAY = 10;
 
+// Time in milliseconds to wait for a booster that is not ready yet
+// before executing the application directly. 0 waits indefinitely.
+static const unsigned int MAX_WAIT     = INVOKER_DEFAULT_MAX_WAIT;
+static const unsigned int MIN_MAX_WAIT = 0;
+static const unsigned int MAX_MAX_WAIT = 60000;
+
 static const unsigned char EXIT_STATUS_APPLICATION_CONNECTION_LOST = 0xfa;
 static const unsigned char EXIT_STATUS_APPLICATION_NOT_FOUND = 0x7f;
 
@@ -162,227 +170,6 @@ static void sigs_restore(void)
     sigs_set(&sig);
 }
 
-// Receive ACK
-static bool invoke_recv_ack(int fd)
-{
-    uint32_t action;
-
-    invoke_recv_msg(fd, &action);
-
-    if (action != INVOKER_MSG_ACK)
-    {
-        die(1, "Received wrong ack (%08x)\n", action);
-    }
-
-    return true;
-}
-
-// Inits a socket connection for the given application type
-static int invoker_init(const char *app_type)
-{
-    int fd;
-    struct sockaddr_un sun;
-
-    fd = socket(PF_UNIX, SOCK_STREAM, 0);
-    if (fd < 0)
-    {
-        error("Failed to open invoker socket.\n");
-        return -1;
-    }
-
-    sun.sun_family = AF_UNIX;
-    int maxSize = sizeof(sun.sun_path) - 1;
- 
-    const char *runtimeDir = getenv("XDG_RUNTIME_DIR");
-    const char *subpath = "/mapplauncherd/";
-    const int subpathLen = strlen(subpath);
-
-    if (runtimeDir && *runtimeDir)
-        strncpy(sun.sun_path, runtimeDir, maxSize - subpathLen);
-    else
-        strncpy(sun.sun_path, "/tmp", maxSize - subpathLen);
-
-    sun.sun_path[maxSize - subpathLen] = 0;
-    strcat(sun.sun_path, subpath);
-
-    maxSize -= strlen(sun.sun_path);
-    if (maxSize < strlen(app_type) || strchr(app_type, '/'))
-        die(1, "Invalid type of application: %s\n", app_type);
-
-    strcat(sun.sun_path, app_type);
-
-    if (connect(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0)
-    {
-        error("Failed to initiate connect on the socket.\n");
-        return -1;
-    }
-
-    return fd;
-}
-
-// Receives pid of the invoked process.
-// Invoker doesn't know it, because the launcher daemon
-// is the one who forks.
-static uint32_t invoker_recv_pid(int fd)
-{
-    // Receive action.
-    uint32_t action;
-    invoke_recv_msg(fd, &action);
-    if (action != INVOKER_MSG_PID)
-        die(1, "Received a bad message id (%08x)\n", action);
-
-    // Receive pid.
-    uint32_t pid = 0;
-    invoke_recv_msg(fd, &pid);
-    if (pid == 0)
-        die(1, "Received a zero pid \n");
-
-    return pid;
-}
-
-// Receives exit status of the invoked process
-static bool invoker_recv_exit(int fd, int* status)
-{
-    uint32_t action;
-
-    // Receive action.
-    bool res = invoke_recv_msg(fd, &action);
-
-    if (!res || (action != INVOKER_MSG_EXIT))
-    {
-        // Boosted application process was killed somehow.
-        // Let's give applauncherd process some time to cope 
-        // with this situation.
-        sleep(2);
-
-        // If nothing happend, return
-        return false;
-    }
-  
-    // Receive exit status.
-    res = invoke_recv_msg(fd, (uint32_t*) status);
-    return res;
-}
-
-// Sends magic number / protocol version
-static void invoker_send_magic(int fd, uint32_t options)
-{
-    // Send magic.
-    invoke_send_msg(fd, INVOKER_MSG_MAGIC | INVOKER_MSG_MAGIC_VERSION | options);
-}
-
-// Sends the process name to be invoked.
-static void invoker_send_name(int fd, char *name)
-{
-    invoke_send_msg(fd, INVOKER_MSG_NAME);
-    invoke_send_str(fd, name);
-}
-
-static void invoker_send_exec(int fd, char *exec)
-{
-    invoke_send_msg(fd, INVOKER_MSG_EXEC);
-    invoke_send_str(fd, exec);
-}
-
-static void invoker_send_args(int fd, int argc, char **argv)
-{
-    int i;
-
-    invoke_send_msg(fd, INVOKER_MSG_ARGS);
-    invoke_send_msg(fd, argc);
-    for (i = 0; i < argc; i++)
-    {
-        debug("param %d %s \n", i, argv[i]);
-        invoke_send_str(fd, argv[i]);
-    }
-}
-
-static void invoker_send_prio(int fd, int prio)
-{
-    invoke_send_msg(fd, INVOKER_MSG_PRIO);
-    invoke_send_msg(fd, prio);
-}
-
-// Sends booster respawn delay
-static void invoker_send_delay(int fd, int delay)
-{
-    invoke_send_msg(fd, INVOKER_MSG_DELAY);
-    invoke_send_msg(fd, delay);
-}
-
-// Sends UID and GID
-static void invoker_send_ids(int fd, int uid, int gid)
-{
-    invoke_send_msg(fd, INVOKER_MSG_IDS);
-    invoke_send_msg(fd, uid);
-    invoke_send_msg(fd, gid);
-}
-
-// Sends the environment variables
-static void invoker_send_env(int fd)
-{
-    int i, n_vars;
-
-    // Count environment variables.
-    for (n_vars = 0; environ[n_vars] != NULL; n_vars++) ;
-
-    invoke_send_msg(fd, INVOKER_MSG_ENV);
-    invoke_send_msg(fd, n_vars);
-
-    for (i = 0; i < n_vars; i++)
-    {
-        invoke_send_str(fd, environ[i]);
-    }
-
-    return;
-}
-
-// Sends I/O descriptors
-static void invoker_send_io(int fd)
-{
-    struct msghdr msg;
-    struct cmsghdr *cmsg = NULL;
-    int io[3] = { 0, 1, 2 };
-    char buf[CMSG_SPACE(sizeof(io))];
-    struct iovec iov;
-    int dummy;
-
-    memset(&msg, 0, sizeof(struct msghdr));
-
-    iov.iov_base = &dummy;
-    iov.iov_len = 1;
-
-    msg.msg_iov = &iov;
-    msg.msg_iovlen = 1;
-    msg.msg_control = buf;
-    msg.msg_controllen = sizeof(buf);
-
-    cmsg = CMSG_FIRSTHDR(&msg);
-    cmsg->cmsg_len = CMSG_LEN(sizeof(io));
-    cmsg->cmsg_level = SOL_SOCKET;
-    cmsg->cmsg_type = SCM_RIGHTS;
-
-    memcpy(CMSG_DATA(cmsg), io, sizeof(io));
-
-    msg.msg_controllen = cmsg->cmsg_len;
-
-    invoke_send_msg(fd, INVOKER_MSG_IO);
-    if (sendmsg(fd, &msg, 0) < 0)
-    {
-        warning("sendmsg failed in invoker_send_io: %s \n", strerror(errno));
-    }
-
-    return;
-}
-
-// Sends the END message
-static void invoker_send_end(int fd)
-{
-    invoke_send_msg(fd, INVOKER_MSG_END);
-    invoke_recv_ack(fd);
-
-}
-
 // Prints the usage and exits with given status
 static void usage(int status)
 {
@@ -393,12 +180,17 @@ static void usage(int status)
            "launch anything. Possible values for TYPE:\n"
            "  q (or qt)              Launch a Qt application.\n"
            "  d                      Launch a Qt Declarative (QML) application.\n"
-           "  e                      Launch any application, even if it's not a library.\n\n"
+           "  e                      Launch any application, even if it's not a library.\n"
+           "  auto                   Choose the booster whose preloaded libraries best\n"
+           "                         match the libraries the application needs.\n\n"
            "Options:\n"
            "  -d, --delay SECS       After invoking sleep for SECS seconds\n"
            "                         (default %d).\n"
            "  -r, --respawn SECS     After invoking respawn new booster after SECS seconds\n"
            "                         (default %d, max %d).\n"
+           "  -m, --max-wait MS      Execute the application directly if no booster is\n"
+           "                         expected to be ready within MS milliseconds\n"
+           "                         (default %d, 0 waits for the booster).\n"
            "  -w, --wait-term        Wait for launched process to terminate (default).\n"
            "  -n, --no-wait          Do not wait for launched process to terminate.\n"
            "  -G, --global-syms      Places symbols in the application binary and its\n"
@@ -407,12 +199,19 @@ static void usage(int status)
            "  -s, --single-instance  Launch the application as a single instance.\n"
            "                         The existing application window will be activated\n"
            "                         if already launched.\n"
+           "  -N, --no-coalesce      Launch a new instance even if the same application\n"
+           "                         with the same arguments was launched just before.\n"
+           "  -B, --background       Launch in the background class. Interactive launches\n"
+           "                         get a waiting booster first; the application is\n"
+           "                         executed directly if it doesn't get one within\n"
+           "                         --max-wait.\n"
            "  -o, --daemon-mode      Notify invoker that the launched process is a daemon.\n"
-           "                         This resets the oom_adj of the process.\n"
+           "                         This resets the oom_adj of the process and implies\n"
+           "                         --background.\n"
            "  -T, --test-mode        Invoker test mode. Also control file in root home should be in place.\n"
            "  -h, --help             Print this help.\n\n"
            "Example: %s --type=m /usr/bin/helloworld\n\n",
-           PROG_NAME_INVOKER, EXIT_DELAY, RESPAWN_DELAY, MAX_RESPAWN_DELAY, PROG_NAME_INVOKER);
+           PROG_NAME_INVOKER, EXIT_DELAY, RESPAWN_DELAY, MAX_RESPAWN_DELAY, MAX_WAIT, PROG_NAME_INVOKER);
 
     exit(status);
 }
@@ -441,138 +240,119 @@ static unsigned int get_delay(char *delay_arg, char *param_name,
     return delay;
 }
 
-static int wait_for_launched_process_to_exit(int socket_fd, bool wait_term)
+// Waits for the application launched through the connection socket_fd
+// to exit and returns the exit status to use
+static int wait_for_launched_process_to_exit(int socket_fd)
 {
     int status = 0;
 
-    // Wait for launched process to exit
-    if (wait_term)
-    {
-        // coverity[tainted_string_return_content]
-        g_invoked_pid = invoker_recv_pid(socket_fd);
-        debug("Booster's pid is %d \n ", g_invoked_pid);
-
-        // Forward UNIX signals to the invoked process
-        sigs_init();
+    // Forward UNIX signals to the invoked process
+    sigs_init();
 
-        while(1)
-        {
-            // Setup things for select()
-            fd_set readfds;
-            int ndfs = 0;
+    while(1)
+    {
+        // Setup things for select()
+        fd_set readfds;
+        int ndfs = 0;
 
-            FD_ZERO(&readfds);
+        FD_ZERO(&readfds);
 
-            FD_SET(socket_fd, &readfds);
-            ndfs = (socket_fd > ndfs) ? socket_fd : ndfs;
+        FD_SET(socket_fd, &readfds);
+        ndfs = (socket_fd > ndfs) ? socket_fd : ndfs;
 
-            // sig_forwarder() handles signals.
-            // We only have to receive those here.
-            FD_SET(g_signal_pipe[0], &readfds);
-            ndfs = (g_signal_pipe[0] > ndfs) ? g_signal_pipe[0] : ndfs;
+        // sig_forwarder() handles signals.
+        // We only have to receive those here.
+        FD_SET(g_signal_pipe[0], &readfds);
+        ndfs = (g_signal_pipe[0] > ndfs) ? g_signal_pipe[0] : ndfs;
 
-            // Wait for something appearing in the pipes.
-            if (select(ndfs + 1, &readfds, NULL, NULL, NULL) > 0)
+        // Wait for something appearing in the pipes.
+        if (select(ndfs + 1, &readfds, NULL, NULL, NULL) > 0)
+        {
+            // Check if an exit status from the invoked application
+            if (FD_ISSET(socket_fd, &readfds))
             {
-                // Check if an exit status from the invoked application
-                if (FD_ISSET(socket_fd, &readfds))
+                int wait_status = 0;
+                if (invoker_launch_finish(socket_fd, &wait_status) == 0)
                 {
-                    bool res = invoker_recv_exit(socket_fd, &status);
-
-                    if (!res)
+                    if (WIFSIGNALED(wait_status))
+                    {
+                        // Die of the same signal as the application
+                        int sig = WTERMSIG(wait_status);
+                        sigs_restore();
+                        raise(sig);
+                        status = 128 + sig;
+                    }
+                    else
                     {
-                        // Because we are here, applauncherd.bin must be dead.
-                        // Now we check if the invoked process is also dead
-                        // and if not, we will kill it.
-                        char filename[50];
-                        snprintf(filename, sizeof(filename), "/proc/%d/cmdline", g_invoked_pid);
-
-                        // Open filename for reading only
-                        int fd = open(filename, O_RDONLY);
-                        if (fd != -1)
-                        {
-                            // Application is still running
-                            close(fd);
-
-                            // Send a signal to kill the application too and exit.
-                            // Sleep for some time to give
-                            // the new applauncherd some time to load its boosters and
-                            // the restart of g_invoked_pid succeeds.
-
-                            sleep(10);
-                            kill(g_invoked_pid, SIGKILL);
-                            raise(SIGKILL);
-                        }
-                        else
-                        {
-                            // connection to application was lost
-                            status = EXIT_FAILURE; 
-                        }
+                        status = WEXITSTATUS(wait_status);
                     }
-                    break;
                 }
-                // Check if we got a UNIX signal.
-                else if (FD_ISSET(g_signal_pipe[0], &readfds))
+                else
                 {
-                    // Clean up the pipe
-                    char signal_id;
-                    read(g_signal_pipe[0], &signal_id, sizeof(signal_id));
+                    // Because we are here, applauncherd.bin must be dead.
+                    // Now we check if the invoked process is also dead
+                    // and if not, we will kill it.
+                    char filename[50];
+                    snprintf(filename, sizeof(filename), "/proc/%d/cmdline", g_invoked_pid);
+
+                    // Open filename for reading only
+                    int fd = open(filename, O_RDONLY);
+                    if (fd != -1)
+                    {
+                        // Application is still running
+                        close(fd);
 
-                    // Set signals forwarding to the invoked process again
-                    // (they were reset by the signal forwarder).
-                    sigs_init();
+                        // Send a signal to kill the application too and exit.
+                        // Sleep for some time to give
+                        // the new applauncherd some time to load its boosters and
+                        // the restart of g_invoked_pid succeeds.
+
+                        sleep(10);
+                        kill(g_invoked_pid, SIGKILL);
+                        raise(SIGKILL);
+                    }
+                    else
+                    {
+                        // connection to application was lost
+                        status = EXIT_FAILURE;
+                    }
                 }
+                break;
             }
-        }
+            // Check if we got a UNIX signal.
+            else if (FD_ISSET(g_signal_pipe[0], &readfds))
+            {
+                // Clean up the pipe
+                char signal_id;
+                read(g_signal_pipe[0], &signal_id, sizeof(signal_id));
 
-        // Restore default signal handlers
-        sigs_restore();
+                // Set signals forwarding to the invoked process again
+                // (they were reset by the signal forwarder).
+                sigs_init();
+            }
+        }
     }
 
+    // Restore default signal handlers
+    sigs_restore();
+
     return status;
 }
 
-// "normal" invoke through a socket connection
-static int invoke_remote(int socket_fd, int prog_argc, char **prog_argv, char *prog_name,
-                         uint32_t magic_options, bool wait_term, unsigned int respawn_delay)
+static void invoke_fallback(char **prog_argv, char *prog_name, bool wait_term, bool booster_late)
 {
-    // Get process priority
-    errno = 0;
-    int prog_prio = getpriority(PRIO_PROCESS, 0);
-    if (errno && prog_prio < 0)
+    // Connection with launcher is broken,
+    // try to launch application via execve
+    if (booster_late)
     {
-        prog_prio = 0;
+        info("No booster ready in time, starting %s without launcher\n", prog_name);
     }
-
-    // Connection with launcher process is established,
-    // send the data.
-    invoker_send_magic(socket_fd, magic_options);
-    invoker_send_name(socket_fd, prog_argv[0]);
-    invoker_send_exec(socket_fd, prog_name);
-    invoker_send_args(socket_fd, prog_argc, prog_argv);
-    invoker_send_prio(socket_fd, prog_prio);
-    invoker_send_delay(socket_fd, respawn_delay);
-    invoker_send_ids(socket_fd, getuid(), getgid());
-    invoker_send_io(socket_fd);
-    invoker_send_env(socket_fd);
-    invoker_send_end(socket_fd);
-
-    if (prog_name)
+    else
     {
-        free(prog_name);
+        warning("Connection with launcher process is broken. \n");
+        error("Start application %s as a binary executable without launcher...\n", prog_name);
     }
 
-    int exit_status = wait_for_launched_process_to_exit(socket_fd, wait_term);
-    return exit_status;
-}
-
-static void invoke_fallback(char **prog_argv, char *prog_name, bool wait_term)
-{
-    // Connection with launcher is broken,
-    // try to launch application via execve
-    warning("Connection with launcher process is broken. \n");
-    error("Start application %s as a binary executable without launcher...\n", prog_name);
-
     // Fork if wait_term not set
     if(!wait_term)
     {
@@ -598,8 +378,8 @@ static void invoke_fallback(char **prog_argv, char *prog_name, bool wait_term)
 
 // Invokes the given application
 static int invoke(int prog_argc, char **prog_argv, char *prog_name,
-                  const char *app_type, uint32_t magic_options, bool wait_term, unsigned int respawn_delay,
-                  bool test_mode)
+                  const char *app_type, uint32_t options, bool wait_term, unsigned int respawn_delay,
+                  unsigned int max_wait, bool test_mode)
 {
     int status = 0;
     if (prog_name && prog_argv)
@@ -611,41 +391,81 @@ static int invoke(int prog_argc, char **prog_argv, char *prog_name,
             info("Invoker test mode is not enabled.\n");
         }
 
-        // This is a fallback if connection with the launcher
-        // process is broken       
-        int fd = invoker_init(app_type);
-        if (fd == -1)
+        struct invoker_params params;
+        invoker_params_init(&params);
+        params.type          = app_type;
+        params.exec          = prog_name;
+        params.argc          = prog_argc;
+        params.argv          = prog_argv;
+        params.options       = options;
+        params.respawn_delay = respawn_delay;
+        params.max_wait      = max_wait;
+
+        int fd = -1;
+        int ret = wait_term ? invoker_launch_async(&params, &g_invoked_pid, &fd)
+                            : invoker_launch(&params, NULL);
+
+        if (ret == 1)
         {
-            invoke_fallback(prog_argv, prog_name, wait_term);
+            // The running single instance was activated
+            status = EXIT_SUCCESS;
         }
-        // "normal" invoke through a socket connetion
-        else
+        else if (ret == -1)
         {
-            status = invoke_remote(fd, prog_argc, prog_argv, prog_name,
-                                   magic_options, wait_term, respawn_delay);
-            close(fd);
+            // This is a fallback if connection with the launcher
+            // process is broken
+            if (errno == EEXIST || errno == EINVAL || errno == EPROTO)
+                status = EXIT_FAILURE;
+            else
+                invoke_fallback(prog_argv, prog_name, wait_term, errno == EAGAIN);
+        }
+        // Wait for launched process to exit
+        else if (wait_term)
+        {
+            debug("Booster's pid is %d \n ", g_invoked_pid);
+            status = wait_for_launched_process_to_exit(fd);
         }
+
+        free(prog_name);
     }
-    
+
     return status;
 }
 
+// Prints the messages of libinvoker like those of the invoker
+static void report_library_message(int priority, const char *message)
+{
+    switch (priority)
+    {
+    case LOG_DEBUG:
+        report(report_debug, "%s", message);
+        break;
+    case LOG_WARNING:
+        report(report_warning, "%s", message);
+        break;
+    case LOG_ERR:
+        report(report_error, "%s", message);
+        break;
+    default:
+        report(report_info, "%s", message);
+        break;
+    }
+}
+
 int main(int argc, char *argv[])
 {
     const char   *app_type      = NULL;
     int           prog_argc     = 0;
-    uint32_t      magic_options = 0;
+    uint32_t      options       = 0;
     bool          wait_term     = true;
     unsigned int  delay         = EXIT_DELAY;
     unsigned int  respawn_delay = RESPAWN_DELAY;
+    unsigned int  max_wait      = MAX_WAIT;
     char        **prog_argv     = NULL;
     char         *prog_name     = NULL;
     struct stat   file_stat;
     bool test_mode = false;
 
-    // wait-term parameter by default
-    magic_options |= INVOKER_MSG_MAGIC_OPTION_WAIT;
-
     // Called with a different name (old way of using invoker) ?
     if (!strstr(argv[0], PROG_NAME_INVOKER) )
     {
@@ -654,6 +474,8 @@ int main(int argc, char *argv[])
             "Run invoker explicitly from e.g. a D-Bus service file instead.\n");
     }
 
+    invoker_set_report(report_library_message);
+
     // Stops parsing args as soon as a non-option argument is encountered
     putenv("POSIXLY_CORRECT=1");
 
@@ -665,11 +487,14 @@ int main(int argc, char *argv[])
         {"global-syms",      no_argument,       NULL, 'G'},
         {"deep-syms",        no_argument,       NULL, 'D'},
         {"single-instance",  no_argument,       NULL, 's'},
+        {"no-coalesce",      no_argument,       NULL, 'N'},
+        {"background",       no_argument,       NULL, 'B'},
         {"daemon-mode",      no_argument,       NULL, 'o'},
         {"test-mode",        no_argument,       NULL, 'T'},
         {"type",             required_argument, NULL, 't'},
         {"delay",            required_argument, NULL, 'd'},
         {"respawn",          required_argument, NULL, 'r'},
+        {"max-wait",         required_argument, NULL, 'm'},
         {"splash",           required_argument, NULL, 'S'},
         {"splash-landscape", required_argument, NULL, 'L'},
         {0, 0, 0, 0}
@@ -678,7 +503,7 @@ int main(int argc, char *argv[])
     // Parse options
     // TODO: Move to a function
     int opt;
-    while ((opt = getopt_long(argc, argv, "hcwnGDsoTd:t:r:S:L:", longopts, NULL)) != -1)
+    while ((opt = getopt_long(argc, argv, "hcwnGDsNBoTd:t:r:m:S:L:", longopts, NULL)) != -1)
     {
         switch(opt)
         {
@@ -691,20 +516,23 @@ int main(int argc, char *argv[])
             break;
 
         case 'o':
-            magic_options |= INVOKER_MSG_MAGIC_OPTION_OOM_ADJ_DISABLE;
+            options |= INVOKER_OPTION_DAEMON_MODE | INVOKER_OPTION_BACKGROUND;
+            break;
+
+        case 'B':
+            options |= INVOKER_OPTION_BACKGROUND;
             break;
 
         case 'n':
             wait_term = false;
-            magic_options &= (~INVOKER_MSG_MAGIC_OPTION_WAIT);
             break;
 
         case 'G':
-            magic_options |= INVOKER_MSG_MAGIC_OPTION_DLOPEN_GLOBAL;
+            options |= INVOKER_OPTION_GLOBAL_SYMS;
             break;
 
         case 'D':
-            magic_options |= INVOKER_MSG_MAGIC_OPTION_DLOPEN_DEEP;
+            options |= INVOKER_OPTION_DEEP_SYMS;
             break;
 
         case 'T':
@@ -724,8 +552,16 @@ int main(int argc, char *argv[])
                                       MIN_RESPAWN_DELAY, MAX_RESPAWN_DELAY);
             break;
 
+        case 'm':
+            max_wait = get_delay(optarg, "max wait", MIN_MAX_WAIT, MAX_MAX_WAIT);
+            break;
+
         case 's':
-            magic_options |= INVOKER_MSG_MAGIC_OPTION_SINGLE_INSTANCE;
+            options |= INVOKER_OPTION_SINGLE_INSTANCE;
+            break;
+
+        case 'N':
+            options |= INVOKER_OPTION_NO_COALESCE;
             break;
 
         case 'S':
@@ -773,6 +609,10 @@ int main(int argc, char *argv[])
         usage(1);
     }
 
+    // Pick the booster from the libraries the application needs
+    if (!strcmp(app_type, "auto"))
+        app_type = auto_select_type(prog_name);
+
     // Translate types for compatibility with older versions
     if (!strcmp(app_type, "q") || !strcmp(app_type, "qt") || !strcmp(app_type, "m"))
         app_type = "qt4";
@@ -791,7 +631,8 @@ int main(int argc, char *argv[])
 
     // Send commands to the launcher daemon
     info("Invoking execution: '%s'\n", prog_name);
-    int ret_val = invoke(prog_argc, prog_argv, prog_name, app_type, magic_options, wait_term, respawn_delay, test_mode);
+    int ret_val = invoke(prog_argc, prog_argv, prog_name, app_type, options, wait_term, respawn_delay,
+                         max_wait, test_mode);
 
     // Sleep for delay before exiting
     if (delay)
@@ -0,0 +1,173 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef LIBINVOKER_H
+#define LIBINVOKER_H
+
+/*!
+ * \file libinvoker.h
+ * \brief Launching applications through mapplauncherd from a program.
+ *
+ * The functions send the application to a waiting booster of the launcher
+ * the same way the invoker binary does, without forking an invoker per
+ * launch. Link with -linvoker.
+ *
+ * All functions return 0 on success and -1 with errno set on failure.
+ * The launch functions return 1 if the application was launched as a
+ * single instance and its running instance was activated instead.
+ * Launching fails with
+ *  - EAGAIN if no booster of the type is expected to be ready within
+ *    max_wait milliseconds,
+ *  - ENOENT or ECONNREFUSED if the launcher is not running,
+ *  - EEXIST if the running single instance could not be activated,
+ *  - EPROTO if the launcher does not follow the protocol,
+ *  - ETIMEDOUT if the booster doesn't answer in time, see
+ *    INVOKER_OPTION_TIMEOUT.
+ * The caller may execute the application directly in these cases.
+ *
+ * The library prints nothing and doesn't touch syslog. A program that
+ * wants its diagnostic messages sets a receiver with invoker_set_report().
+ *
+ * Launching the same executable with the same arguments again within the
+ * coalescing window of the launcher does not start a second application.
+ * The launch shares the application of the first one and gets its pid and
+ * wait status. Background launches and launches with
+ * INVOKER_OPTION_NO_COALESCE always start their own application.
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define INVOKER_EXPORT __attribute__ ((visibility("default")))
+
+//! Place the symbols of the application to the global scope, see RTLD_GLOBAL
+#define INVOKER_OPTION_GLOBAL_SYMS      0x01
+//! Prefer the symbols of the application, see RTLD_DEEPBIND
+#define INVOKER_OPTION_DEEP_SYMS        0x02
+//! Activate the running instance of the application instead of launching it
+#define INVOKER_OPTION_SINGLE_INSTANCE  0x04
+//! The application is a daemon, its oom_score_adj is not changed
+#define INVOKER_OPTION_DAEMON_MODE      0x08
+//! Don't share the application if the same application with the same
+//! arguments is being launched, see above
+#define INVOKER_OPTION_NO_COALESCE      0x10
+//! Launch in the background class, e.g. a service. Interactive launches
+//! get a waiting booster first, a background launch that doesn't get one
+//! within max_wait fails with EAGAIN.
+#define INVOKER_OPTION_BACKGROUND       0x20
+//! Don't block, e.g. in a main loop: skip boosters that are not ready and
+//! fail with ETIMEDOUT if the booster doesn't answer within max_wait
+//! milliseconds. The application may have been launched then.
+#define INVOKER_OPTION_TIMEOUT          0x40
+
+//! Default delay in seconds before the launcher starts a new booster
+#define INVOKER_DEFAULT_RESPAWN_DELAY   3
+//! Default time in milliseconds to wait for a booster to get ready
+#define INVOKER_DEFAULT_MAX_WAIT        1000
+
+//! Application to launch
+struct invoker_params
+{
+    //! Booster type, e.g. "generic"
+    const char *type;
+
+    //! Absolute path of the application
+    const char *exec;
+
+    //! Arguments of the application, argv[0] is its name
+    int argc;
+    char **argv;
+
+    //! Environment of the application, NULL for the environment of the caller
+    char **envp;
+
+    //! INVOKER_OPTION_* flags
+    uint32_t options;
+
+    //! Nice value of the application
+    int priority;
+
+    //! Delay in seconds before the launcher starts a new booster
+    unsigned int respawn_delay;
+
+    //! Milliseconds to wait for a booster that is not ready yet,
+    //! 0 waits for the booster
+    unsigned int max_wait;
+
+    //! Standard input, output and error of the application
+    int io[3];
+};
+
+//! Receives a diagnostic message of the library. The priority is one of
+//! the LOG_* levels of syslog(), the message ends with a newline.
+typedef void (*invoker_report_func)(int priority, const char *message);
+
+//! Sets the receiver of the diagnostic messages, NULL silences the library
+//! again. Not thread-safe, set it before launching.
+INVOKER_EXPORT void invoker_set_report(invoker_report_func func);
+
+//! Initializes params with the defaults, the priority and I/O of the caller
+INVOKER_EXPORT void invoker_params_init(struct invoker_params *params);
+
+//! Launches the application without waiting for it to exit. If pid is
+//! not NULL, stores the pid of the application there.
+INVOKER_EXPORT int invoker_launch(const struct invoker_params *params, pid_t *pid);
+
+//! Launches the application and waits for it to exit. Stores the pid to
+//! pid and the wait status (see waitpid()) to status if these are not NULL.
+INVOKER_EXPORT int invoker_launch_wait(const struct invoker_params *params, pid_t *pid, int *status);
+
+//! Launches the application and stores the pid to pid and a descriptor to
+//! fd. The descriptor becomes readable when the application exits, pass it
+//! to invoker_launch_finish() then.
+INVOKER_EXPORT int invoker_launch_async(const struct invoker_params *params, pid_t *pid, int *fd);
+
+//! Receives the wait status of the application launched with
+//! invoker_launch_async() and closes fd. Blocks if the application is
+//! running. Fails with EPIPE if the launcher exited before the application.
+INVOKER_EXPORT int invoker_launch_finish(int fd, int *status);
+
+//! Asks the launcher to launch the application for an activator. The
+//! launcher itself talks to the booster and keeps no process around for
+//! the application. If app_id is not NULL and the application of the id
+//! launched earlier still runs, returns 1 and its pid. The environment
+//! and I/O are those in params.
+INVOKER_EXPORT int invoker_activate(const struct invoker_params *params, const char *app_id, pid_t *pid);
+
+//! Asks the launcher to launch count applications at once, e.g. on
+//! session start. The environment, priority and I/O of params[0] are
+//! shared by all of them, app_ids may be NULL. The launcher hands the
+//! applications to boosters as these become ready. Stores the pid of each
+//! application to pids and 0 or the errno of its launch to errors, EAGAIN
+//! if no booster got ready in time. Returns the number of applications
+//! launched or already running. A batch bigger than a request of the
+//! launcher (64 KiB with the environment) is sent in several requests;
+//! an application that doesn't fit into a request alone fails with E2BIG.
+INVOKER_EXPORT int invoker_launch_batch(const struct invoker_params *params, const char *const *app_ids,
+                                        int count, pid_t *pids, int *errors);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // LIBINVOKER_H
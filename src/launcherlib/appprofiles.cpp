@@ -0,0 +1,417 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "appprofiles.h"
+#include "logger.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "coverage.h"
+
+static const int IOPRIO_CLASS_RT    = 1;
+static const int IOPRIO_CLASS_BE    = 2;
+static const int IOPRIO_CLASS_IDLE  = 3;
+static const int IOPRIO_CLASS_SHIFT = 13;
+
+// Attempts to read an entry while the launcher is rewriting the index, an
+// update takes microseconds so an index that stays odd has no profiles
+static const int MAX_READ_ATTEMPTS = 4;
+
+AppProfiles::AppProfiles(const string & path) :
+    m_index(NULL)
+{
+    // An existing index is reused after re-exec, the waiting boosters
+    // still map it
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd == -1 || ftruncate(fd, sizeof(Index)) == -1)
+    {
+        Logger::logError("AppProfiles: Couldn't create '%s': %s", path.c_str(), strerror(errno));
+        if (fd != -1)
+            close(fd);
+        return;
+    }
+
+    void * index = mmap(NULL, sizeof(Index), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (index == MAP_FAILED)
+    {
+        Logger::logError("AppProfiles: Couldn't map '%s': %s", path.c_str(), strerror(errno));
+        return;
+    }
+
+    m_index = static_cast<Index *>(index);
+
+    // An odd sequence was left by a launcher that died in the middle of
+    // an update, the entries can't be trusted
+    if (m_index->sequence & 1)
+    {
+        Logger::logWarning("AppProfiles: Discarding an incomplete update of '%s'", path.c_str());
+
+        m_index->count = 0;
+        memset(m_index->entries, 0, sizeof(m_index->entries));
+        __sync_synchronize();
+        m_index->sequence++;
+    }
+}
+
+AppProfiles::~AppProfiles()
+{
+    if (m_index)
+        munmap(m_index, sizeof(Index));
+}
+
+uint64_t AppProfiles::hashOf(const string & app)
+{
+    // 64-bit FNV-1a, never 0 which marks a free entry
+    uint64_t hash = 14695981039346656037ULL;
+    for (string::const_iterator it = app.begin(); it != app.end(); it++)
+        hash = (hash ^ static_cast<unsigned char>(*it)) * 1099511628211ULL;
+
+    return hash ? hash : 1;
+}
+
+bool AppProfiles::sameApp(const Profile & entry, uint64_t hash, const char * app)
+{
+    // The entry may be rewritten while it is compared, don't rely on
+    // the terminating zero
+    return entry.hash == hash && strncmp(entry.path, app, PATH_SIZE) == 0;
+}
+
+static string trim(const string & s)
+{
+    const string::size_type start = s.find_first_not_of(" \t\r");
+    if (start == string::npos)
+        return "";
+
+    return s.substr(start, s.find_last_not_of(" \t\r") + 1 - start);
+}
+
+static bool parseInt(const string & value, int min, int max, int32_t & result)
+{
+    char * end = NULL;
+    errno = 0;
+    const long number = strtol(value.c_str(), &end, 10);
+    if (errno || value.empty() || *end != '\0' || number < min || number > max)
+        return false;
+
+    result = number;
+    return true;
+}
+
+bool AppProfiles::parseLine(const string & key, const string & value, Profile & profile)
+{
+    int32_t number = 0;
+
+    if (key == "dlopen")
+    {
+        // lazy|now[,global][,deep]
+        int flags = 0;
+        std::stringstream modes(value);
+        string mode;
+        while (std::getline(modes, mode, ','))
+        {
+            if (mode == "lazy")
+                flags |= RTLD_LAZY;
+            else if (mode == "now")
+                flags |= RTLD_NOW;
+            else if (mode == "global")
+                flags |= RTLD_GLOBAL;
+            else if (mode == "deep")
+                flags |= RTLD_DEEPBIND;
+            else
+                return false;
+        }
+
+        if (flags & RTLD_NOW)
+            flags &= ~RTLD_LAZY;
+        else
+            flags |= RTLD_LAZY;
+        if (!(flags & RTLD_GLOBAL))
+            flags |= RTLD_LOCAL;
+
+        profile.dlopenFlags = flags;
+        profile.fields |= DLOPEN_FLAGS;
+    }
+    else if (key == "sched")
+    {
+        // other|batch|idle|fifo:PRIORITY|rr:PRIORITY
+        const string::size_type colon = value.find(':');
+        const string policy = value.substr(0, colon);
+        int32_t priority = 0;
+
+        if (policy == "other")
+            profile.schedPolicy = SCHED_OTHER;
+        else if (policy == "batch")
+            profile.schedPolicy = SCHED_BATCH;
+        else if (policy == "idle")
+            profile.schedPolicy = SCHED_IDLE;
+        else if (policy == "fifo")
+            profile.schedPolicy = SCHED_FIFO;
+        else if (policy == "rr")
+            profile.schedPolicy = SCHED_RR;
+        else
+            return false;
+
+        const bool realTime = profile.schedPolicy == SCHED_FIFO || profile.schedPolicy == SCHED_RR;
+        if (realTime != (colon != string::npos))
+            return false;
+        if (realTime && !parseInt(value.substr(colon + 1), 1, 99, priority))
+            return false;
+
+        profile.schedPriority = priority;
+        profile.fields |= SCHED_POLICY;
+    }
+    else if (key == "affinity")
+    {
+        // CPU list, e.g. 0-3,6
+        CPU_ZERO(&profile.affinity);
+        std::stringstream ranges(value);
+        string range;
+        while (std::getline(ranges, range, ','))
+        {
+            const string::size_type dash = range.find('-');
+            int32_t first = 0, last = 0;
+            if (!parseInt(range.substr(0, dash), 0, CPU_SETSIZE - 1, first))
+                return false;
+            if (dash == string::npos)
+                last = first;
+            else if (!parseInt(range.substr(dash + 1), first, CPU_SETSIZE - 1, last))
+                return false;
+
+            for (int cpu = first; cpu <= last; cpu++)
+                CPU_SET(cpu, &profile.affinity);
+        }
+
+        if (!CPU_COUNT(&profile.affinity))
+            return false;
+
+        profile.fields |= AFFINITY;
+    }
+    else if (key == "uclamp-min" || key == "uclamp-max")
+    {
+        if (!parseInt(value, 0, 1024, number))
+            return false;
+
+        if (key == "uclamp-min")
+        {
+            profile.uclampMin = number;
+            profile.fields |= UCLAMP_MIN;
+        }
+        else
+        {
+            profile.uclampMax = number;
+            profile.fields |= UCLAMP_MAX;
+        }
+    }
+    else if (key == "oom-score-adj")
+    {
+        if (!parseInt(value, -1000, 1000, profile.oomScoreAdj))
+            return false;
+
+        profile.fields |= OOM_SCORE_ADJ;
+    }
+    else if (key == "nice")
+    {
+        if (!parseInt(value, -20, 19, profile.nice))
+            return false;
+
+        profile.fields |= NICE;
+    }
+    else if (key == "ioprio")
+    {
+        // rt:LEVEL|be:LEVEL|idle
+        const string::size_type colon = value.find(':');
+        const string ioClass = value.substr(0, colon);
+        int32_t level = 0;
+
+        if (ioClass == "idle" && colon == string::npos)
+            profile.ioPriority = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+        else if ((ioClass == "rt" || ioClass == "be") && colon != string::npos &&
+                 parseInt(value.substr(colon + 1), 0, 7, level))
+            profile.ioPriority = ((ioClass == "rt" ? IOPRIO_CLASS_RT : IOPRIO_CLASS_BE) << IOPRIO_CLASS_SHIFT) | level;
+        else
+            return false;
+
+        profile.fields |= IO_PRIORITY;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+void AppProfiles::parseFile(const string & file, Profile & profile, vector<string> & apps)
+{
+    std::ifstream in(file.c_str());
+    string line;
+    unsigned int lineNumber = 0;
+
+    while (std::getline(in, line))
+    {
+        lineNumber++;
+
+        // Skip comments and empty lines
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        const string::size_type equals = line.find('=');
+        const string key   = equals == string::npos ? "" : trim(line.substr(0, equals));
+        const string value = equals == string::npos ? "" : trim(line.substr(equals + 1));
+
+        if (key == "path" && !value.empty() && value[0] == '/')
+            apps.push_back(value);
+        else if (key.empty() || !parseLine(key, value, profile))
+            Logger::logWarning("AppProfiles: %s:%u: invalid line ignored", file.c_str(), lineNumber);
+    }
+}
+
+unsigned int AppProfiles::compile(const string & dir)
+{
+    if (!m_index)
+        return 0;
+
+    // Parse everything before touching the index, readers only wait
+    // for the copy
+    vector<Profile> profiles;
+
+    DIR * d = opendir(dir.c_str());
+    if (!d)
+        Logger::logWarning("AppProfiles: Couldn't open '%s': %s", dir.c_str(), strerror(errno));
+
+    struct dirent * entry;
+    while (d && (entry = readdir(d)))
+    {
+        // Hidden files include the temporary files of editors
+        if (entry->d_name[0] == '.')
+            continue;
+
+        Profile profile;
+        memset(&profile, 0, sizeof(profile));
+
+        vector<string> apps;
+        parseFile(dir + "/" + entry->d_name, profile, apps);
+
+        for (vector<string>::const_iterator it = apps.begin(); it != apps.end(); it++)
+        {
+            if (it->size() >= PATH_SIZE)
+            {
+                Logger::logWarning("AppProfiles: %s: path too long, '%s' ignored",
+                                   entry->d_name, it->c_str());
+                continue;
+            }
+
+            profile.hash = hashOf(*it);
+            memset(profile.path, 0, sizeof(profile.path));
+            strcpy(profile.path, it->c_str());
+            profiles.push_back(profile);
+        }
+    }
+
+    if (d)
+        closedir(d);
+
+    // Odd sequence tells readers that an update is in progress
+    const uint32_t sequence = m_index->sequence | 1;
+    m_index->sequence = sequence;
+    __sync_synchronize();
+
+    m_index->version = VERSION;
+    m_index->count   = 0;
+    memset(m_index->entries, 0, sizeof(m_index->entries));
+
+    for (vector<Profile>::const_iterator it = profiles.begin(); it != profiles.end(); it++)
+    {
+        // Linear probing, the table is kept at most half full
+        if (m_index->count >= TABLE_SIZE / 2)
+        {
+            Logger::logWarning("AppProfiles: Too many profiles, %u ignored",
+                               static_cast<unsigned int>(profiles.end() - it));
+            break;
+        }
+
+        // Paths with the same hash take separate entries
+        unsigned int slot = it->hash % TABLE_SIZE;
+        while (m_index->entries[slot].hash && !sameApp(m_index->entries[slot], it->hash, it->path))
+            slot = (slot + 1) % TABLE_SIZE;
+
+        if (!m_index->entries[slot].hash)
+            m_index->count++;
+
+        m_index->entries[slot] = *it;
+    }
+
+    __sync_synchronize();
+    m_index->sequence = sequence + 1;
+
+    return m_index->count;
+}
+
+bool AppProfiles::lookup(const string & app, Profile & profile) const
+{
+    if (!m_index || app.size() >= PATH_SIZE)
+        return false;
+
+    const uint64_t hash = hashOf(app);
+    const volatile uint32_t & sequence = m_index->sequence;
+
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++)
+    {
+        const uint32_t before = sequence;
+        __sync_synchronize();
+
+        bool found = false;
+        if (!(before & 1) && m_index->version == VERSION)
+        {
+            unsigned int slot = hash % TABLE_SIZE;
+            for (unsigned int i = 0; i < TABLE_SIZE && m_index->entries[slot].hash; i++)
+            {
+                if (sameApp(m_index->entries[slot], hash, app.c_str()))
+                {
+                    profile = m_index->entries[slot];
+                    found   = true;
+                    break;
+                }
+
+                slot = (slot + 1) % TABLE_SIZE;
+            }
+        }
+
+        __sync_synchronize();
+        if (!(before & 1) && sequence == before)
+            return found;
+
+        sched_yield();
+    }
+
+    Logger::logWarning("AppProfiles: Index is being updated, no profile for %s", app.c_str());
+    return false;
+}
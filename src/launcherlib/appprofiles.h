@@ -0,0 +1,144 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef APPPROFILES_H
+#define APPPROFILES_H
+
+#include "launcherlib.h"
+
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+#include <sched.h>
+#include <stdint.h>
+
+/*!
+ * \class AppProfiles
+ * \brief Launch profiles of applications, looked up by the application path.
+ *
+ * The launcher compiles the profile files of a directory into an index
+ * file mapped by the launcher and all boosters, so that a booster only
+ * copies the entry of the launched application. The index is rewritten
+ * in place when the profiles change; readers retry a few times while an
+ * update is in progress and then go without a profile. The index is a fixed size hash table, profiles that don't
+ * fit are dropped.
+ */
+class DECL_EXPORT AppProfiles
+{
+public:
+
+    //! Fields set in a profile
+    enum Field
+    {
+        DLOPEN_FLAGS  = 1 << 0,
+        SCHED_POLICY  = 1 << 1,
+        AFFINITY      = 1 << 2,
+        UCLAMP_MIN    = 1 << 3,
+        UCLAMP_MAX    = 1 << 4,
+        OOM_SCORE_ADJ = 1 << 5,
+        NICE          = 1 << 6,
+        IO_PRIORITY   = 1 << 7
+    };
+
+    //! Size of the application path stored in a profile, longer paths have no profile
+    static const unsigned int PATH_SIZE = 256;
+
+    //! Launch profile of an application
+    struct Profile
+    {
+        uint64_t hash;
+        char     path[PATH_SIZE];
+        uint32_t fields;
+        int32_t  dlopenFlags;
+        int32_t  schedPolicy;
+        int32_t  schedPriority;
+        uint32_t uclampMin;
+        uint32_t uclampMax;
+        int32_t  oomScoreAdj;
+        int32_t  nice;
+        int32_t  ioPriority;
+        uint32_t reserved;
+        cpu_set_t affinity;
+    };
+
+    //! Constructor, maps the index at path creating it if needed
+    explicit AppProfiles(const string & path);
+
+    //! Destructor
+    ~AppProfiles();
+
+    /*!
+     * \brief Compile the profiles in dir into the index.
+     * Every file in dir is a profile of "key=value" lines that applies
+     * to the applications given with "path=" keys.
+     * \return The number of applications with a profile.
+     */
+    unsigned int compile(const string & dir);
+
+    /*!
+     * \brief Find the profile of an application.
+     * \param app Path of the application.
+     * \param profile Set to the profile if found.
+     * \return true if the application has a profile.
+     */
+    bool lookup(const string & app, Profile & profile) const;
+
+private:
+
+    //! Disable copy-constructor
+    AppProfiles(const AppProfiles & r);
+
+    //! Disable assignment operator
+    AppProfiles & operator= (const AppProfiles & r);
+
+    //! Number of entries in the table
+    static const unsigned int TABLE_SIZE = 256;
+
+    //! Version of the index layout
+    static const uint32_t VERSION = 2;
+
+    struct Index
+    {
+        uint32_t version;
+        uint32_t sequence;
+        uint32_t count;
+        uint32_t reserved;
+        Profile  entries[TABLE_SIZE];
+    };
+
+    //! Parse a profile file, the paths it applies to are added to apps
+    static void parseFile(const string & file, Profile & profile, vector<string> & apps);
+
+    //! Parse a "key=value" line into profile
+    static bool parseLine(const string & key, const string & value, Profile & profile);
+
+    //! Hash of the application path, never 0
+    static uint64_t hashOf(const string & app);
+
+    //! Check if entry is the profile of app with the given hash
+    static bool sameApp(const Profile & entry, uint64_t hash, const char * app);
+
+    //! Shared index, NULL if mapping failed
+    Index * m_index;
+};
+
+#endif // APPPROFILES_H
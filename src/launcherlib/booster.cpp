@@ -23,6 +23,11 @@
 #include "singleinstance.h"
 #include "socketmanager.h"
 #include "logger.h"
+#include "forksafetyauditor.h"
+#include "envsignature.h"
+#include "launchthrottle.h"
+#include "boosterstatus.h"
+#include "schedtune.h"
 
 #include <cstdlib>
 #include <dlfcn.h>
@@ -31,27 +36,86 @@
 #include <sys/user.h>
 #include <sys/prctl.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <signal.h>
+#include <poll.h>
 #include <fcntl.h>
 #include <cstring>
+#include <climits>
+#include <cctype>
+#include <cstddef>
+#include <cstdio>
 #include <sstream>
 #include <stdexcept>
+#include <algorithm>
 #include <syslog.h>
 
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/un.h>
+#include <link.h>
+#include <fstream>
 #include <grp.h>
+#include <pwd.h>
+#include <ctime>
+#include <locale.h>
+#include <iconv.h>
 
 #include "coverage.h"
 
 static const int FALLBACK_GID = 126;
 
+// Libraries that are never released before launch even if
+// the launched application does not link against them.
+static const char * const DEFAULT_RESIDENT_LIBRARIES[] = {
+    "libc.so.6",
+    "libdl.so.2",
+    "libm.so.6",
+    "libpthread.so.0",
+    "librt.so.1",
+    "libstdc++.so.6",
+    "libgcc_s.so.1"
+};
+
+// I/O priority of the in-place upgrade and of preloading during a
+// launch boost, see ioprio_set(2)
+static const int IOPRIO_WHO_PROCESS = 1;
+static const int IOPRIO_CLASS_IDLE  = 3;
+static const int IOPRIO_CLASS_SHIFT = 13;
+
+// Nice steps and minimum utilization clamp of the launch boost
+static const int      LAUNCH_BOOST_NICE_STEPS = 5;
+static const uint32_t LAUNCH_BOOST_UCLAMP_MIN = 512;
+
+// Set by SIGUSR1 from the launcher when leaving the boot mode
+static volatile sig_atomic_t upgradeRequested = 0;
+
+static void upgradeHandler(int)
+{
+    upgradeRequested = 1;
+}
+
+// Return true if an invoker is waiting to be accepted
+static bool invocationPending(int socketFd)
+{
+    struct pollfd pfd;
+    pfd.fd      = socketFd;
+    pfd.events  = POLLIN;
+    pfd.revents = 0;
+    return poll(&pfd, 1, 0) > 0;
+}
+
 static gid_t getGroupId(const char *name, gid_t fallback)
 {
     struct group group, *grpptr;
     size_t size = sysconf(_SC_GETGR_R_SIZE_MAX);
-    char buf[size];
+    if (size == static_cast<size_t>(-1))
+        size = 16384;
 
-    if (getgrnam_r(name, &group, buf, size, &grpptr) == 0 && grpptr != NULL)
+    vector<char> buf(size);
+
+    if (getgrnam_r(name, &group, &buf[0], size, &grpptr) == 0 && grpptr != NULL)
         return group.gr_gid;
     else
         return fallback;
@@ -63,9 +127,35 @@ Booster::Booster() :
     m_oldPriority(0),
     m_oldPriorityOk(false),
     m_spaceAvailable(0),
-    m_bootMode(false)
+    m_bootMode(false),
+    m_unloadUnusedLibraries(false),
+    m_fastExit(false),
+    m_appModule(NULL),
+    m_auditForkSafety(false),
+    m_refuseForkUnsafe(false),
+    m_libcWarmup(false),
+    m_preloadVariant(-1),
+    m_envSignature(ENV_SIGNATURE_INIT),
+    m_upgradeSocket(-1),
+    m_upgradeInterrupted(false),
+    m_launchThrottle(NULL),
+    m_status(NULL),
+    m_appProfiles(NULL),
+    m_launchBoostMs(0),
+    m_deprioritizedPreload(false),
+    m_launchBoost(0),
+    m_boostNice(0),
+    m_normalNice(0),
+    m_normalUclampMin(0),
+    m_normalAutogroupNice(0)
 {
+    memset(&m_profile, 0, sizeof(m_profile));
+
     m_boosted_gid = getGroupId("boosted", FALLBACK_GID);
+
+    const unsigned int count = sizeof(DEFAULT_RESIDENT_LIBRARIES) / sizeof(DEFAULT_RESIDENT_LIBRARIES[0]);
+    for (unsigned int i = 0; i < count; i++)
+        m_residentLibraries.insert(DEFAULT_RESIDENT_LIBRARIES[i]);
 }
 
 Booster::~Booster()
@@ -83,14 +173,56 @@ void Booster::initialize(int initialArgc, char ** initialArgv, int newBoosterLau
 {
     m_bootMode = newBootMode;
 
+    const int64_t initStart = booster_status_now_ms();
+
     setBoosterLauncherSocket(newBoosterLauncherSocket);
 
-    // Drop priority (nice = 10)
-    pushPriority(10);
+    // The launcher asks a boot mode booster to upgrade itself to the
+    // normal mode with SIGUSR1. The launcher forks boosters with SIGUSR1
+    // blocked, it is only delivered while waiting for an invocation.
+    sigset_t upgradeSignal;
+    sigemptyset(&upgradeSignal);
+    sigaddset(&upgradeSignal, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &upgradeSignal, NULL);
+
+    struct sigaction upgradeAction, oldUpgradeAction;
+    memset(&upgradeAction, 0, sizeof(upgradeAction));
+    upgradeAction.sa_handler = upgradeHandler;
+    sigemptyset(&upgradeAction.sa_mask);
+    sigaction(SIGUSR1, &upgradeAction, &oldUpgradeAction);
+
+    // Everything open at this point is expected to be shared with the
+    // launched applications
+    ForkSafetyAuditor auditor;
+    if (m_auditForkSafety)
+        auditor.takeBaseline();
+
+    // Drop priority (nice = 10), lower while the application launched
+    // before is boosted
+    pushPriority(m_deprioritizedPreload ? 19 : 10);
+    const int oldIoPriority = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+    const int oldGroupNice  = m_deprioritizedPreload ? autogroup_nice(0) : INT_MIN;
+    if (m_deprioritizedPreload)
+    {
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+        if (oldGroupNice != INT_MIN)
+            autogroup_set_nice(0, 19);
+    }
+
+    // Remember the environment the preload is done under
+    m_envSignature = currentEnvSignature();
 
     // Preload stuff
     if (!m_bootMode)
-        preload();
+    {
+        preloadAll();
+        publishPreloadedLibraries(socketFd);
+    }
+
+    // Check the state of the booster before it starts waiting for invokers
+    if (m_auditForkSafety && !auditor.audit("preload"))
+        Logger::logWarning("Booster: Booster of type '%s' is not fork safe after preload",
+                           boosterType().c_str());
 
     // Rename process to temporary booster process name
     std::string temporaryProcessName = "booster [";
@@ -101,11 +233,26 @@ void Booster::initialize(int initialArgc, char ** initialArgv, int newBoosterLau
 
     // Restore priority
     popPriority();
+    if (m_deprioritizedPreload && oldIoPriority != -1)
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, oldIoPriority);
+    if (oldGroupNice != INT_MIN)
+        autogroup_set_nice(0, oldGroupNice);
+
+    // Invokers connecting from now on are accepted right away
+    if (m_status)
+        m_status->preload_ms = booster_status_now_ms() - initStart;
+    setReady();
 
     while (true)
     {
         // Wait and read commands from the invoker
         Logger::logDebug("Booster: Wait for message from invoker");
+        waitForInvocation(socketFd);
+
+        // Taken, invokers connecting from now on wait for the next booster
+        if (m_status)
+            m_status->ready = 0;
+
         if (!receiveDataFromInvoker(socketFd))
             throw std::runtime_error("Booster: Couldn't read command\n");
 
@@ -129,6 +276,7 @@ void Booster::initialize(int initialArgc, char ** initialArgv, int newBoosterLau
                         m_connection->sendExitValue(EXIT_SUCCESS);
                     }
                     m_connection->close();
+                    setReady();
 
                     // invoker requested to start an application that is already running
                     // booster is not needed this time, let's wait for the next connection from invoker
@@ -148,15 +296,45 @@ void Booster::initialize(int initialArgc, char ** initialArgv, int newBoosterLau
         break;
     }
 
+    // A pending upgrade request is delivered to the handler before the
+    // application gets the original SIGUSR1 disposition
+    sigprocmask(SIG_UNBLOCK, &upgradeSignal, NULL);
+    sigaction(SIGUSR1, &oldUpgradeAction, NULL);
+
+    // The next booster is forked after the respawn delay
+    if (m_status)
+    {
+        m_status->ready_at_ms = booster_status_now_ms() + m_appData->delay() * 1000 + m_status->preload_ms;
+        m_status->ready       = 0;
+    }
+
+    // Tell the parent under which environment the application was invoked
+    if (!m_envSignatureVars.empty())
+        sendEnvSignature();
+
     // Send parent process a message that it can create a new booster,
     // send pid of invoker, booster respawn value and invoker socket connection.
     sendDataToParent();
 
+    // Slow down applications that keep crashing right after launch. The
+    // launcher already has a new booster coming for other applications.
+    // Launches during boot are not delayed.
+    const int throttleMs = m_launchThrottle && !m_bootMode ?
+        m_launchThrottle->delayMs(m_appData->fileName()) : 0;
+    if (throttleMs)
+    {
+        Logger::logWarning("Booster: %s keeps crashing, delaying launch by %d ms",
+                           m_appData->fileName().c_str(), throttleMs);
+        usleep(throttleMs * 1000);
+    }
+
     // Give the process the real application name now that it
     // has been read from invoker in receiveDataFromInvoker().
     renameProcess(initialArgc, initialArgv, m_appData->argc(), m_appData->argv());
 
-    close(boosterLauncherSocket());
+    // The booster socket is closed after the launch statistics have been
+    // sent, make sure it is not inherited if the booster exec()s instead.
+    fcntl(boosterLauncherSocket(), F_SETFD, FD_CLOEXEC);
 
     // close invoker socket connection
     m_connection->close();
@@ -165,33 +343,446 @@ void Booster::initialize(int initialArgc, char ** initialArgv, int newBoosterLau
     prctl(PR_SET_PDEATHSIG, 0);
 }
 
+// Return microseconds elapsed since start and reset start to now.
+static long elapsedUs(struct timespec & start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    const long us = (now.tv_sec - start.tv_sec) * 1000000L + (now.tv_nsec - start.tv_nsec) / 1000;
+    start = now;
+    return us;
+}
+
+void Booster::preloadAll()
+{
+    // Do the libc initialization otherwise repeated by every application
+    if (m_libcWarmup && !upgradeInterrupted())
+        warmupLibc();
+
+    for (vector<string>::const_iterator it = m_preloadList.begin(); it != m_preloadList.end(); it++)
+        preloadLibrary(*it);
+
+    if (!upgradeInterrupted())
+        preload();
+}
+
+bool Booster::upgradeInterrupted()
+{
+    // A launch takes precedence over an in-place upgrade
+    if (m_upgradeSocket != -1 && (m_upgradeInterrupted || invocationPending(m_upgradeSocket)))
+        m_upgradeInterrupted = true;
+
+    return m_upgradeInterrupted;
+}
+
+void Booster::waitForInvocation(int socketFd)
+{
+    // SIGUSR1 is unblocked only inside ppoll(), so a request arriving
+    // after upgradeRequested has been checked is not lost
+    sigset_t waitMask;
+    sigprocmask(SIG_SETMASK, NULL, &waitMask);
+    sigdelset(&waitMask, SIGUSR1);
+
+    struct pollfd pfd;
+    pfd.fd     = socketFd;
+    pfd.events = POLLIN;
+
+    while (true)
+    {
+        if (upgradeRequested)
+        {
+            upgradeRequested = 0;
+            if (m_bootMode)
+                upgradeToNormalMode(socketFd);
+        }
+
+        pfd.revents = 0;
+        if (ppoll(&pfd, 1, NULL, &waitMask) > 0 || errno != EINTR)
+            return;
+    }
+}
+
+void Booster::upgradeToNormalMode(int socketFd)
+{
+    Logger::logDebug("Booster: upgrading booster of type '%s' to normal mode", boosterType().c_str());
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // Preload in the background, the booster is idle otherwise
+    pushPriority(19);
+    const int oldIoPriority = syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0);
+    syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+
+    ForkSafetyAuditor auditor;
+    if (m_auditForkSafety)
+        auditor.takeBaseline();
+
+    // preloadLibrary() gives up once an invocation is waiting
+    m_upgradeSocket      = socketFd;
+    m_upgradeInterrupted = false;
+
+    // Normal mode boosters inherit these from the launcher
+    for (vector<string>::const_iterator it = m_sharedPreloadList.begin(); it != m_sharedPreloadList.end(); it++)
+        preloadLibrary(*it);
+
+    preloadAll();
+
+    m_upgradeSocket = -1;
+
+    if (m_auditForkSafety && !auditor.audit("upgrade"))
+        Logger::logWarning("Booster: Booster of type '%s' is not fork safe after upgrade",
+                           boosterType().c_str());
+
+    if (oldIoPriority != -1)
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, oldIoPriority);
+    popPriority();
+
+    if (m_upgradeInterrupted)
+    {
+        // Serve the launch with what has been loaded so far. Booster
+        // specific initialization expects a complete preload, so the
+        // booster stays in the boot mode.
+        Logger::logInfo("Booster: upgrade of '%s' interrupted by a launch after %ld us",
+                        boosterType().c_str(), elapsedUs(start));
+        return;
+    }
+
+    m_bootMode = false;
+    publishPreloadedLibraries(socketFd);
+
+    Logger::logInfo("Booster: upgraded '%s' to normal mode in %ld us",
+                    boosterType().c_str(), elapsedUs(start));
+}
+
 bool Booster::bootMode() const
 {
     return m_bootMode;
 }
 
+void Booster::setUnloadUnusedLibraries(bool enable)
+{
+    m_unloadUnusedLibraries = enable;
+}
+
+void Booster::addResidentLibrary(const string & library)
+{
+    m_residentLibraries.insert(library);
+}
+
+void Booster::setFastExit(bool enable)
+{
+    m_fastExit = enable;
+}
+
+void Booster::setForkSafetyAudit(bool enable, bool refuseUnsafe)
+{
+    m_auditForkSafety  = enable;
+    m_refuseForkUnsafe = refuseUnsafe;
+}
+
+void Booster::setLibcWarmup(bool enable)
+{
+    m_libcWarmup = enable;
+}
+
+void Booster::warmupLibc()
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // NSS: load the configured modules by resolving the current user and group
+    {
+        size_t size = sysconf(_SC_GETPW_R_SIZE_MAX);
+        if (size == static_cast<size_t>(-1))
+            size = 16384;
+
+        vector<char> buf(size);
+        struct passwd pw, *pwptr;
+        getpwuid_r(getuid(), &pw, &buf[0], size, &pwptr);
+
+        struct group gr, *grptr;
+        getgrgid_r(getgid(), &gr, &buf[0], size, &grptr);
+    }
+    Logger::logInfo("Booster: libc warmup: NSS lookups took %ld us", elapsedUs(start));
+
+    // Locale: map the locale archive for the locale of the session without
+    // changing the locale of the process
+    locale_t locale = newlocale(LC_ALL_MASK, "", static_cast<locale_t>(0));
+    if (locale)
+        freelocale(locale);
+    Logger::logInfo("Booster: libc warmup: locale loading took %ld us", elapsedUs(start));
+
+    // Timezone: parse tzdata
+    tzset();
+    time_t now = time(NULL);
+    struct tm tm;
+    localtime_r(&now, &tm);
+    Logger::logInfo("Booster: libc warmup: timezone parsing took %ld us", elapsedUs(start));
+
+    // iconv: load the gconv module cache and the most common conversions
+    static const char * const CONVERSIONS[][2] = {
+        {"UTF-8", "WCHAR_T"},
+        {"WCHAR_T", "UTF-8"},
+        {"UTF-8", "UTF-16"},
+        {"UTF-16", "UTF-8"}
+    };
+
+    const unsigned int count = sizeof(CONVERSIONS) / sizeof(CONVERSIONS[0]);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        iconv_t cd = iconv_open(CONVERSIONS[i][0], CONVERSIONS[i][1]);
+        if (cd != reinterpret_cast<iconv_t>(-1))
+            iconv_close(cd);
+    }
+    Logger::logInfo("Booster: libc warmup: iconv module loading took %ld us", elapsedUs(start));
+}
+
+void Booster::setLaunchThrottle(const LaunchThrottle * throttle)
+{
+    m_launchThrottle = throttle;
+}
+
+void Booster::setAppProfiles(const AppProfiles * profiles)
+{
+    m_appProfiles = profiles;
+}
+
+void Booster::setLaunchBoost(int ms)
+{
+    m_launchBoostMs = ms;
+}
+
+void Booster::setDeprioritizedPreload(bool enable)
+{
+    m_deprioritizedPreload = enable;
+}
+
+void Booster::setStatus(booster_status * status, int delay)
+{
+    m_status = status;
+
+    if (m_status)
+    {
+        m_status->ready_at_ms = booster_status_now_ms() + delay * 1000 + m_status->preload_ms;
+        m_status->ready       = 0;
+    }
+}
+
+void Booster::setSharedPreloadList(const vector<string> & libraries)
+{
+    m_sharedPreloadList = libraries;
+}
+
+void Booster::setPreloadList(const vector<string> & libraries, int variant)
+{
+    m_preloadList    = libraries;
+    m_preloadVariant = variant;
+}
+
+// Collect the file names and sonames of the loaded objects
+static int collectLoadedLibrary(struct dl_phdr_info * info, size_t, void * data)
+{
+    set<string> * names = static_cast<set<string> *>(data);
+
+    // The main program and the vdso have no useful name
+    if (!info->dlpi_name || !*info->dlpi_name || strstr(info->dlpi_name, "linux-vdso"))
+        return 0;
+
+    const char * name = strrchr(info->dlpi_name, '/');
+    names->insert(name ? name + 1 : info->dlpi_name);
+
+    // DT_NEEDED refers to the soname, which may differ from the file name
+    for (int i = 0; i < info->dlpi_phnum; i++)
+    {
+        if (info->dlpi_phdr[i].p_type != PT_DYNAMIC)
+            continue;
+
+        const ElfW(Dyn) * dyn = reinterpret_cast<const ElfW(Dyn) *>(info->dlpi_addr + info->dlpi_phdr[i].p_vaddr);
+        ElfW(Addr) strtab = 0;
+        ElfW(Xword) soname = 0;
+        bool hasSoname = false;
+
+        for (; dyn->d_tag != DT_NULL; dyn++)
+        {
+            if (dyn->d_tag == DT_STRTAB)
+                strtab = dyn->d_un.d_ptr;
+            else if (dyn->d_tag == DT_SONAME)
+            {
+                soname = dyn->d_un.d_val;
+                hasSoname = true;
+            }
+        }
+
+        if (strtab && hasSoname)
+        {
+            // The dynamic linker relocates DT_STRTAB on most architectures
+            if (strtab < info->dlpi_addr)
+                strtab += info->dlpi_addr;
+
+            names->insert(reinterpret_cast<const char *>(strtab + soname));
+        }
+    }
+
+    return 0;
+}
+
+void Booster::publishPreloadedLibraries(int socketFd)
+{
+    struct sockaddr_un sun;
+    socklen_t len = sizeof(sun);
+    memset(&sun, 0, sizeof(sun));
+
+    if (getsockname(socketFd, reinterpret_cast<struct sockaddr *>(&sun), &len) != 0 ||
+        sun.sun_family != AF_UNIX)
+        return;
+
+    // Only the default booster of the type publishes its libraries,
+    // not the ones for environment signatures
+    const string socketPath(sun.sun_path);
+    const size_t slash = socketPath.rfind('/');
+    if (socketPath.substr(slash + 1) != boosterType())
+        return;
+
+    set<string> names;
+    dl_iterate_phdr(collectLoadedLibrary, &names);
+
+    std::stringstream contents;
+    for (set<string>::const_iterator it = names.begin(); it != names.end(); it++)
+        contents << *it << '\n';
+
+    const string path = socketPath + ".preload";
+
+    // Keep the file untouched if nothing changed, invokers cache their
+    // choices until it is modified
+    std::ifstream current(path.c_str());
+    std::stringstream currentContents;
+    currentContents << current.rdbuf();
+    if (currentContents.str() == contents.str())
+        return;
+
+    // Replace the file atomically
+    const string tmpPath = path + ".tmp";
+    std::ofstream file(tmpPath.c_str());
+    file << contents.str();
+    file.close();
+
+    if (!file || rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        Logger::logWarning("Booster: Couldn't publish preloaded libraries to '%s'", path.c_str());
+        unlink(tmpPath.c_str());
+    }
+}
+
+void Booster::setEnvSignatureVars(const vector<string> & vars)
+{
+    m_envSignatureVars = vars;
+}
+
+void Booster::setCgroupPath(const string & path)
+{
+    m_cgroupPath = path;
+}
+
+uint32_t Booster::currentEnvSignature() const
+{
+    uint32_t signature = ENV_SIGNATURE_INIT;
+
+    for (vector<string>::const_iterator it = m_envSignatureVars.begin(); it != m_envSignatureVars.end(); it++)
+        signature = env_signature_add(signature, it->c_str(), getenv(it->c_str()));
+
+    return signature;
+}
+
+void Booster::fastExitHandler(int status, void * booster)
+{
+    // All exit handlers registered by the application after loadMain()
+    // have been run at this point. Run the destructors of the application
+    // binary and flush what the application wrote, but skip the rest.
+    Booster * self = static_cast<Booster *>(booster);
+    if (self->m_appModule)
+        dlclose(self->m_appModule);
+
+    fflush(NULL);
+
+#ifdef WITH_COVERAGE
+    __gcov_flush();
+#endif
+
+    _exit(status);
+}
+
 void Booster::sendDataToParent()
 {
     // Number of data items to be sent to
     // the parent (launcher) process
-    const unsigned int NUM_DATA_ITEMS = 2;
+    const unsigned int NUM_DATA_ITEMS = 10;
 
     struct iovec    iov[NUM_DATA_ITEMS];
     struct msghdr   msg;
     struct cmsghdr *cmsg;
     char buf[CMSG_SPACE(sizeof(int))];
 
+    uint32_t type = BOOSTER_MSG_LAUNCH;
+    iov[0].iov_base = &type;
+    iov[0].iov_len  = sizeof(uint32_t);
+
     // Signal the parent process that it can create a new
     // waiting booster process and close write end
-    // Send to the parent process pid of invoker for tracking
-    pid_t pid = invokersPid();
-    iov[0].iov_base = &pid;
-    iov[0].iov_len  = sizeof(pid_t);
+    // Send to the parent process pid of invoker for tracking. The
+    // invoker is waited for only if its socket is passed along.
+    pid_t pid = m_connection->peerPid();
+    iov[1].iov_base = &pid;
+    iov[1].iov_len  = sizeof(pid_t);
 
     // Send to the parent process booster respawn delay value
     int delay = m_appData->delay();
-    iov[1].iov_base = &delay;
-    iov[1].iov_len  = sizeof(int);
+    iov[2].iov_base = &delay;
+    iov[2].iov_len  = sizeof(int);
+
+    // Send own pid so that the parent knows which booster type to restart
+    pid_t boosterPid = getpid();
+    iov[3].iov_base = &boosterPid;
+    iov[3].iov_len  = sizeof(pid_t);
+
+    // Send the invoker options so that the parent knows how to report the exit
+    uint32_t options = m_appData->options();
+    iov[4].iov_base = &options;
+    iov[4].iov_len  = sizeof(uint32_t);
+
+    // Send the user so that the parent knows the cgroup of the application
+    uid_t uid = m_appData->userId();
+    iov[5].iov_base = &uid;
+    iov[5].iov_len  = sizeof(uid_t);
+
+    // Send the application so that the parent can detect crash loops,
+    // and the arguments so that it can share the launch
+    const string & app = m_appData->fileName();
+    uint32_t appLength = std::min<size_t>(app.size(), BOOSTER_MSG_LAUNCH_MAX_APP);
+    iov[6].iov_base = &appLength;
+    iov[6].iov_len  = sizeof(uint32_t);
+
+    string args;
+    for (int i = 0; i < m_appData->argc(); i++)
+    {
+        args += m_appData->argv()[i];
+        args += '\0';
+    }
+
+    uint32_t argc = m_appData->argc();
+    if (args.size() > BOOSTER_MSG_LAUNCH_MAX_ARGS)
+    {
+        argc = ~0u;
+        args.clear();
+    }
+
+    iov[7].iov_base = &argc;
+    iov[7].iov_len  = sizeof(uint32_t);
+    iov[8].iov_base = const_cast<char *>(app.data());
+    iov[8].iov_len  = appLength;
+    iov[9].iov_base = const_cast<char *>(args.data());
+    iov[9].iov_len  = args.size();
 
     msg.msg_iov     = iov;
     msg.msg_iovlen  = NUM_DATA_ITEMS;
@@ -227,6 +818,137 @@ void Booster::sendDataToParent()
     }
 }
 
+void Booster::sendLaunchReport()
+{
+    // Only experimenting boosters and boosted launches are reported
+    if (m_preloadVariant == -1 && !m_launchBoost)
+    {
+        close(boosterLauncherSocket());
+        return;
+    }
+
+    LaunchReport report;
+    memset(&report, 0, sizeof(report));
+
+    report.pid           = getpid();
+    report.variant       = m_preloadVariant;
+    report.timeToMainUs  = elapsedUs(m_launchStart);
+    report.boost         = m_launchBoost;
+    report.boostNice     = m_boostNice;
+    report.nice          = m_normalNice;
+    report.uclampMin     = m_normalUclampMin;
+    report.autogroupNice = m_normalAutogroupNice;
+
+    // Memory usage is only needed to compare preload variants
+    if (m_preloadVariant != -1)
+    {
+        FILE * smaps = fopen("/proc/self/smaps_rollup", "r");
+        if (smaps)
+        {
+            char line[256];
+            while (fgets(line, sizeof(line), smaps))
+            {
+                sscanf(line, "Rss: %u kB", &report.rssKb);
+                sscanf(line, "Pss: %u kB", &report.pssKb);
+            }
+
+            fclose(smaps);
+        }
+    }
+
+    uint32_t type = BOOSTER_MSG_REPORT;
+
+    struct iovec iov[2];
+    iov[0].iov_base = &type;
+    iov[0].iov_len  = sizeof(uint32_t);
+    iov[1].iov_base = &report;
+    iov[1].iov_len  = sizeof(report);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 2;
+
+    if (sendmsg(boosterLauncherSocket(), &msg, 0) < 0)
+    {
+        Logger::logError("Booster: Couldn't send launch report to launcher process\n");
+    }
+
+    close(boosterLauncherSocket());
+}
+
+void Booster::setReady()
+{
+    if (m_status)
+        m_status->ready = 1;
+
+    uint32_t type = BOOSTER_MSG_READY;
+    pid_t pid = getpid();
+
+    struct iovec iov[2];
+    iov[0].iov_base = &type;
+    iov[0].iov_len  = sizeof(uint32_t);
+    iov[1].iov_base = &pid;
+    iov[1].iov_len  = sizeof(pid_t);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 2;
+
+    if (sendmsg(boosterLauncherSocket(), &msg, 0) < 0)
+    {
+        Logger::logError("Booster: Couldn't send readiness to launcher process\n");
+    }
+}
+
+void Booster::sendEnvSignature()
+{
+    EnvSignatureReport report;
+    memset(&report, 0, sizeof(report));
+
+    // The environment of the invocation has been received at this point
+    report.boosterPid = getpid();
+    report.signature  = currentEnvSignature();
+    report.matched    = report.signature == m_envSignature;
+
+    size_t envSize = 0;
+    for (vector<string>::const_iterator it = m_envSignatureVars.begin(); it != m_envSignatureVars.end(); it++)
+    {
+        const char * value = getenv(it->c_str());
+        if (!value)
+            continue;
+
+        string assignment = *it + "=" + value;
+        if (envSize + assignment.size() + 1 > sizeof(report.env))
+        {
+            Logger::logWarning("Booster: environment signature variables too long");
+            return;
+        }
+
+        memcpy(report.env + envSize, assignment.c_str(), assignment.size() + 1);
+        envSize += assignment.size() + 1;
+    }
+
+    uint32_t type = BOOSTER_MSG_SIGNATURE;
+
+    struct iovec iov[2];
+    iov[0].iov_base = &type;
+    iov[0].iov_len  = sizeof(uint32_t);
+    iov[1].iov_base = &report;
+    iov[1].iov_len  = offsetof(EnvSignatureReport, env) + envSize;
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 2;
+
+    if (sendmsg(boosterLauncherSocket(), &msg, 0) < 0)
+    {
+        Logger::logError("Booster: Couldn't send environment signature to launcher process\n");
+    }
+}
+
 bool Booster::receiveDataFromInvoker(int socketFd)
 {
     // delete previous connection instance because booster can
@@ -243,6 +965,9 @@ bool Booster::receiveDataFromInvoker(int socketFd)
     // Accept a new invocation.
     if (m_connection->accept(m_appData))
     {
+        // Launch latency is measured from here
+        clock_gettime(CLOCK_MONOTONIC, &m_launchStart);
+
         // Receive application data from the invoker
         if(!m_connection->receiveApplicationData(m_appData))
         {
@@ -340,6 +1065,17 @@ void Booster::setEnvironmentBeforeLaunch()
     if (!errno && cur_prio < m_appData->priority())
         setpriority(PRIO_PROCESS, 0, m_appData->priority());
 
+    // Join the cgroup of the application before dropping privileges,
+    // so that it is classified before it starts running
+    const bool placed = placeIntoCgroup();
+
+    // The profile may need the privileges, too. Affinity is set after
+    // joining the cgroup, whose cpuset could override it.
+    applyProfile();
+
+    // Raising the priority needs the privileges as well
+    applyLaunchBoost();
+
     // Set user ID and group ID of calling process if differing
     // from the ones we got from invoker
 
@@ -351,13 +1087,16 @@ void Booster::setEnvironmentBeforeLaunch()
 
     // Flip the effective group ID forth and back to a dedicated group
     // id to generate an event for policy (re-)classification.
-    gid_t orig = getegid();
-      
-    setegid(m_boosted_gid);
-    setegid(orig);
+    if (!placed)
+    {
+        gid_t orig = getegid();
+
+        setegid(m_boosted_gid);
+        setegid(orig);
+    }
 
-    // Reset out-of-memory killer adjustment
-    if (!m_appData->disableOutOfMemAdj())
+    // Reset out-of-memory killer adjustment unless set by the profile
+    if (!m_appData->disableOutOfMemAdj() && !(m_profile.fields & AppProfiles::OOM_SCORE_ADJ))
         resetOomAdj();
 
     // Make sure that boosted application can dump core. This must be
@@ -388,10 +1127,19 @@ int Booster::launchProcess()
     // Load the application and find out the address of main()
     loadMain();
 
+    // Release preloaded libraries the application doesn't depend on.
+    // This must be done after loadMain() so that the libraries needed
+    // by the application are referenced by it.
+    if (m_unloadUnusedLibraries && !m_bootMode)
+        unloadUnusedLibraries();
+
     // make booster specific initializations unless booster is in boot mode
     if (!m_bootMode)
         preinit();
 
+    // Tell the launcher how long it took to get here
+    sendLaunchReport();
+
 #ifdef WITH_COVERAGE
     __gcov_flush();
 #endif
@@ -406,6 +1154,12 @@ int Booster::launchProcess()
     __gcov_flush();
 #endif
 
+    // Leave through exit() like a normal process would. The exit handler
+    // installed in loadMain() terminates the process after the application's
+    // own exit handlers.
+    if (m_fastExit)
+        exit(retVal);
+
     return retVal;
 }
 
@@ -425,6 +1179,16 @@ void* Booster::loadMain()
         dlopenFlags |= RTLD_DEEPBIND;
 #endif
 
+    // The profile of the application overrides the invoker options
+    if (m_profile.fields & AppProfiles::DLOPEN_FLAGS)
+        dlopenFlags = m_profile.dlopenFlags;
+
+    // Exit handlers are run in the reverse order of registration, so the
+    // fast-exit handler must be registered before the application's static
+    // constructors get a chance to register their destructors.
+    if (m_fastExit && on_exit(fastExitHandler, this) != 0)
+        Logger::logWarning("Booster: Couldn't register the fast-exit handler");
+
     // Load the application as a library
     void * module = dlopen(m_appData->fileName().c_str(), dlopenFlags);
 
@@ -432,6 +1196,8 @@ void* Booster::loadMain()
         throw std::runtime_error(std::string("Booster: Loading invoked application failed: '") +
                                  dlerror() + "'\n");
 
+    m_appModule = module;
+
     // Find out the address for symbol "main". dlerror() is first used to clear any old error conditions,
     // then dlsym() is called, and then dlerror() is checked again. This procedure is documented
     // in dlsym()'s man page.
@@ -447,6 +1213,78 @@ void* Booster::loadMain()
     return module;
 }
 
+bool Booster::preloadLibrary(const string & path, int flags)
+{
+    if (upgradeInterrupted())
+        return false;
+
+    // Threads started by a library can't be undone, so a library is
+    // tried out in a throwaway process before it is refused or loaded.
+    if (m_refuseForkUnsafe && !ForkSafetyAuditor::probeLibrary(path, flags))
+    {
+        Logger::logWarning("Booster: Refusing to preload '%s', it is not fork safe", path.c_str());
+        return false;
+    }
+
+    ForkSafetyAuditor auditor;
+    if (m_auditForkSafety)
+        auditor.takeBaseline();
+
+    void * handle = dlopen(path.c_str(), flags);
+    if (!handle)
+    {
+        Logger::logWarning("Booster: Preloading '%s' failed: %s", path.c_str(), dlerror());
+        return false;
+    }
+
+    if (m_auditForkSafety && !m_refuseForkUnsafe)
+        auditor.audit(path);
+
+    m_preloadedLibraries.push_back(std::make_pair(path, handle));
+    return true;
+}
+
+bool Booster::isResidentLibrary(const string & path) const
+{
+    if (m_residentLibraries.count(path))
+        return true;
+
+    const string::size_type slash = path.rfind('/');
+    return slash != string::npos && m_residentLibraries.count(path.substr(slash + 1));
+}
+
+void Booster::unloadUnusedLibraries()
+{
+    int released = 0;
+
+    for (LibraryVect::iterator it = m_preloadedLibraries.begin(); it != m_preloadedLibraries.end(); it++)
+    {
+        if (isResidentLibrary(it->first))
+            continue;
+
+        // Drop the reference taken in preloadLibrary(). The dynamic linker
+        // keeps the library mapped if it is still reachable from the
+        // application or from another loaded library.
+        dlclose(it->second);
+
+        void * handle = dlopen(it->first.c_str(), RTLD_LAZY | RTLD_NOLOAD);
+        if (handle)
+        {
+            dlclose(handle);
+        }
+        else
+        {
+            Logger::logDebug("Booster: released unused library '%s'", it->first.c_str());
+            released++;
+        }
+    }
+
+    Logger::logDebug("Booster: released %d of %d preloaded libraries", released,
+                     static_cast<int>(m_preloadedLibraries.size()));
+
+    m_preloadedLibraries.clear();
+}
+
 bool Booster::pushPriority(int nice)
 {
     errno = 0;
@@ -513,6 +1351,179 @@ AppData* Booster::appData() const
     return m_appData;
 }
 
+string Booster::cgroupOf(const string & cgroupPath, const string & fileName, uid_t uid)
+{
+    // Cgroup names can't contain slashes and "." and ".." are reserved
+    string app = fileName.substr(fileName.rfind('/') + 1);
+    for (string::iterator it = app.begin(); it != app.end(); it++)
+    {
+        if (!isalnum(static_cast<unsigned char>(*it)) && *it != '-' && *it != '_' && *it != '.')
+            *it = '_';
+    }
+    if (app.find_first_not_of('.') == string::npos)
+        app = "_" + app;
+
+    std::ostringstream path;
+    bool appExpanded = false;
+    for (string::size_type i = 0; i < cgroupPath.size(); i++)
+    {
+        if (cgroupPath[i] != '%' || i + 1 == cgroupPath.size())
+        {
+            path << cgroupPath[i];
+            continue;
+        }
+
+        switch (cgroupPath[++i])
+        {
+        case 'u':
+            path << uid;
+            break;
+        case 'a':
+            path << app;
+            appExpanded = true;
+            break;
+        default:
+            path << cgroupPath[i];
+            break;
+        }
+    }
+    if (!appExpanded)
+        path << '/' << app;
+
+    return path.str();
+}
+
+bool Booster::placeIntoCgroup()
+{
+    if (m_cgroupPath.empty())
+        return false;
+
+    // Create the missing directories of the delegated subtree
+    const string dir = cgroupOf(m_cgroupPath, m_appData->fileName(), m_appData->userId());
+    for (string::size_type slash = dir.find('/', 1); ; slash = dir.find('/', slash + 1))
+    {
+        const string parent = dir.substr(0, slash);
+        if (mkdir(parent.c_str(), 0755) == -1 && errno != EEXIST)
+        {
+            Logger::logWarning("Booster: couldn't create cgroup '%s': %s",
+                               parent.c_str(), strerror(errno));
+            return false;
+        }
+
+        if (slash == string::npos)
+            break;
+    }
+
+    const string procs = dir + "/cgroup.procs";
+    int fd = open(procs.c_str(), O_WRONLY);
+    if (fd == -1)
+    {
+        Logger::logWarning("Booster: couldn't open '%s' for write: %s",
+                           procs.c_str(), strerror(errno));
+        return false;
+    }
+
+    char pid[16];
+    const int len = snprintf(pid, sizeof(pid), "%d", getpid());
+    const bool placed = write(fd, pid, len) == len;
+    if (placed)
+        Logger::logInfo("Booster: %s (pid=%d) placed into cgroup '%s'", m_appData->fileName().c_str(), getpid(), dir.c_str());
+    else
+        Logger::logWarning("Booster: couldn't write to '%s': %s", procs.c_str(), strerror(errno));
+
+    close(fd);
+    return placed;
+}
+
+bool Booster::applyProfile()
+{
+    if (!m_appProfiles || !m_appProfiles->lookup(m_appData->fileName(), m_profile))
+        return false;
+
+    const AppProfiles::Profile & profile = m_profile;
+    const char * app = m_appData->fileName().c_str();
+
+    if (profile.fields & AppProfiles::NICE &&
+        setpriority(PRIO_PROCESS, 0, profile.nice) == -1)
+    {
+        Logger::logWarning("Booster: couldn't set nice %d for %s: %s", profile.nice, app, strerror(errno));
+    }
+
+    if (profile.fields & AppProfiles::SCHED_POLICY)
+    {
+        struct sched_param param;
+        param.sched_priority = profile.schedPriority;
+        if (sched_setscheduler(0, profile.schedPolicy, &param) == -1)
+            Logger::logWarning("Booster: couldn't set scheduling policy of %s: %s", app, strerror(errno));
+    }
+
+    if (profile.fields & (AppProfiles::UCLAMP_MIN | AppProfiles::UCLAMP_MAX) &&
+        util_clamp_set(0,
+                       profile.fields & AppProfiles::UCLAMP_MIN ? static_cast<int>(profile.uclampMin) : -1,
+                       profile.fields & AppProfiles::UCLAMP_MAX ? static_cast<int>(profile.uclampMax) : -1) == -1)
+    {
+        Logger::logWarning("Booster: couldn't set utilization clamps of %s: %s", app, strerror(errno));
+    }
+
+    if (profile.fields & AppProfiles::AFFINITY &&
+        sched_setaffinity(0, sizeof(profile.affinity), &profile.affinity) == -1)
+    {
+        Logger::logWarning("Booster: couldn't set CPU affinity of %s: %s", app, strerror(errno));
+    }
+
+    if (profile.fields & AppProfiles::IO_PRIORITY &&
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, profile.ioPriority) == -1)
+    {
+        Logger::logWarning("Booster: couldn't set I/O priority of %s: %s", app, strerror(errno));
+    }
+
+    if (profile.fields & AppProfiles::OOM_SCORE_ADJ)
+    {
+        std::ofstream oomScoreAdj("/proc/self/oom_score_adj");
+        if (!(oomScoreAdj << profile.oomScoreAdj << std::flush))
+            Logger::logWarning("Booster: couldn't set oom_score_adj of %s", app);
+    }
+
+    Logger::logDebug("Booster: applied launch profile of %s", app);
+    return true;
+}
+
+void Booster::applyLaunchBoost()
+{
+    // Applications profiled to run in the background or in real time
+    // are left as they are
+    if (!m_launchBoostMs || sched_getscheduler(0) != SCHED_OTHER)
+        return;
+
+    errno = 0;
+    const int nice = getpriority(PRIO_PROCESS, 0);
+    if (errno)
+        return;
+
+    // The launcher restores the normal values when the boost ends
+    m_normalNice = nice;
+    m_boostNice  = std::max(nice - LAUNCH_BOOST_NICE_STEPS, -20);
+    if (m_boostNice < nice && setpriority(PRIO_PROCESS, 0, m_boostNice) == 0)
+        m_launchBoost |= LAUNCH_BOOST_NICE;
+
+    m_normalUclampMin = m_profile.fields & AppProfiles::UCLAMP_MIN ? m_profile.uclampMin : 0;
+    if (m_normalUclampMin < LAUNCH_BOOST_UCLAMP_MIN &&
+        util_clamp_set(0, LAUNCH_BOOST_UCLAMP_MIN, -1) == 0)
+        m_launchBoost |= LAUNCH_BOOST_UCLAMP;
+
+    // The application is alone in the autogroup of its booster's session
+    const int groupNice = autogroup_nice(0);
+    if (groupNice != INT_MIN && groupNice > -20 &&
+        autogroup_set_nice(0, std::max(groupNice - LAUNCH_BOOST_NICE_STEPS, -20)) == 0)
+    {
+        m_normalAutogroupNice = groupNice;
+        m_launchBoost |= LAUNCH_BOOST_AUTOGROUP;
+    }
+
+    if (!m_launchBoost)
+        Logger::logDebug("Booster: couldn't boost %s: %s", m_appData->fileName().c_str(), strerror(errno));
+}
+
 void Booster::resetOomAdj()
 {
     const char * PROC_OOM_ADJ_FILE = "/proc/self/oom_adj";
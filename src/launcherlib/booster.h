@@ -23,15 +23,116 @@
 #include "launcherlib.h"
 
 #include <cstdlib>
+#include <dlfcn.h>
 #include <string>
 
 using std::string;
 
+#include <vector>
+
+using std::vector;
+
+#include <set>
+
+using std::set;
+
+#include <stdint.h>
+#include <ctime>
+
 #include "appdata.h"
+#include "appprofiles.h"
 
 class Connection;
 class SocketManager;
 class SingleInstance;
+class LaunchThrottle;
+struct booster_status;
+
+//! Message sent to the launcher when a launch request has been received:
+//! the invoker pid, respawn delay, booster pid, invoker options, user ID
+//! of the application, length of the application path, number of the
+//! arguments, the application path and the '\0' terminated arguments
+const uint32_t BOOSTER_MSG_LAUNCH = 0x1a0c0000;
+
+//! Maximum length of the application path in BOOSTER_MSG_LAUNCH
+const unsigned int BOOSTER_MSG_LAUNCH_MAX_APP = 1024;
+
+//! Maximum size of the arguments in BOOSTER_MSG_LAUNCH, longer arguments
+//! are not sent and the number of the arguments is ~0
+const unsigned int BOOSTER_MSG_LAUNCH_MAX_ARGS = 2048;
+
+//! Message sent to the launcher right before jumping to main()
+const uint32_t BOOSTER_MSG_REPORT = 0x2e902000;
+
+//! Message sent to the launcher with the environment signature of a launch
+const uint32_t BOOSTER_MSG_SIGNATURE = 0x5e9a0000;
+
+//! Message sent to the launcher when the booster waits for invokers,
+//! followed by the pid of the booster
+const uint32_t BOOSTER_MSG_READY = 0x4ead0000;
+
+//! Maximum size of the environment assignments in BOOSTER_MSG_SIGNATURE
+const unsigned int ENV_SIGNATURE_MAX_ENV = 2048;
+
+//! Payload of BOOSTER_MSG_SIGNATURE
+struct EnvSignatureReport
+{
+    //! Pid of the booster that received the invocation
+    pid_t boosterPid;
+
+    //! Signature of the invocation's environment
+    uint32_t signature;
+
+    //! Non-zero if the booster was preloaded under the same signature
+    uint32_t matched;
+
+    //! "NAME=value" assignments of the set signature variables,
+    //! each terminated by '\0'
+    char env[ENV_SIGNATURE_MAX_ENV];
+};
+
+//! Payload of BOOSTER_MSG_REPORT
+struct LaunchReport
+{
+    //! Pid of the launched application
+    pid_t pid;
+
+    //! Preload variant of the booster, -1 if not experimenting
+    int variant;
+
+    //! Time from accepting the invoker connection to main()
+    uint32_t timeToMainUs;
+
+    //! Resident set size right before main(), 0 if not measured
+    uint32_t rssKb;
+
+    //! Proportional set size right before main(), 0 if not measured
+    uint32_t pssKb;
+
+    //! Launch boost applied before main(), LAUNCH_BOOST_* flags
+    uint32_t boost;
+
+    //! Nice value during the launch boost
+    int32_t boostNice;
+
+    //! Nice value to return to after the launch boost
+    int32_t nice;
+
+    //! Minimum utilization clamp to return to after the launch boost
+    uint32_t uclampMin;
+
+    //! Nice value of the autogroup to return to after the launch boost
+    int32_t autogroupNice;
+};
+
+//! The launched application runs at LaunchReport::boostNice
+const uint32_t LAUNCH_BOOST_NICE = 0x1;
+
+//! The launched application runs with a raised minimum utilization clamp
+const uint32_t LAUNCH_BOOST_UCLAMP = 0x2;
+
+//! The autogroup of the launched application runs at LaunchReport::boostNice
+const uint32_t LAUNCH_BOOST_AUTOGROUP = 0x4;
 
 /*!
  *  \class Booster
@@ -122,6 +223,125 @@ public:
     //! Return true, if in boot mode.
     bool bootMode() const;
 
+    /*!
+     * \brief Release preloaded libraries that the application does not need.
+     * If enabled, libraries preloaded with preloadLibrary() are dlclose()'d
+     * after the application has been loaded and before jumping to main().
+     * The dynamic linker unmaps only those libraries that are not part of
+     * the dependency closure of the application (or of a library kept
+     * resident), so the application sees no difference.
+     */
+    void setUnloadUnusedLibraries(bool enable);
+
+    /*!
+     * \brief Never release the given library before launch.
+     * \param library Full path or file name (e.g. "libfoo.so.1") of the library.
+     */
+    void addResidentLibrary(const string & library);
+
+    /*!
+     * \brief Skip exit-time cleanup of preloaded libraries.
+     * If enabled, exit() and returning from main() flush stdio, run the
+     * exit handlers and destructors of the application binary and then
+     * terminate with _exit(), so the cleanup registered by libraries
+     * initialized in the booster is not executed.
+     */
+    void setFastExit(bool enable);
+
+    /*!
+     * \brief Audit the fork safety of the preload stage.
+     * \param enable Log threads, file descriptors, file locks and connected
+     *        sockets created during preloading.
+     * \param refuseUnsafe Don't load libraries passed to preloadLibrary()
+     *        that violate fork safety.
+     */
+    void setForkSafetyAudit(bool enable, bool refuseUnsafe);
+
+    /*!
+     * \brief Warm up libc before preload().
+     * If enabled, NSS lookups, locale loading, timezone parsing and iconv
+     * module loading are done once in the booster, so that the resulting
+     * caches and mappings are shared by all launched applications.
+     */
+    void setLibcWarmup(bool enable);
+
+    /*!
+     * \brief Set the libraries to be preloaded before preload().
+     * \param libraries Paths of the libraries.
+     * \param variant Preload variant reported to the launcher with the
+     *        launch statistics. Memory usage is measured only if variant
+     *        is not -1.
+     */
+    void setPreloadList(const vector<string> & libraries, int variant = -1);
+
+    /*!
+     * \brief Set the libraries the launcher preloads for all booster types.
+     * Boosters started in the normal mode inherit them from the launcher.
+     * A boot mode booster loads them itself when upgraded to the normal mode.
+     */
+    void setSharedPreloadList(const vector<string> & libraries);
+
+    /*!
+     * \brief Set the environment variables that affect library initialization.
+     * The booster reports the signature of these variables in every
+     * invocation, so that the launcher can start boosters preloaded under
+     * the same values.
+     */
+    void setEnvSignatureVars(const vector<string> & vars);
+
+    /*!
+     * \brief Set the cgroup launched applications are placed into.
+     * \param path Directory in a delegated cgroup hierarchy. "%u" is
+     *        replaced with the user ID and "%a" with the file name of the
+     *        application, which is appended as the last component if "%a"
+     *        is not used. Missing directories are created at launch.
+     *        Empty disables the placement.
+     */
+    void setCgroupPath(const string & path);
+
+    //! Return the cgroup of the application fileName launched for uid
+    //! under the path given to setCgroupPath()
+    static string cgroupOf(const string & path, const string & fileName, uid_t uid);
+
+    //! Return the signature of the signature variables in the current environment.
+    uint32_t currentEnvSignature() const;
+
+    /*!
+     * \brief Set the table of applications that crash right after launch.
+     * Launches of crash looping applications are delayed.
+     */
+    void setLaunchThrottle(const LaunchThrottle * throttle);
+
+    /*!
+     * \brief Set the launch profiles of applications.
+     * The profile of the launched application is applied in
+     * setEnvironmentBeforeLaunch().
+     */
+    void setAppProfiles(const AppProfiles * profiles);
+
+    /*!
+     * \brief Boost the scheduling of launched applications.
+     * \param ms Time after main() the launcher keeps the application at a
+     *        lower nice value and a raised minimum utilization clamp,
+     *        0 disables the boost.
+     */
+    void setLaunchBoost(int ms);
+
+    /*!
+     * \brief Preload at the lowest CPU and I/O priority.
+     * Used while a launched application is boosted.
+     */
+    void setDeprioritizedPreload(bool enable);
+
+    /*!
+     * \brief Set the readiness status page of the booster socket.
+     * The booster publishes when it expects to be ready and marks itself
+     * ready when it starts waiting for invokers.
+     * \param status Status page, can be NULL.
+     * \param delay Seconds the booster sleeps before initializing.
+     */
+    void setStatus(booster_status * status, int delay);
+
 protected:
 
     /*!
@@ -136,6 +356,14 @@ protected:
      */
     virtual int launchProcess();
 
+    /*!
+     * Send launch statistics to the parent process and close the
+     * booster socket. Call it right before jumping to the application
+     * if launchProcess() is re-implemented, a launch boost ends only
+     * when it's reported.
+     */
+    void sendLaunchReport();
+
     /*!
      * \brief Preload libraries / initialize cache etc.
      * Called from initialize if not in the boot mode.
@@ -166,6 +394,16 @@ protected:
     //! Restore the old priority stored by the previous successful setPriority().
     bool popPriority();
 
+    /*!
+     * \brief Preload a library and remember its handle.
+     * Boosters should preload their libraries with this method in preload()
+     * so that the launcher can keep track of them.
+     * \param path Path of the library to be dlopen()'d.
+     * \param flags Flags passed to dlopen().
+     * \return true on success
+     */
+    bool preloadLibrary(const string & path, int flags = RTLD_NOW | RTLD_GLOBAL);
+
     //! Sets the socket fd used in the communication between
     //! the booster and launcher.
     void setBoosterLauncherSocket(int boosterLauncherSocket);
@@ -176,6 +414,24 @@ protected:
     //! Reset out-of-memory killer adjustment
     void resetOomAdj();
 
+    /*!
+     * \brief Move the process into the cgroup of the application.
+     * \return true if the process was placed into the cgroup set with
+     *         setCgroupPath().
+     */
+    bool placeIntoCgroup();
+
+    /*!
+     * \brief Look up the launch profile of the application and apply the
+     * scheduling, CPU affinity, OOM and I/O priority settings of it.
+     * The dlopen flags are applied by loadMain().
+     * \return true if the application has a profile.
+     */
+    bool applyProfile();
+
+    //! Boost the scheduling of the application for the launch, see setLaunchBoost()
+    void applyLaunchBoost();
+
     //! Data structure representing the application to be invoked
     AppData* m_appData;
 
@@ -187,13 +443,60 @@ private:
     //! Disable assignment operator
     Booster & operator= (const Booster & r);
 
-    //! Send data to the parent process (invokers pid, respwan delay)
-    //! and signal that a new booster can be created.
+    //! Send data to the parent process (invokers pid, respwan delay,
+    //! own pid, application path) and signal that a new booster can be
+    //! created.
     void sendDataToParent();
 
+    //! Send the environment signature of the invocation to the parent process.
+    void sendEnvSignature();
+
+    //! Mark the booster ready in its status page and tell the parent
+    //! process, which hands its waiting launches to the booster.
+    void setReady();
+
+    /*!
+     * \brief Publish the libraries loaded in the booster.
+     * The names are written to "<socket path>.preload" for the invoker
+     * to pick the best booster type with --type=auto.
+     * \param socketFd Listening socket of the booster.
+     */
+    void publishPreloadedLibraries(int socketFd);
+
     //! Helper method: load the library and find out address for "main".
     void* loadMain();
 
+    //! dlclose() preloaded libraries unless they are kept resident.
+    void unloadUnusedLibraries();
+
+    //! Return true if the library must not be released before launch.
+    bool isResidentLibrary(const string & path) const;
+
+    //! Perform the libc warmup steps and log the time spent in each.
+    void warmupLibc();
+
+    //! Warm up libc if enabled, load the preload list and call preload().
+    //! Steps are skipped once an upgrade is interrupted.
+    void preloadAll();
+
+    //! Return true if an invocation arrived during the in-place upgrade
+    bool upgradeInterrupted();
+
+    //! Wait until an invoker connects, upgrading to the normal mode
+    //! when the launcher asks for it.
+    void waitForInvocation(int socketFd);
+
+    /*!
+     * \brief Run the preloads skipped in the boot mode.
+     * Libraries are loaded at the lowest CPU and I/O priority. Loading
+     * stops as soon as an invoker connects, the booster then stays in
+     * the boot mode.
+     */
+    void upgradeToNormalMode(int socketFd);
+
+    //! Exit handler used in the fast-exit mode, see setFastExit().
+    static void fastExitHandler(int status, void * booster);
+
     //! Socket connection to invoker
     Connection* m_connection;
 
@@ -213,13 +516,97 @@ private:
     //! True, if being run in boot mode.
     bool m_bootMode;
 
+    //! Paths and handles of the libraries loaded by preloadLibrary()
+    typedef vector<std::pair<string, void *> > LibraryVect;
+    LibraryVect m_preloadedLibraries;
+
+    //! True if unneeded preloaded libraries are released before launch
+    bool m_unloadUnusedLibraries;
+
+    //! Libraries that are never released before launch
+    set<string> m_residentLibraries;
+
+    //! True if exit-time cleanup of preloaded libraries is skipped
+    bool m_fastExit;
+
+    //! Handle of the launched application binary
+    void * m_appModule;
+
+    //! True if the preload stage is audited for fork safety
+    bool m_auditForkSafety;
+
+    //! True if fork-unsafe libraries are not preloaded
+    bool m_refuseForkUnsafe;
+
+    //! True if libc is warmed up before preload()
+    bool m_libcWarmup;
+
+    //! Libraries preloaded before preload()
+    vector<string> m_preloadList;
+
+    //! Preload variant the preload list belongs to
+    int m_preloadVariant;
+
+    //! Time the invoker connection was accepted
+    struct timespec m_launchStart;
+
+    //! Environment variables the signature is computed over
+    vector<string> m_envSignatureVars;
+
+    //! Signature of the environment the booster was preloaded under
+    uint32_t m_envSignature;
+
+    //! Libraries loaded by the launcher for all boosters in the normal mode
+    vector<string> m_sharedPreloadList;
+
+    //! Listening socket while upgrading to the normal mode, -1 otherwise
+    int m_upgradeSocket;
+
+    //! True if an invocation arrived during the upgrade
+    bool m_upgradeInterrupted;
+
+    //! Crash loop table shared with the launcher, may be NULL
+    const LaunchThrottle * m_launchThrottle;
+
+    //! Readiness status page shared with the launcher, may be NULL
+    booster_status * m_status;
+
     //! Group ID to flip to and back to generate an event for policy
     //! (re)classification.
     gid_t m_boosted_gid;
 
+    //! Cgroup path template of launched applications, empty if not used
+    string m_cgroupPath;
+
+    //! Launch profiles shared with the launcher, may be NULL
+    const AppProfiles * m_appProfiles;
+
+    //! Profile of the launched application, no fields set if none
+    AppProfiles::Profile m_profile;
+
+    //! Duration of the launch boost, 0 if disabled
+    int m_launchBoostMs;
+
+    //! True if preloading at the lowest priority
+    bool m_deprioritizedPreload;
+
+    //! Launch boost applied, reported to the launcher
+    uint32_t m_launchBoost;
+    int m_boostNice;
+    int m_normalNice;
+    uint32_t m_normalUclampMin;
+    int m_normalAutogroupNice;
+
 #ifdef UNIT_TEST
     friend class Ut_Booster;
 #endif
 };
 
+/*!
+ * Type of the factory function booster plugins export as "createBooster".
+ * The daemon loads booster plugins with --booster-plugins=DIR and hosts
+ * one booster of each plugin's type.
+ */
+typedef Booster * (*create_booster_func_t)();
+
 #endif // BOOSTER_H
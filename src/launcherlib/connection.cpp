@@ -34,6 +34,7 @@ Connection::Connection(int socketFd, bool testMode) :
         m_testMode(testMode),
         m_fd(-1),
         m_curSocket(socketFd),
+        m_peerPid(0),
         m_fileName(""),
         m_argc(0),
         m_argv(NULL),
@@ -82,6 +83,9 @@ bool Connection::accept(AppData* appData)
             Logger::logError("Connection: Failed to accept a connection: %s\n", strerror(errno));
             return false;
         }
+
+        m_peerPid = 0;
+        m_peerPid = peerPid();
     }
 
     return true;
@@ -534,6 +538,9 @@ bool Connection::isReportAppExitStatusNeeded() const
 
 pid_t Connection::peerPid()
 {
+    if (m_peerPid)
+        return m_peerPid;
+
     struct ucred cr;
 
     socklen_t len = sizeof(struct ucred);
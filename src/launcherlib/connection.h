@@ -150,6 +150,9 @@ private:
     //! Fd of the UNIX socket file
     int m_curSocket;
 
+    //! Pid of the peer of the accepted connection, kept after close()
+    pid_t m_peerPid;
+
     string   m_fileName;
     uint32_t m_argc;
     const char **  m_argv;
@@ -23,19 +23,42 @@
 #include "booster.h"
 #include "singleinstance.h"
 #include "socketmanager.h"
+#include "preloadexperiment.h"
+#include "forksafetyauditor.h"
+#include "envsignature.h"
+#include "savedstate.h"
+#include "launchthrottle.h"
+#include "appprofiles.h"
+#include "boosterstatus.h"
+#include "launchercontrol.h"
+#include "libinvoker.h"
+#include "schedtune.h"
 
 #include <cstdlib>
 #include <cerrno>
 #include <sys/stat.h>
+#include <sys/sysmacros.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <sys/prctl.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <sys/resource.h>
 #include <fcntl.h>
+#include <dirent.h>
 #include <dlfcn.h>
 #include <glob.h>
+#include <climits>
+#include <ctime>
+#include <link.h>
 #include <cstring>
+#include <cstddef>
 #include <cstdio>
 #include <stdexcept>
+#include <algorithm>
 #include <fstream>
 #include <sstream>
 #include <stdlib.h>
@@ -48,9 +71,50 @@ extern char ** environ;
 
 Daemon * Daemon::m_instance = NULL;
 const int Daemon::m_boosterSleepTime = 2;
+const unsigned int Daemon::m_maxSignatureBoosters = 4;
+const int Daemon::m_staleDebounceMs = 2000;
+const int Daemon::m_staleRecycleIntervalMs = 3000;
+const unsigned int Daemon::m_maxBoosterFailures = 5;
+const int Daemon::m_degradedPeriodMs = 10 * 60 * 1000;
+const int Daemon::m_maxRespawnBackoff = 64;
+const int Daemon::m_crashWindowMs = 5000;
+const int Daemon::m_instanceReservationMs = 10000;
+const int Daemon::m_sharedLaunchTimeoutMs = 2000;
+const int Daemon::m_activationTimeoutMs = 100;
+const int Daemon::m_instancePollMs = 100;
+const int Daemon::m_admissionHoldMs = 1000;
+const int Daemon::m_interactiveStaleMs = 1000;
+
+// Read count '\0' terminated strings of data starting at pos
+static bool readStrings(const string & data, size_t & pos, size_t count, vector<string> & strings)
+{
+    for (size_t i = 0; i < count; i++)
+    {
+        const size_t end = data.find('\0', pos);
+        if (end == string::npos)
+            return false;
+
+        strings.push_back(data.substr(pos, end - pos));
+        pos = end + 1;
+    }
+
+    return true;
+}
+
+// Return true if a process died from a crash or exited with an error
+static bool abnormalExit(int status)
+{
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status) != 0;
 
-const std::string Daemon::m_stateDir = std::string(getenv("XDG_RUNTIME_DIR"))+"/applauncherd";
-const std::string Daemon::m_stateFile = Daemon::m_stateDir + "/saved-state";
+    if (WIFSIGNALED(status))
+    {
+        const int signal = WTERMSIG(status);
+        return signal != SIGTERM && signal != SIGKILL && signal != SIGINT && signal != SIGHUP;
+    }
+
+    return false;
+}
 
 static void sigChldHandler(int)
 {
@@ -92,12 +156,39 @@ Daemon::Daemon(int & argc, char * argv[]) :
     m_daemon(false),
     m_debugMode(false),
     m_bootMode(false),
-    m_boosterPid(0),
     m_socketManager(new SocketManager),
     m_singleInstance(new SingleInstance),
     m_reExec(false),
+    m_stateFd(-1),
     m_notifySystemd(false),
-    m_booster(0)
+    m_unloadUnusedLibraries(false),
+    m_fastExit(false),
+    m_auditPreload(false),
+    m_strictPreload(false),
+    m_warmupLibc(false),
+    m_preloadExperiment(NULL),
+    m_sharedLibrariesLoaded(false),
+    m_signatureHits(0),
+    m_signatureMisses(0),
+    m_recycleStale(false),
+    m_inotifyFd(-1),
+    m_staleCheckTime(0),
+    m_recycleTime(0),
+    m_staleLaunches(0),
+    m_recycledBoosters(0),
+    m_launchThrottle(NULL),
+    m_launchBoostMs(0),
+    m_launchBoostUntil(0),
+    m_boostedLaunches(0),
+    m_appProfiles(NULL),
+    m_profileWatchFd(-1),
+    m_controlSocket(-1),
+    m_instanceActivations(0),
+    m_activations(0),
+    m_coalesceWindowMs(500),
+    m_coalescedLaunches(0),
+    m_deferredBackgroundLaunches(0),
+    m_expiredBackgroundLaunches(0)
 {
     // Open the log
     Logger::openLog(argc > 0 ? argv[0] : "booster");
@@ -133,6 +224,16 @@ Daemon::Daemon(int & argc, char * argv[]) :
     m_initialArgv = argv;
     m_initialArgc = argc;
 
+    // Resolve the binary now, after an upgrade /proc/self/exe points
+    // to the deleted old binary
+    char executable[PATH_MAX];
+    ssize_t len = readlink("/proc/self/exe", executable, sizeof(executable) - 1);
+    if (len > 0)
+    {
+        executable[len] = '\0';
+        m_executable = executable;
+    }
+
     if (!m_reExec && socketpair(AF_UNIX, SOCK_DGRAM, 0, m_boosterLauncherSocket) == -1)
     {
         throw std::runtime_error("Daemon: Creating a socket pair for boosters failed!\n");
@@ -157,7 +258,68 @@ Daemon * Daemon::instance()
 
 void Daemon::run(Booster *booster)
 {
-    m_booster = booster;
+    if (booster)
+        addBooster(booster);
+
+    if (!m_boosterPluginDir.empty())
+        loadBoosterPlugins(m_boosterPluginDir);
+
+    if (m_boosters.empty())
+    {
+        // Critical error no booster types. Exiting applauncherd.
+        Logger::logError("Daemon: No boosters to run\n");
+        _exit(EXIT_FAILURE);
+    }
+
+    if (!m_preloadListFile.empty())
+        m_preloadLists[0] = readPreloadList(m_preloadListFile);
+
+    if (!m_experimentListFile.empty())
+    {
+        m_preloadLists[1] = readPreloadList(m_experimentListFile);
+        m_preloadExperiment = new PreloadExperiment;
+        m_preloadExperiment->setWinner(savedPreloadWinner());
+        if (m_preloadExperiment->winner() != -1)
+            Logger::logInfo("Daemon: preload experiment: variant %c won earlier, using it",
+                            'A' + m_preloadExperiment->winner());
+        else
+            Logger::logInfo("Daemon: preload experiment: A has %u, B has %u libraries",
+                            static_cast<unsigned int>(m_preloadLists[0].size()),
+                            static_cast<unsigned int>(m_preloadLists[1].size()));
+    }
+
+    // Crash counts are kept over re-exec
+    m_launchThrottle = new LaunchThrottle(m_socketManager->socketRootPath() + "launch-throttle");
+
+    if (!m_profileDir.empty())
+        loadAppProfiles();
+
+    // Boot mode boosters load the shared libraries themselves when
+    // they are upgraded to the normal mode
+    vector<string> sharedLibraries;
+    if (m_bootMode && !m_sharedPreloadFile.empty())
+        sharedLibraries = readPreloadList(m_sharedPreloadFile);
+
+    // Pass library and exit handling options to the boosters
+    for (BoosterMap::iterator b = m_boosters.begin(); b != m_boosters.end(); b++)
+    {
+        Booster * booster = b->second;
+
+        booster->setUnloadUnusedLibraries(m_unloadUnusedLibraries);
+        for (vector<string>::const_iterator it = m_residentLibraries.begin(); it != m_residentLibraries.end(); it++)
+            booster->addResidentLibrary(*it);
+
+        booster->setFastExit(m_fastExit);
+        booster->setForkSafetyAudit(m_auditPreload || m_strictPreload, m_strictPreload);
+        booster->setLibcWarmup(m_warmupLibc);
+        booster->setPreloadList(m_preloadLists[0]);
+        booster->setSharedPreloadList(sharedLibraries);
+        booster->setLaunchThrottle(m_launchThrottle);
+        booster->setEnvSignatureVars(m_envSignatureVars);
+        booster->setCgroupPath(m_cgroupPath);
+        booster->setAppProfiles(m_appProfiles);
+        booster->setLaunchBoost(m_launchBoostMs);
+    }
 
     // Make sure that LD_BIND_NOW does not prevent dynamic linker to
     // use lazy binding in later dlopen() calls.
@@ -166,23 +328,64 @@ void Daemon::run(Booster *booster)
     // dlopen single-instance
     loadSingleInstancePlugin();
 
+    // Boosters run the code loaded so far
+    m_binaryFingerprint = binaryFingerprint();
+
+    // Libraries common to all booster types are loaded once into the
+    // daemon and inherited by every booster. Deferred in boot mode.
+    if (!m_bootMode)
+        preloadSharedLibraries();
+
     if (m_reExec)
     {
+        // Waiting boosters survived the re-exec. Keep them if they were
+        // forked from the same binaries with the same configuration.
+        if (m_savedBinaryFingerprint == m_binaryFingerprint &&
+            m_savedConfigFingerprint == configFingerprint())
+        {
+            Logger::logInfo("Daemon: Adopting waiting boosters after re-exec");
+        }
+        else
+        {
+            Logger::logInfo("Daemon: Boosters are stale after re-exec, restarting them");
+            killBoosters();
+        }
+
         // Reap dead booster processes and restart them
         // Note: this cannot be done before booster plugins have been loaded
         reapZombies();
     }
-    else
+
+    vector<string> newTypes;
+    for (BoosterMap::iterator b = m_boosters.begin(); b != m_boosters.end(); b++)
     {
+        // Types restored after re-exec already have a booster
+        if (m_boosterPids.find(b->first) != m_boosterPids.end())
+            continue;
+
         // Create socket for the booster
-        Logger::logDebug("Daemon: initing socket: %s", booster->boosterType().c_str());
-        m_socketManager->initSocket(booster->boosterType());
+        Logger::logDebug("Daemon: initing socket: %s", b->first.c_str());
+        m_socketManager->initSocket(b->first);
+        newTypes.push_back(b->first);
+    }
 
+    // Boosters must not inherit sockets passed by systemd for unknown types
+    m_socketManager->closeActivatedSockets();
+
+    for (vector<string>::const_iterator it = newTypes.begin(); it != newTypes.end(); it++)
+    {
         // Fork each booster for the first time
-        Logger::logDebug("Daemon: forking booster: %s", booster->boosterType().c_str());
-        forkBooster();
+        Logger::logDebug("Daemon: forking booster: %s", it->c_str());
+        forkBooster(*it);
     }
 
+    publishEnvSignatureVars();
+
+    initControlSocket();
+
+    if (m_recycleStale)
+        watchLoadedFiles();
+
     // Notify systemd that init is done
     if (m_notifySystemd) {
         Logger::logDebug("Daemon: initialization done. Notify systemd\n");
@@ -199,14 +402,79 @@ void Daemon::run(Booster *booster)
         // Init data for select
         FD_ZERO(&rfds);
 
+        fd_set wfds;
+        FD_ZERO(&wfds);
+
         FD_SET(m_boosterLauncherSocket[0], &rfds);
         ndfs = std::max(ndfs, m_boosterLauncherSocket[0]);
 
         FD_SET(m_sigPipeFd[0], &rfds);
         ndfs = std::max(ndfs, m_sigPipeFd[0]);
 
+        if (m_inotifyFd != -1)
+        {
+            FD_SET(m_inotifyFd, &rfds);
+            ndfs = std::max(ndfs, m_inotifyFd);
+        }
+
+        if (m_profileWatchFd != -1)
+        {
+            FD_SET(m_profileWatchFd, &rfds);
+            ndfs = std::max(ndfs, m_profileWatchFd);
+        }
+
+        if (m_controlSocket != -1)
+        {
+            FD_SET(m_controlSocket, &rfds);
+            ndfs = std::max(ndfs, m_controlSocket);
+        }
+
+        for (set<int>::const_iterator it = m_controlClients.begin(); it != m_controlClients.end(); it++)
+        {
+            FD_SET(*it, &rfds);
+            ndfs = std::max(ndfs, *it);
+        }
+
+        // Window activations queued for the session bus
+        bool activationPending = false;
+        const int activationSocket = activationFd(&activationPending);
+        if (activationSocket != -1)
+        {
+            FD_SET(activationSocket, &rfds);
+            if (activationPending)
+                FD_SET(activationSocket, &wfds);
+            ndfs = std::max(ndfs, activationSocket);
+        }
+
+        // Wake up for pending stale booster checks
+        struct timeval timeout;
+        struct timeval * timeoutPtr = NULL;
+        int64_t waitMs = -1;
+        int64_t nextTime = staleTimerDeadline();
+        const int64_t sharedTime = sharedLaunchDeadline();
+        if (sharedTime && (!nextTime || sharedTime < nextTime))
+            nextTime = sharedTime;
+        const int64_t boostTime = launchBoostDeadline();
+        if (boostTime && (!nextTime || boostTime < nextTime))
+            nextTime = boostTime;
+        const int64_t waitingTime = waitingLaunchDeadline();
+        if (waitingTime && (!nextTime || waitingTime < nextTime))
+            nextTime = waitingTime;
+        if (nextTime)
+            waitMs = std::max<int64_t>(nextTime - monotonicMs(), 0);
+
+        if (!m_instanceRequests.empty() && (waitMs < 0 || waitMs > m_instancePollMs))
+            waitMs = m_instancePollMs;
+
+        if (waitMs >= 0)
+        {
+            timeout.tv_sec  = waitMs / 1000;
+            timeout.tv_usec = (waitMs % 1000) * 1000;
+            timeoutPtr = &timeout;
+        }
+
         // Wait for something appearing in the pipes.
-        if (select(ndfs + 1, &rfds, NULL, NULL, NULL) > 0)
+        if (select(ndfs + 1, &rfds, &wfds, NULL, timeoutPtr) > 0)
         {
             Logger::logDebug("Daemon: select done.");
 
@@ -217,6 +485,39 @@ void Daemon::run(Booster *booster)
                 readFromBoosterSocket(m_boosterLauncherSocket[0]);
             }
 
+            // Check if files of the boosters changed on disk
+            if (m_inotifyFd != -1 && FD_ISSET(m_inotifyFd, &rfds))
+            {
+                Logger::logDebug("Daemon: FD_ISSET(m_inotifyFd)");
+                readInotifyEvents();
+            }
+
+            // Check if the launch profiles changed
+            if (m_profileWatchFd != -1 && FD_ISSET(m_profileWatchFd, &rfds))
+            {
+                Logger::logDebug("Daemon: FD_ISSET(m_profileWatchFd)");
+                readProfileEvents();
+            }
+
+            // Requests served by the launcher itself. Copy the clients,
+            // requests can close finished connections.
+            const set<int> controlClients = m_controlClients;
+            for (set<int>::const_iterator it = controlClients.begin(); it != controlClients.end(); it++)
+            {
+                if (FD_ISSET(*it, &rfds) && m_controlClients.count(*it))
+                    readControlRequest(*it);
+            }
+
+            if (m_controlSocket != -1 && FD_ISSET(m_controlSocket, &rfds))
+                acceptControlConnection();
+
+            if (activationSocket != -1 &&
+                (FD_ISSET(activationSocket, &rfds) || FD_ISSET(activationSocket, &wfds)))
+            {
+                Logger::logDebug("Daemon: FD_ISSET(activationSocket)");
+                m_singleInstance->pluginEntry()->processActivationsFunc();
+            }
+
             // Check if we got SIGCHLD, SIGTERM, SIGUSR1 or SIGUSR2
             if (FD_ISSET(m_sigPipeFd[0], &rfds))
             {
@@ -233,6 +534,24 @@ void Daemon::run(Booster *booster)
 
                 case SIGTERM:
                     Logger::logDebug("Daemon: SIGTERM received.");
+                    if (m_preloadExperiment)
+                        m_preloadExperiment->logSummary();
+                    if (!m_envSignatureVars.empty())
+                        logEnvSignatureStats();
+                    if (m_recycleStale)
+                        logStaleBoosterStats();
+                    logFallbackStats();
+                    if (m_instanceActivations)
+                        Logger::logInfo("Daemon: %u single instance launches found a running instance",
+                                        m_instanceActivations);
+                    if (m_activations)
+                        Logger::logInfo("Daemon: %u applications launched for activation requests",
+                                        m_activations);
+                    if (m_coalescedLaunches)
+                        Logger::logInfo("Daemon: %u launches coalesced with an identical launch",
+                                        m_coalescedLaunches);
+                    if (m_boostedLaunches)
+                        Logger::logInfo("Daemon: %u launches boosted", m_boostedLaunches);
                     exit(EXIT_SUCCESS);
                     break;
 
@@ -263,22 +582,49 @@ void Daemon::run(Booster *booster)
                 }
             }
         }
+
+        runStaleTimers();
+
+        if (!m_instanceRequests.empty())
+            runInstanceRequests();
+
+        if (!m_pendingActivations.empty())
+            runPendingActivations();
+
+        if (!m_backgroundLaunches.empty())
+            runBackgroundLaunches();
+
+        if (!m_sharedLaunches.empty())
+            expireSharedLaunches();
+
+        if (!m_launchBoosts.empty())
+            endLaunchBoosts();
     }
 }
 
 void Daemon::readFromBoosterSocket(int fd)
 {
+    uint32_t type    = 0;
     pid_t invokerPid = 0;
     int delay        = 0;
+    pid_t boosterPid = 0;
+    LaunchReport report;
     struct msghdr   msg;
     struct cmsghdr *cmsg;
     struct iovec    iov[2];
     char buf[CMSG_SPACE(sizeof(int))];
 
-    iov[0].iov_base = &invokerPid;
-    iov[0].iov_len  = sizeof(pid_t);
-    iov[1].iov_base = &delay;
-    iov[1].iov_len  = sizeof(int);
+    // All messages share the type field, the rest of the message is
+    // interpreted based on it. The largest payload is an
+    // EnvSignatureReport or a launch with its arguments.
+    const size_t launchHeaderSize = 2 * sizeof(pid_t) + sizeof(int) + 3 * sizeof(uint32_t) + sizeof(uid_t);
+    const size_t launchSize = launchHeaderSize + BOOSTER_MSG_LAUNCH_MAX_APP + BOOSTER_MSG_LAUNCH_MAX_ARGS;
+    char payload[launchSize > sizeof(EnvSignatureReport) ? launchSize : sizeof(EnvSignatureReport)];
+
+    iov[0].iov_base = &type;
+    iov[0].iov_len  = sizeof(uint32_t);
+    iov[1].iov_base = payload;
+    iov[1].iov_len  = sizeof(payload);
 
     msg.msg_iov        = iov;
     msg.msg_iovlen     = 2;
@@ -287,42 +633,1957 @@ void Daemon::readFromBoosterSocket(int fd)
     msg.msg_control    = buf;
     msg.msg_controllen = sizeof(buf);
 
-    if (recvmsg(fd, &msg, 0) >= 0)
+    ssize_t received = recvmsg(fd, &msg, 0);
+
+    if (received >= 0 && type == BOOSTER_MSG_REPORT)
+    {
+        if (received == static_cast<ssize_t>(sizeof(uint32_t) + sizeof(LaunchReport)))
+        {
+            memcpy(&report, payload, sizeof(LaunchReport));
+            Logger::logDebug("Daemon: pid %d reached main() in %u us\n",
+                             report.pid, report.timeToMainUs);
+
+            if (m_preloadExperiment && m_preloadExperiment->winner() == -1)
+            {
+                m_preloadExperiment->addSample(report.variant, report.timeToMainUs,
+                                               report.rssKb, report.pssKb);
+
+                if (m_preloadExperiment->winner() != -1)
+                    savePreloadWinner(m_preloadExperiment->winner());
+            }
+
+            if (report.boost)
+                startLaunchBoost(report);
+        }
+
+        // Reports don't need a new booster
+        return;
+    }
+
+    if (received >= 0 && type == BOOSTER_MSG_READY)
+    {
+        if (received == static_cast<ssize_t>(sizeof(uint32_t) + sizeof(pid_t)))
+        {
+            memcpy(&boosterPid, payload, sizeof(pid_t));
+            Logger::logDebug("Daemon: booster %d is ready\n", boosterPid);
+        }
+
+        // The main loop hands the waiting launches to the booster
+        return;
+    }
+
+    if (received >= 0 && type == BOOSTER_MSG_SIGNATURE)
+    {
+        const ssize_t headerSize = sizeof(uint32_t) + offsetof(EnvSignatureReport, env);
+        if (received >= headerSize)
+        {
+            EnvSignatureReport signatureReport;
+            memcpy(&signatureReport, payload, received - sizeof(uint32_t));
+            handleEnvSignature(signatureReport, received - headerSize);
+        }
+
+        // The launch message follows
+        return;
+    }
+
+    if (received >= static_cast<ssize_t>(sizeof(uint32_t) + launchHeaderSize) &&
+        type == BOOSTER_MSG_LAUNCH)
     {
+        uint32_t options = 0;
+        uid_t uid = 0;
+        uint32_t appLength = 0;
+        uint32_t argc = 0;
+        memcpy(&invokerPid, payload, sizeof(pid_t));
+        memcpy(&delay, payload + sizeof(pid_t), sizeof(int));
+        memcpy(&boosterPid, payload + sizeof(pid_t) + sizeof(int), sizeof(pid_t));
+        memcpy(&options, payload + 2 * sizeof(pid_t) + sizeof(int), sizeof(uint32_t));
+        memcpy(&uid, payload + 2 * sizeof(pid_t) + sizeof(int) + sizeof(uint32_t), sizeof(uid_t));
+        memcpy(&appLength, payload + 2 * sizeof(pid_t) + sizeof(int) + sizeof(uint32_t) + sizeof(uid_t),
+               sizeof(uint32_t));
+        memcpy(&argc, payload + 2 * sizeof(pid_t) + sizeof(int) + 2 * sizeof(uint32_t) + sizeof(uid_t),
+               sizeof(uint32_t));
+
+        // The rest of the message is the path of the application and the
+        // arguments
+        const string rest(payload + launchHeaderSize, received - sizeof(uint32_t) - launchHeaderSize);
+        const string app = rest.substr(0, appLength);
+        if (boosterPid && !app.empty())
+        {
+            LaunchedApp & launched = m_launchedApps[boosterPid];
+            launched.app = app;
+            launched.launchTime = monotonicMs();
+
+            // Removed when the application exits, unless other
+            // instances still use it
+            if (!m_cgroupPath.empty())
+                launched.cgroup = Booster::cgroupOf(m_cgroupPath, launched.app, uid);
+        }
+
+        if (invokerPid && boosterPid)
+        {
+            // Without the whole path and arguments the launch can't be
+            // shared with identical ones
+            size_t pos = appLength;
+            vector<string> argv;
+            string key;
+            if (appLength < BOOSTER_MSG_LAUNCH_MAX_APP && app.size() == appLength &&
+                argc != ~0u && readStrings(rest, pos, argc, argv))
+                key = launchKey(uid, app, argv);
+
+            instanceLaunched(invokerPid, boosterPid);
+            sharedLaunchStarted(invokerPid, boosterPid, app, key);
+        }
+
         Logger::logDebug("Daemon: invoker's pid: %d\n", invokerPid);
         Logger::logDebug("Daemon: respawn delay: %d \n", delay);
-        if (invokerPid != 0)
+        Logger::logDebug("Daemon: booster's pid: %d \n", boosterPid);
+        // The invoker socket is passed if the invoker waits for the
+        // application to exit
+        cmsg = CMSG_FIRSTHDR(&msg);
+        if (invokerPid != 0 && cmsg)
         {
             // Store booster - invoker pid pair
             // Store booster - invoker socket pair
-            if (m_boosterPid)
+            if (boosterPid)
             {
-                cmsg = CMSG_FIRSTHDR(&msg);
                 int newFd;                 
                 memcpy(&newFd, CMSG_DATA(cmsg), sizeof(int));
                 Logger::logDebug("Daemon: socket file descriptor: %d\n", newFd);
-                m_boosterPidToInvokerPid[m_boosterPid] = invokerPid;
-                m_boosterPidToInvokerFd[m_boosterPid] = newFd;
+
+                // Activations are launched by the launcher itself, which
+                // doesn't wait for them
+                if (invokerPid == getpid())
+                {
+                    close(newFd);
+                }
+                else
+                {
+                    m_boosterPidToInvokerPid[boosterPid] = invokerPid;
+                    m_boosterPidToInvokerFd[boosterPid] = newFd;
+
+                    if (options & INVOKER_MSG_MAGIC_OPTION_WAIT_STATUS)
+                        m_waitStatusPids.insert(boosterPid);
+                }
+            }
+        }
+    }
+    else
+    {
+        Logger::logError("Daemon: Nothing read from the socket\n");
+        // Critical error communicating with booster. Exiting applauncherd.
+        _exit(EXIT_FAILURE);
+    }
+
+    const string boosterType = boosterTypeOf(boosterPid);
+    if (boosterType.empty())
+    {
+        Logger::logWarning("Daemon: Launch from unknown booster %d\n", boosterPid);
+        return;
+    }
+
+    // The booster made it through preload
+    BoosterHealth & health = m_boosterHealth[boosterType];
+    health.failures = 0;
+    if (health.probing)
+    {
+        health.probing = false;
+        Logger::logInfo("Daemon: booster '%s' recovered", boosterType.c_str());
+    }
+
+    if (m_staleBoosterPids.erase(boosterPid))
+    {
+        m_staleLaunches++;
+        Logger::logInfo("Daemon: launch served by stale booster %d", boosterPid);
+    }
+
+    // 2nd param guarantees some time for the just launched application
+    // to start up before forking new booster. Not doing this would
+    // slow down the start-up significantly on single core CPUs.
+
+    forkBooster(boosterType, delay);
+}
+
+string Daemon::boosterTypeOf(pid_t pid) const
+{
+    if (pid > 0)
+    {
+        for (BoosterPidMap::const_iterator it = m_boosterPids.begin(); it != m_boosterPids.end(); it++)
+        {
+            if (it->second == pid)
+                return it->first;
+        }
+    }
+
+    return string();
+}
+
+void Daemon::handleEnvSignature(const EnvSignatureReport & report, size_t envSize)
+{
+    const string slot = boosterTypeOf(report.boosterPid);
+    if (slot.empty())
+        return;
+
+    SignatureBoosterMap::const_iterator s = m_signatureBoosters.find(slot);
+    const string type = s != m_signatureBoosters.end() ? s->second.type : slot;
+
+    if (report.matched)
+    {
+        m_signatureHits++;
+
+        if (s != m_signatureBoosters.end())
+        {
+            m_signatureLru.remove(slot);
+            m_signatureLru.push_front(slot);
+        }
+
+        return;
+    }
+
+    m_signatureMisses++;
+
+    char signature[16];
+    snprintf(signature, sizeof(signature), ENV_SIGNATURE_FORMAT, report.signature);
+    const string signatureSlot = type + "." + signature;
+
+    Logger::logDebug("Daemon: launch with environment signature %s missed", signatureSlot.c_str());
+
+    if (m_signatureBoosters.find(signatureSlot) != m_signatureBoosters.end())
+    {
+        // Booster exists, but was busy
+        m_signatureLru.remove(signatureSlot);
+        m_signatureLru.push_front(signatureSlot);
+        return;
+    }
+
+    // The assignments are separated by '\0'
+    vector<string> env;
+    size_t begin = 0;
+    while (begin < envSize)
+    {
+        size_t end = begin;
+        while (end < envSize && report.env[end])
+            end++;
+
+        env.push_back(string(report.env + begin, end - begin));
+        begin = end + 1;
+    }
+
+    addSignatureBooster(signatureSlot, type, env);
+}
+
+void Daemon::addSignatureBooster(const string & slot, const string & type, const vector<string> & env)
+{
+    // Drop the least recently used signature boosters. Boosters that
+    // are not waiting for invokers may be about to take a launch.
+    while (m_signatureLru.size() >= m_maxSignatureBoosters)
+    {
+        list<string>::reverse_iterator victim = m_signatureLru.rbegin();
+        while (victim != m_signatureLru.rend())
+        {
+            const booster_status * status = boosterStatus(*victim);
+            if (!status || status->ready)
+                break;
+
+            victim++;
+        }
+
+        if (victim == m_signatureLru.rend())
+        {
+            Logger::logDebug("Daemon: all signature boosters are busy, not adding '%s'", slot.c_str());
+            return;
+        }
+
+        const string victimSlot = *victim;
+        removeSignatureBooster(victimSlot);
+    }
+
+    SignatureBooster signatureBooster;
+    signatureBooster.type = type;
+    signatureBooster.env  = env;
+
+    m_signatureBoosters[slot] = signatureBooster;
+    m_signatureLru.push_front(slot);
+
+    m_socketManager->initSocket(slot);
+
+    // Give the just launched application time to start up
+    forkBooster(slot, m_boosterSleepTime);
+
+    Logger::logInfo("Daemon: started booster '%s' for a new environment signature", slot.c_str());
+    logEnvSignatureStats();
+}
+
+void Daemon::removeSignatureBooster(const string & slot)
+{
+    Logger::logDebug("Daemon: removing signature booster '%s'", slot.c_str());
+
+    // Forget the pid first so that the booster is not restarted when reaped
+    BoosterPidMap::iterator it = m_boosterPids.find(slot);
+    if (it != m_boosterPids.end())
+    {
+        if (it->second)
+            killProcess(it->second, SIGTERM);
+
+        m_boosterPids.erase(it);
+    }
+
+    // Invokers fall back to the default booster once the socket is gone
+    unlink((m_socketManager->socketRootPath() + slot).c_str());
+    m_socketManager->closeSocket(slot);
+    removeBoosterStatus(slot);
+
+    m_signatureBoosters.erase(slot);
+    m_signatureLru.remove(slot);
+}
+
+void Daemon::publishEnvSignatureVars()
+{
+    // Remove signature booster sockets and status pages left behind by
+    // a previous launcher
+    const string rootPath = m_socketManager->socketRootPath();
+    const string statusSuffix = BOOSTER_STATUS_SUFFIX;
+    for (BoosterMap::iterator b = m_boosters.begin(); b != m_boosters.end(); b++)
+    {
+        const string pattern = rootPath + b->first + ".*";
+
+        glob_t globResult;
+        if (glob(pattern.c_str(), 0, NULL, &globResult) == 0)
+        {
+            for (size_t i = 0; i < globResult.gl_pathc; i++)
+            {
+                const string path = globResult.gl_pathv[i];
+                const string slot = path.substr(rootPath.size());
+
+                struct stat st;
+                if (stat(path.c_str(), &st) != 0)
+                    continue;
+
+                if (S_ISSOCK(st.st_mode))
+                {
+                    unlink(path.c_str());
+                }
+                else if (S_ISREG(st.st_mode) && slot.size() > statusSuffix.size() &&
+                         slot.compare(slot.size() - statusSuffix.size(), statusSuffix.size(), statusSuffix) == 0)
+                {
+                    // Keep the status pages of the running boosters
+                    if (m_boosterStatus.find(slot.substr(0, slot.size() - statusSuffix.size())) == m_boosterStatus.end())
+                        unlink(path.c_str());
+                }
             }
         }
+
+        globfree(&globResult);
+    }
+
+    const string path = m_socketManager->socketRootPath() + ENV_SIGNATURE_VARS_FILE;
+
+    if (m_envSignatureVars.empty())
+    {
+        unlink(path.c_str());
+        return;
+    }
+
+    std::ofstream file(path.c_str());
+    for (vector<string>::const_iterator it = m_envSignatureVars.begin(); it != m_envSignatureVars.end(); it++)
+        file << *it << std::endl;
+
+    if (!file)
+        Logger::logWarning("Daemon: Couldn't write '%s'", path.c_str());
+}
+
+void Daemon::logEnvSignatureStats() const
+{
+    const unsigned int launches = m_signatureHits + m_signatureMisses;
+
+    Logger::logInfo("Daemon: environment signature hits %u/%u (%u%%), %u signature boosters",
+                    m_signatureHits, launches,
+                    launches ? 100 * m_signatureHits / launches : 0,
+                    static_cast<unsigned int>(m_signatureBoosters.size()));
+}
+
+int64_t Daemon::monotonicMs()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<int64_t>(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+void Daemon::watchLoadedFiles()
+{
+    m_inotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_inotifyFd == -1)
+    {
+        Logger::logWarning("Daemon: inotify_init1() failed, not recycling stale boosters");
+        return;
+    }
+
+    // Booster binaries and plugins are mapped by the launcher itself.
+    // Directories of libraries preloaded by the boosters are added
+    // when the boosters are checked.
+    checkMappings(0);
+
+    // Boosters may not have preloaded yet, watch the listed libraries
+    for (int variant = 0; variant < 2; variant++)
+    {
+        for (vector<string>::const_iterator it = m_preloadLists[variant].begin(); it != m_preloadLists[variant].end(); it++)
+        {
+            if ((*it)[0] == '/')
+                watchDirOf(*it);
+        }
+    }
+
+    for (BoosterPidMap::const_iterator it = m_boosterPids.begin(); it != m_boosterPids.end(); it++)
+    {
+        if (it->second)
+            checkMappings(it->second);
+    }
+}
+
+void Daemon::watchDirOf(const string & file)
+{
+    string dir = file.substr(0, file.rfind('/'));
+    if (dir.empty())
+        dir = "/";
+
+    if (m_watchedDirs.insert(dir).second &&
+        inotify_add_watch(m_inotifyFd, dir.c_str(),
+                          IN_CREATE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM | IN_CLOSE_WRITE) == -1)
+    {
+        Logger::logDebug("Daemon: couldn't watch %s", dir.c_str());
+    }
+}
+
+bool Daemon::checkMappings(pid_t pid)
+{
+    std::stringstream path;
+    if (pid)
+        path << "/proc/" << pid << "/maps";
+    else
+        path << "/proc/self/maps";
+
+    std::ifstream maps(path.str().c_str());
+
+    const string deletedSuffix(" (deleted)");
+    bool stale = false;
+    string previousFile;
+    string line;
+
+    while (std::getline(maps, line))
+    {
+        // address perms offset dev inode pathname
+        std::istringstream fields(line);
+        string address, perms, offset, device, file;
+        unsigned long inode = 0;
+        fields >> address >> perms >> offset >> device >> inode;
+        std::getline(fields >> std::ws, file);
+
+        unsigned int major = 0, minor = 0;
+        sscanf(device.c_str(), "%x:%x", &major, &minor);
+
+        // Only code matters, data files may be deleted on purpose
+        if (inode == 0 || perms.find('x') == string::npos ||
+            file.empty() || file[0] != '/' || file == previousFile)
+            continue;
+
+        previousFile = file;
+
+        bool deleted = false;
+        if (file.size() > deletedSuffix.size() &&
+            file.compare(file.size() - deletedSuffix.size(), deletedSuffix.size(), deletedSuffix) == 0)
+        {
+            file.erase(file.size() - deletedSuffix.size());
+            deleted = true;
+        }
+
+        // The inode alone may be reused by a file on another file system
+        struct stat st;
+        if (deleted || (stat(file.c_str(), &st) == 0 &&
+                        (st.st_ino != inode || st.st_dev != makedev(major, minor))))
+        {
+            Logger::logDebug("Daemon: pid %d maps replaced file %s", pid ? pid : getpid(), file.c_str());
+            stale = true;
+        }
+
+        watchDirOf(file);
+    }
+
+    return stale;
+}
+
+void Daemon::readInotifyEvents()
+{
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    while (read(m_inotifyFd, buf, sizeof(buf)) > 0)
+        ;
+
+    // Package upgrades replace many files, check after they are done
+    m_staleCheckTime = monotonicMs() + m_staleDebounceMs;
+}
+
+void Daemon::loadAppProfiles()
+{
+    // Boosters map the index next to their sockets
+    m_appProfiles = new AppProfiles(m_socketManager->socketRootPath() + "profiles.index");
+
+    m_profileWatchFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (m_profileWatchFd == -1 ||
+        inotify_add_watch(m_profileWatchFd, m_profileDir.c_str(),
+                          IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_TO | IN_MOVED_FROM) == -1)
+    {
+        Logger::logWarning("Daemon: Couldn't watch '%s', profiles are not reloaded", m_profileDir.c_str());
+        if (m_profileWatchFd != -1)
+            close(m_profileWatchFd);
+        m_profileWatchFd = -1;
+    }
+
+    Logger::logInfo("Daemon: %u launch profiles loaded from '%s'",
+                    m_appProfiles->compile(m_profileDir), m_profileDir.c_str());
+}
+
+void Daemon::readProfileEvents()
+{
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    while (read(m_profileWatchFd, buf, sizeof(buf)) > 0)
+        ;
+
+    // Waiting boosters see the new profiles without restarting
+    Logger::logInfo("Daemon: %u launch profiles reloaded from '%s'",
+                    m_appProfiles->compile(m_profileDir), m_profileDir.c_str());
+}
+
+int64_t Daemon::staleTimerDeadline() const
+{
+    if (m_staleCheckTime && m_recycleTime)
+        return std::min(m_staleCheckTime, m_recycleTime);
+
+    return m_staleCheckTime ? m_staleCheckTime : m_recycleTime;
+}
+
+void Daemon::runStaleTimers()
+{
+    const int64_t now = monotonicMs();
+
+    if (m_staleCheckTime && now >= m_staleCheckTime)
+    {
+        m_staleCheckTime = 0;
+        checkStaleBoosters();
+    }
+
+    if (m_recycleTime && now >= m_recycleTime)
+    {
+        m_recycleTime = 0;
+        recycleStaleBooster();
+    }
+}
+
+void Daemon::checkStaleBoosters()
+{
+    // Boosters inherit the mappings of the launcher, so restarting
+    // them doesn't help if the launcher itself is stale
+    if (checkMappings(0))
+    {
+        Logger::logInfo("Daemon: launcher maps replaced files, re-executing");
+        reExec();
+
+        // Not reached if re-exec successful
+        return;
+    }
+
+    for (BoosterPidMap::const_iterator it = m_boosterPids.begin(); it != m_boosterPids.end(); it++)
+    {
+        if (it->second && checkMappings(it->second))
+        {
+            Logger::logInfo("Daemon: booster '%s' (pid=%d) is stale", it->first.c_str(), it->second);
+            m_staleBoosterPids.insert(it->second);
+        }
+    }
+
+    if (!m_staleBoosterPids.empty() && !m_recycleTime)
+        m_recycleTime = monotonicMs();
+}
+
+void Daemon::recycleStaleBooster()
+{
+    // Restart one booster at a time so that the others keep serving
+    // launches while the new one preloads
+    while (!m_staleBoosterPids.empty())
+    {
+        const pid_t pid = *m_staleBoosterPids.begin();
+        m_staleBoosterPids.erase(m_staleBoosterPids.begin());
+
+        // Skip boosters that launched an application meanwhile
+        const string type = boosterTypeOf(pid);
+        if (type.empty())
+            continue;
+
+        Logger::logInfo("Daemon: recycling stale booster '%s' (pid=%d)", type.c_str(), pid);
+        m_recycledBoosters++;
+
+        // reapZombies() starts a new booster
+        killProcess(pid, SIGTERM);
+        break;
+    }
+
+    if (!m_staleBoosterPids.empty())
+        m_recycleTime = monotonicMs() + m_staleRecycleIntervalMs;
+}
+
+void Daemon::logStaleBoosterStats() const
+{
+    Logger::logInfo("Daemon: %u launches served by stale boosters, %u boosters recycled",
+                    m_staleLaunches, m_recycledBoosters);
+}
+
+booster_status * Daemon::boosterStatus(const string & slot)
+{
+    BoosterStatusMap::iterator it = m_boosterStatus.find(slot);
+    if (it != m_boosterStatus.end())
+        return it->second;
+
+    // An existing page is reused after re-exec, the waiting boosters
+    // still map it
+    const string path = m_socketManager->socketRootPath() + slot + BOOSTER_STATUS_SUFFIX;
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd == -1 || ftruncate(fd, sizeof(booster_status)) == -1)
+    {
+        Logger::logWarning("Daemon: Couldn't create '%s': %s", path.c_str(), strerror(errno));
+        if (fd != -1)
+            close(fd);
+        return NULL;
+    }
+
+    void * page = mmap(NULL, sizeof(booster_status), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (page == MAP_FAILED)
+    {
+        Logger::logWarning("Daemon: Couldn't map '%s': %s", path.c_str(), strerror(errno));
+        return NULL;
+    }
+
+    booster_status * status = static_cast<booster_status *>(page);
+    status->version = BOOSTER_STATUS_VERSION;
+
+    m_boosterStatus[slot] = status;
+    return status;
+}
+
+void Daemon::removeBoosterStatus(const string & slot)
+{
+    BoosterStatusMap::iterator it = m_boosterStatus.find(slot);
+    if (it == m_boosterStatus.end())
+        return;
+
+    if (it->second->fallbacks)
+        Logger::logInfo("Daemon: %u invokers did not wait for booster '%s'",
+                        it->second->fallbacks, slot.c_str());
+
+    munmap(it->second, sizeof(booster_status));
+    m_boosterStatus.erase(it);
+
+    unlink((m_socketManager->socketRootPath() + slot + BOOSTER_STATUS_SUFFIX).c_str());
+}
+
+void Daemon::logFallbackStats() const
+{
+    static const char * const classNames[BOOSTER_CLASS_COUNT] = { "interactive", "background" };
+
+    for (BoosterStatusMap::const_iterator it = m_boosterStatus.begin(); it != m_boosterStatus.end(); it++)
+    {
+        Logger::logInfo("Daemon: %u invokers did not wait for booster '%s', last initialization took %u ms",
+                        it->second->fallbacks, it->first.c_str(), it->second->preload_ms);
+
+        for (int launchClass = 0; launchClass < BOOSTER_CLASS_COUNT; launchClass++)
+        {
+            const booster_class_stats & stats = it->second->classes[launchClass];
+            if (!stats.launches && !stats.fallbacks)
+                continue;
+
+            Logger::logInfo("Daemon: booster '%s' took %u %s launches in %.1f ms on average, "
+                            "%u ms at most, %u were executed directly",
+                            it->first.c_str(), stats.launches, classNames[launchClass],
+                            stats.launches ? stats.latency_us / 1000.0 / stats.launches : 0.0,
+                            stats.max_latency_ms, stats.fallbacks);
+        }
+    }
+
+    if (m_deferredBackgroundLaunches)
+        Logger::logInfo("Daemon: %u background launches waited for interactive launches, "
+                        "%u of them were executed directly",
+                        m_deferredBackgroundLaunches, m_expiredBackgroundLaunches);
+}
+
+void Daemon::initControlSocket()
+{
+    const string path = m_socketManager->socketRootPath() + LAUNCHER_CONTROL_SOCKET;
+
+    struct sockaddr_un sun;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(sun.sun_path))
+    {
+        Logger::logWarning("Daemon: control socket path '%s' is too long", path.c_str());
+        return;
+    }
+
+    strncpy(sun.sun_path, path.c_str(), sizeof(sun.sun_path) - 1);
+
+    // Not inherited over re-exec, the socket is created again
+    m_controlSocket = socket(PF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_controlSocket == -1)
+    {
+        Logger::logWarning("Daemon: Failed to open control socket: %s", strerror(errno));
+        return;
+    }
+
+    unlink(path.c_str());
+    if (bind(m_controlSocket, reinterpret_cast<struct sockaddr *>(&sun), sizeof(sun)) == -1 ||
+        listen(m_controlSocket, 10) == -1)
+    {
+        Logger::logWarning("Daemon: Failed to listen to '%s': %s", path.c_str(), strerror(errno));
+        close(m_controlSocket);
+        m_controlSocket = -1;
+        return;
+    }
+
+    chmod(path.c_str(), S_IRUSR | S_IWUSR | S_IXUSR);
+}
+
+void Daemon::acceptControlConnection()
+{
+    const int fd = accept4(m_controlSocket, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (fd == -1)
+    {
+        if (errno != EAGAIN && errno != EINTR)
+            Logger::logWarning("Daemon: Failed to accept control connection: %s", strerror(errno));
+        return;
+    }
+
+    // Only processes of the launcher's user are served
+    struct ucred cred;
+    socklen_t credLen = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credLen) == -1 || cred.uid != getuid())
+    {
+        Logger::logWarning("Daemon: Rejected control connection");
+        close(fd);
+        return;
+    }
+
+    m_controlClients.insert(fd);
+}
+
+void Daemon::closeControlClient(int fd)
+{
+    dropInstanceRequests(fd);
+    dropActivations(fd);
+    dropSharedLaunches(fd);
+    dropBackgroundLaunches(fd);
+    m_controlClients.erase(fd);
+    close(fd);
+}
+
+void Daemon::readControlRequest(int fd)
+{
+    static char buffer[LAUNCHER_CONTROL_MAX_MSG];
+    char control[CMSG_SPACE(IO_DESCRIPTOR_COUNT * sizeof(int))];
+
+    struct iovec iov;
+    iov.iov_base = buffer;
+    iov.iov_len  = sizeof(buffer);
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    const ssize_t received = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    if (received == -1 && (errno == EAGAIN || errno == EINTR))
+        return;
+
+    // Descriptors passed along the request
+    vector<int> fds;
+    for (cmsghdr * cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg))
+    {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS)
+        {
+            const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            for (size_t i = 0; i < count; i++)
+            {
+                int passed;
+                memcpy(&passed, CMSG_DATA(cmsg) + i * sizeof(int), sizeof(int));
+                fds.push_back(passed);
+            }
+        }
+    }
+
+    struct ucred cred;
+    socklen_t credLen = sizeof(cred);
+    launcher_control_header header;
+
+    if (received < static_cast<ssize_t>(sizeof(header)) ||
+        getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credLen) == -1)
+    {
+        // Closed by the peer or malformed
+        closeControlClient(fd);
+    }
+    else
+    {
+        memcpy(&header, buffer, sizeof(header));
+        const string payload(buffer + sizeof(header), received - sizeof(header));
+
+        switch (header.type)
+        {
+        case LAUNCHER_CONTROL_INSTANCE:
+            handleInstanceRequest(fd, cred.pid, payload);
+            break;
+
+        case LAUNCHER_CONTROL_ACTIVATE:
+            handleActivateRequest(fd, string(buffer, received), fds);
+            break;
+
+        case LAUNCHER_CONTROL_BATCH:
+            handleBatchRequest(fd, string(buffer, received), fds);
+            break;
+
+        case LAUNCHER_CONTROL_COALESCE:
+            handleCoalesceRequest(fd, cred.uid, cred.pid, string(buffer, received));
+            break;
+
+        case LAUNCHER_CONTROL_LAUNCHED:
+            handleLaunchedReport(fd, cred.pid, string(buffer, received));
+            break;
+
+        case LAUNCHER_CONTROL_ADMIT:
+            handleAdmitRequest(fd, string(buffer, received));
+            break;
+
+        default:
+            Logger::logWarning("Daemon: unknown control request %u", header.type);
+            closeControlClient(fd);
+            break;
+        }
+    }
+
+    for (vector<int>::const_iterator it = fds.begin(); it != fds.end(); it++)
+        close(*it);
+}
+
+void Daemon::handleInstanceRequest(int fd, pid_t peerPid, const string & name)
+{
+    InstanceRequest request;
+    request.fd      = fd;
+    request.peerPid = peerPid;
+    request.name    = name;
+
+    if (!answerInstanceRequest(request))
+    {
+        Logger::logDebug("Daemon: %d waits for single instance %s to start", peerPid, name.c_str());
+        m_instanceRequests.push_back(request);
+    }
+}
+
+bool Daemon::answerInstanceRequest(const InstanceRequest & request)
+{
+    launcher_instance_reply reply;
+    reply.header.type = LAUNCHER_CONTROL_INSTANCE;
+    reply.status      = LAUNCHER_INSTANCE_START;
+    reply.pid         = 0;
+
+    SingleInstanceMap::iterator it = m_singleInstanceApps.find(request.name);
+    if (it != m_singleInstanceApps.end())
+    {
+        const SingleInstanceApp & app = it->second;
+
+        // A reservation is kept while its invoker lives and the launch
+        // can still be on its way. Activating the instance before it
+        // runs would be lost.
+        if (!app.pid && kill(app.invokerPid, 0) == 0 &&
+            monotonicMs() - app.reservedAt < m_instanceReservationMs)
+            return false;
+
+        if (app.pid && kill(app.pid, 0) == 0)
+        {
+            // The invoker is answered as soon as the activation is queued,
+            // it is written to the session bus from the main loop. Without
+            // queueing the booster activates the instance after failing
+            // to take its lock, activating blocks on the session bus.
+            SingleInstancePluginEntry * pluginEntry = m_singleInstance->pluginEntry();
+            if (pluginEntry && pluginEntry->queueActivationFunc)
+            {
+                const bool activated = pluginEntry->queueActivationFunc(request.name.c_str());
+                if (!activated)
+                    Logger::logWarning("Daemon: Can't activate existing instance of %s", request.name.c_str());
+
+                reply.status = activated ? LAUNCHER_INSTANCE_ACTIVATED : LAUNCHER_INSTANCE_ACTIVATION_FAILED;
+            }
+            else if (pluginEntry)
+            {
+                reply.status = LAUNCHER_INSTANCE_CHECK_LOCK;
+            }
+            else
+            {
+                Logger::logWarning("Daemon: Can't activate existing instance of %s", request.name.c_str());
+                reply.status = LAUNCHER_INSTANCE_ACTIVATION_FAILED;
+            }
+
+            reply.pid = app.pid;
+            m_instanceActivations++;
+        }
+    }
+
+    if (reply.status == LAUNCHER_INSTANCE_START)
+    {
+        // Instances that can't be activated without blocking are found
+        // by their lock
+        SingleInstancePluginEntry * pluginEntry = m_singleInstance->pluginEntry();
+        if (pluginEntry && !pluginEntry->queueActivationFunc)
+            reply.status = LAUNCHER_INSTANCE_START_LOCK;
+
+        SingleInstanceApp & app = m_singleInstanceApps[request.name];
+        app.pid        = 0;
+        app.invokerPid = request.peerPid;
+        app.reservedAt = monotonicMs();
+
+        Logger::logDebug("Daemon: reserved single instance %s for %d", request.name.c_str(), request.peerPid);
+    }
+
+    if (send(request.fd, &reply, sizeof(reply), MSG_NOSIGNAL) == -1)
+        Logger::logWarning("Daemon: Failed to answer control request: %s", strerror(errno));
+
+    return true;
+}
+
+void Daemon::runInstanceRequests()
+{
+    // In arrival order, the first request of a failed launch gets the
+    // name reserved and the others keep waiting for its instance
+    InstanceRequestList::iterator it = m_instanceRequests.begin();
+    while (it != m_instanceRequests.end())
+    {
+        if (answerInstanceRequest(*it))
+            it = m_instanceRequests.erase(it);
+        else
+            it++;
+    }
+}
+
+void Daemon::dropInstanceRequests(int fd)
+{
+    InstanceRequestList::iterator it = m_instanceRequests.begin();
+    while (it != m_instanceRequests.end())
+    {
+        if (it->fd == fd)
+            it = m_instanceRequests.erase(it);
+        else
+            it++;
+    }
+}
+
+void Daemon::handleActivateRequest(int fd, const string & request, const vector<int> & fds)
+{
+    Activation activation;
+    activation.fd    = fd;
+    activation.batch = false;
+    activation.index = 0;
+    activation.io    = fds;
+
+    launcher_activate_request header;
+    size_t pos = sizeof(header);
+    vector<string> strings;
+    shared_ptr<vector<string> > env(new vector<string>);
+
+    if (request.size() < sizeof(header))
+    {
+        answerActivation(activation, -EINVAL, 0);
+        return;
+    }
+
+    memcpy(&header, request.data(), sizeof(header));
+    if (header.argc < 1 ||
+        !readStrings(request, pos, 3 + header.argc, strings) ||
+        !readStrings(request, pos, header.envc, *env) ||
+        pos != request.size())
+    {
+        answerActivation(activation, -EINVAL, 0);
+        return;
+    }
+
+    activation.id       = strings[0];
+    activation.type     = strings[1];
+    activation.exec     = strings[2];
+    activation.argv.assign(strings.begin() + 3, strings.end());
+    activation.env      = env;
+    activation.options  = header.options;
+    activation.priority = header.priority;
+
+    // Only a waiting booster takes the application, also of the
+    // signature boosters. The activator executes the application itself
+    // otherwise.
+    pid_t pid = 0;
+    const int32_t status = launchActivation(activation, pid);
+    answerActivation(activation, status, pid);
+}
+
+void Daemon::handleBatchRequest(int fd, const string & request, const vector<int> & fds)
+{
+    launcher_batch_request header;
+    size_t pos = sizeof(header);
+    shared_ptr<vector<string> > env(new vector<string>);
+    vector<Activation> batch;
+
+    bool valid = request.size() >= sizeof(header);
+    if (valid)
+    {
+        memcpy(&header, request.data(), sizeof(header));
+        valid = readStrings(request, pos, header.envc, *env);
+    }
+
+    for (uint32_t i = 0; valid && i < header.count; i++)
+    {
+        launcher_batch_app app;
+        vector<string> strings;
+        if (request.size() - pos < sizeof(app))
+        {
+            valid = false;
+            break;
+        }
+
+        memcpy(&app, request.data() + pos, sizeof(app));
+        pos += sizeof(app);
+
+        valid = app.argc >= 1 && readStrings(request, pos, 3 + app.argc, strings);
+        if (valid)
+        {
+            Activation activation;
+            activation.fd       = fd;
+            activation.batch    = true;
+            activation.index    = i;
+            activation.id       = strings[0];
+            activation.type     = strings[1];
+            activation.exec     = strings[2];
+            activation.argv.assign(strings.begin() + 3, strings.end());
+            activation.env      = env;
+            activation.options  = app.options;
+            activation.priority = header.priority;
+            activation.io       = fds;
+            batch.push_back(activation);
+        }
+    }
+
+    if (!valid || pos != request.size())
+    {
+        Logger::logWarning("Daemon: malformed batch request");
+        closeControlClient(fd);
+        return;
+    }
+
+    Logger::logDebug("Daemon: batch of %u applications", header.count);
+
+    // Launch what has a waiting booster now, the rest as the boosters
+    // become ready
+    for (vector<Activation>::iterator it = batch.begin(); it != batch.end(); it++)
+    {
+        pid_t pid = 0;
+        const int32_t status = launchActivation(*it, pid);
+        if (status == -EAGAIN)
+        {
+            it->queuedAt = monotonicMs();
+            for (vector<int>::iterator io = it->io.begin(); io != it->io.end(); io++)
+                *io = fcntl(*io, F_DUPFD_CLOEXEC, 3);
+
+            m_pendingActivations.push_back(*it);
+        }
+        else
+        {
+            answerActivation(*it, status, pid);
+        }
+    }
+}
+
+int32_t Daemon::launchActivation(const Activation & activation, pid_t & pid)
+{
+    ActivatedAppMap::iterator running = activation.id.empty() ?
+        m_activatedApps.end() : m_activatedApps.find(activation.id);
+    if (running != m_activatedApps.end() && kill(running->second, 0) == 0)
+    {
+        pid = running->second;
+        return LAUNCHER_ACTIVATE_RUNNING;
+    }
+
+    // An identical launch just before shares its application. Activations
+    // with an id and the applications of a batch are launched as asked.
+    const bool coalesce = m_coalesceWindowMs > 0 && !(activation.options & INVOKER_OPTION_NO_COALESCE);
+    const string key = launchKey(getuid(), activation.exec, activation.argv);
+    if (coalesce && !activation.batch && activation.id.empty())
+    {
+        expireSharedLaunches();
+        for (SharedLaunchList::const_iterator it = m_sharedLaunches.begin(); it != m_sharedLaunches.end(); it++)
+        {
+            if (it->key == key && it->pid && monotonicMs() - it->startedAt < m_coalesceWindowMs &&
+                kill(it->pid, 0) == 0)
+            {
+                Logger::logDebug("Daemon: activation of %s shares %d", activation.exec.c_str(), it->pid);
+                m_coalescedLaunches++;
+                pid = it->pid;
+                return LAUNCHER_ACTIVATE_RUNNING;
+            }
+        }
+    }
+
+    BoosterStatusMap::const_iterator status = m_boosterStatus.find(activation.type);
+    if (status != m_boosterStatus.end() && !status->second->ready)
+        return -EAGAIN;
+
+    // Interactive launches take the booster first
+    if ((activation.options & INVOKER_OPTION_BACKGROUND) && !boosterFreeForBackground(activation.type))
+        return -EAGAIN;
+
+    vector<char *> argv;
+    for (vector<string>::const_iterator it = activation.argv.begin(); it != activation.argv.end(); it++)
+        argv.push_back(const_cast<char *>(it->c_str()));
+    argv.push_back(NULL);
+
+    vector<char *> envp;
+    for (vector<string>::const_iterator it = activation.env->begin(); it != activation.env->end(); it++)
+        envp.push_back(const_cast<char *>(it->c_str()));
+    envp.push_back(NULL);
+
+    struct invoker_params params;
+    invoker_params_init(&params);
+    params.type     = activation.type.c_str();
+    params.exec     = activation.exec.c_str();
+    params.argc     = activation.argv.size();
+    params.argv     = &argv[0];
+    params.envp     = &envp[0];
+    // The launcher doesn't ask itself to share the launch
+    params.options  = (activation.options & ~(INVOKER_OPTION_SINGLE_INSTANCE | INVOKER_OPTION_BACKGROUND)) |
+                      INVOKER_OPTION_TIMEOUT | INVOKER_OPTION_NO_COALESCE;
+    params.priority = activation.priority;
+    params.max_wait = m_activationTimeoutMs;
+
+    // The rest of a batch needs the next booster right away
+    if (activation.batch)
+        params.respawn_delay = 0;
+
+    for (size_t i = 0; i < activation.io.size() && i < IO_DESCRIPTOR_COUNT; i++)
+        params.io[i] = activation.io[i];
+
+    if (invoker_launch(&params, &pid) != 0)
+    {
+        const int error = errno;
+        if (error != EAGAIN)
+            Logger::logWarning("Daemon: Can't activate %s: %s", activation.exec.c_str(), strerror(error));
+
+        return -error;
+    }
+
+    m_activations++;
+
+    // The booster is taken, don't wait for it to tell that
+    BoosterPidMap::const_iterator booster = m_boosterPids.find(activation.type);
+    if (booster != m_boosterPids.end() && booster->second == pid && status != m_boosterStatus.end())
+        status->second->ready = 0;
+
+    if (!activation.id.empty())
+        m_activatedApps[activation.id] = pid;
+
+    // Identical launches within the window share the application
+    if (coalesce)
+    {
+        SharedLaunch launch;
+        launch.key        = key;
+        launch.exec       = activation.exec;
+        launch.fd         = -1;
+        launch.invokerPid = getpid();
+        launch.pid        = pid;
+        launch.startedAt  = monotonicMs();
+        launch.failed     = false;
+        m_sharedLaunches.push_back(launch);
+    }
+
+    Logger::logInfo("Daemon: activated %s as %d",
+                    activation.id.empty() ? activation.exec.c_str() : activation.id.c_str(), pid);
+
+    return LAUNCHER_ACTIVATE_LAUNCHED;
+}
+
+void Daemon::answerActivation(const Activation & activation, int32_t status, pid_t pid)
+{
+    ssize_t sent;
+    if (activation.batch)
+    {
+        launcher_batch_reply reply;
+        reply.header.type = LAUNCHER_CONTROL_BATCH;
+        reply.index       = activation.index;
+        reply.status      = status;
+        reply.pid         = pid;
+        sent = send(activation.fd, &reply, sizeof(reply), MSG_NOSIGNAL);
+    }
+    else
+    {
+        launcher_activate_reply reply;
+        reply.header.type = LAUNCHER_CONTROL_ACTIVATE;
+        reply.status      = status;
+        reply.pid         = pid;
+        sent = send(activation.fd, &reply, sizeof(reply), MSG_NOSIGNAL);
+    }
+
+    if (sent == -1)
+        Logger::logWarning("Daemon: Failed to answer control request: %s", strerror(errno));
+}
+
+void Daemon::runPendingActivations()
+{
+    const int64_t now = monotonicMs();
+
+    // Interactive activations take the boosters first
+    for (int pass = 0; pass < 2; pass++)
+    {
+        const bool backgroundPass = pass == 1;
+
+        ActivationList::iterator it = m_pendingActivations.begin();
+        while (it != m_pendingActivations.end())
+        {
+            const bool background = it->options & INVOKER_OPTION_BACKGROUND;
+            if (background != backgroundPass)
+            {
+                it++;
+                continue;
+            }
+
+            pid_t pid = 0;
+            int32_t status = launchActivation(*it, pid);
+            if (status == -EAGAIN && now - it->queuedAt < LAUNCHER_BATCH_MAX_WAIT_MS)
+            {
+                it++;
+                continue;
+            }
+
+            answerActivation(*it, status, pid);
+            closeActivation(*it);
+            it = m_pendingActivations.erase(it);
+        }
+    }
+}
+
+void Daemon::dropActivations(int fd)
+{
+    ActivationList::iterator it = m_pendingActivations.begin();
+    while (it != m_pendingActivations.end())
+    {
+        if (it->fd == fd)
+        {
+            closeActivation(*it);
+            it = m_pendingActivations.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+}
+
+void Daemon::closeActivation(const Activation & activation)
+{
+    for (vector<int>::const_iterator it = activation.io.begin(); it != activation.io.end(); it++)
+    {
+        if (*it != -1)
+            close(*it);
+    }
+}
+
+void Daemon::activatedAppExited(pid_t pid)
+{
+    for (ActivatedAppMap::iterator it = m_activatedApps.begin(); it != m_activatedApps.end(); it++)
+    {
+        if (it->second == pid)
+        {
+            m_activatedApps.erase(it);
+            return;
+        }
+    }
+}
+
+int Daemon::activationFd(bool * wantWrite) const
+{
+    SingleInstancePluginEntry * pluginEntry = m_singleInstance->pluginEntry();
+    if (!pluginEntry || !pluginEntry->activationFdFunc)
+        return -1;
+
+    return pluginEntry->activationFdFunc(wantWrite);
+}
+
+void Daemon::instanceLaunched(pid_t invokerPid, pid_t appPid)
+{
+    for (SingleInstanceMap::iterator it = m_singleInstanceApps.begin(); it != m_singleInstanceApps.end(); it++)
+    {
+        if (!it->second.pid && it->second.invokerPid == invokerPid)
+        {
+            Logger::logDebug("Daemon: single instance %s is %d", it->first.c_str(), appPid);
+            it->second.pid = appPid;
+
+            // Activate the instance for the invokers waiting for it
+            runInstanceRequests();
+            return;
+        }
+    }
+}
+
+void Daemon::instanceExited(pid_t pid)
+{
+    for (SingleInstanceMap::iterator it = m_singleInstanceApps.begin(); it != m_singleInstanceApps.end(); it++)
+    {
+        if (it->second.pid == pid)
+        {
+            m_singleInstanceApps.erase(it);
+            runInstanceRequests();
+            return;
+        }
+    }
+}
+
+string Daemon::launchKey(uid_t uid, const string & exec, const vector<string> & argv)
+{
+    string key(reinterpret_cast<const char *>(&uid), sizeof(uid));
+    key += exec;
+    key += '\0';
+    for (vector<string>::const_iterator it = argv.begin(); it != argv.end(); it++)
+    {
+        key += *it;
+        key += '\0';
+    }
+
+    return key;
+}
+
+// Send an invoker protocol message and its value as two packets
+static void sendInvokerMsg(int fd, uint32_t msg, uint32_t value)
+{
+    if (send(fd, &msg, sizeof(msg), MSG_NOSIGNAL) == -1 ||
+        send(fd, &value, sizeof(value), MSG_NOSIGNAL) == -1)
+        Logger::logDebug("Daemon: Failed to answer coalesced launch: %s", strerror(errno));
+}
+
+void Daemon::handleCoalesceRequest(int fd, uid_t uid, pid_t peerPid, const string & request)
+{
+    launcher_coalesce_request header;
+    size_t pos = sizeof(header);
+    vector<string> strings;
+
+    if (request.size() < sizeof(header))
+        header.argc = 0;
+    else
+        memcpy(&header, request.data(), sizeof(header));
+
+    if (header.argc < 1 || !readStrings(request, pos, 1 + header.argc, strings))
+    {
+        Logger::logWarning("Daemon: malformed coalesce request");
+        closeControlClient(fd);
+        return;
+    }
+
+    const string exec = strings[0];
+    strings.erase(strings.begin());
+    const string key = launchKey(uid, exec, strings);
+    const int64_t now = monotonicMs();
+
+    expireSharedLaunches();
+
+    // Launches are shared while the application starts or runs, within
+    // the window from the first launch
+    SharedLaunchList::iterator it = m_sharedLaunches.begin();
+    while (m_coalesceWindowMs > 0 && it != m_sharedLaunches.end() &&
+           !(it->key == key && now - it->startedAt < m_coalesceWindowMs &&
+             (!it->pid || kill(it->pid, 0) == 0)))
+        it++;
+
+    launcher_coalesce_reply reply;
+    reply.header.type = LAUNCHER_CONTROL_COALESCE;
+    reply.status      = LAUNCHER_COALESCE_LAUNCH;
+
+    if (m_coalesceWindowMs > 0 && it != m_sharedLaunches.end())
+    {
+        reply.status = LAUNCHER_COALESCE_JOINED;
+        it->waiters.push_back(fd);
+        m_coalescedLaunches++;
+
+        Logger::logInfo("Daemon: launch of %s by %d coalesced with the launch by %d",
+                        exec.c_str(), peerPid, it->invokerPid);
+    }
+    else if (m_coalesceWindowMs > 0)
+    {
+        SharedLaunch launch;
+        launch.key        = key;
+        launch.exec       = exec;
+        launch.fd         = fd;
+        launch.invokerPid = peerPid;
+        launch.pid        = 0;
+        launch.startedAt  = now;
+        launch.failed     = false;
+        m_sharedLaunches.push_back(launch);
+    }
+
+    if (send(fd, &reply, sizeof(reply), MSG_NOSIGNAL) == -1)
+        Logger::logWarning("Daemon: Failed to answer control request: %s", strerror(errno));
+    else if (reply.status == LAUNCHER_COALESCE_JOINED && it->pid)
+        sendInvokerMsg(fd, INVOKER_MSG_PID, it->pid);
+}
+
+void Daemon::handleLaunchedReport(int fd, pid_t peerPid, const string & request)
+{
+    launcher_launched_report report;
+    if (request.size() < sizeof(report))
+        return;
+
+    memcpy(&report, request.data(), sizeof(report));
+
+    for (SharedLaunchList::iterator it = m_sharedLaunches.begin(); it != m_sharedLaunches.end(); it++)
+    {
+        if (it->fd != fd)
+            continue;
+
+        it->fd = -1;
+
+        // The processes sharing a failed launch launch by themselves
+        if (report.status < 0)
+        {
+            Logger::logDebug("Daemon: shared launch of %s failed: %s",
+                             it->exec.c_str(), strerror(-report.status));
+            it->failed = true;
+            expireSharedLaunches();
+        }
+
+        return;
+    }
+
+    // A process executing a single instance reserved for it becomes
+    // the instance
+    for (SingleInstanceMap::iterator it = m_singleInstanceApps.begin(); it != m_singleInstanceApps.end(); it++)
+    {
+        if (it->second.pid || it->second.invokerPid != peerPid)
+            continue;
+
+        if (report.status < 0)
+        {
+            Logger::logDebug("Daemon: launch of single instance %s failed", it->first.c_str());
+            m_singleInstanceApps.erase(it);
+            runInstanceRequests();
+        }
+        else
+        {
+            instanceLaunched(peerPid, peerPid);
+        }
+
+        return;
+    }
+}
+
+void Daemon::sharedLaunchStarted(pid_t invokerPid, pid_t appPid, const string & app, const string & key)
+{
+    if (m_coalesceWindowMs <= 0)
+        return;
+
+    // Identical launches until the window ends ask the launcher
+    const string slot = boosterTypeOf(appPid);
+    SignatureBoosterMap::const_iterator s = m_signatureBoosters.find(slot);
+    booster_status * status = slot.empty() ? NULL :
+        boosterStatus(s != m_signatureBoosters.end() ? s->second.type : slot);
+    if (status)
+        status->coalesce_until_ms = monotonicMs() + m_coalesceWindowMs;
+
+    for (SharedLaunchList::iterator it = m_sharedLaunches.begin(); it != m_sharedLaunches.end(); it++)
+    {
+        if (!it->pid && it->invokerPid == invokerPid &&
+            it->exec.compare(0, BOOSTER_MSG_LAUNCH_MAX_APP, app) == 0)
+        {
+            it->pid = appPid;
+            for (vector<int>::const_iterator waiter = it->waiters.begin(); waiter != it->waiters.end(); waiter++)
+                sendInvokerMsg(*waiter, INVOKER_MSG_PID, appPid);
+            return;
+        }
+
+        // Activations share their launches themselves
+        if (it->pid == appPid)
+            return;
+    }
+
+    // The first of identical launches doesn't ask the launcher, the
+    // launches after it share it
+    if (key.empty() || invokerPid == getpid())
+        return;
+
+    SharedLaunch launch;
+    launch.key        = key;
+    launch.exec       = app;
+    launch.fd         = -1;
+    launch.invokerPid = invokerPid;
+    launch.pid        = appPid;
+    launch.startedAt  = monotonicMs();
+    launch.failed     = false;
+    m_sharedLaunches.push_back(launch);
+}
+
+void Daemon::sharedLaunchExited(pid_t pid, int status)
+{
+    for (SharedLaunchList::iterator it = m_sharedLaunches.begin(); it != m_sharedLaunches.end(); it++)
+    {
+        if (it->pid != pid)
+            continue;
+
+        // The waiters get the wait status like waiting invokers of
+        // libinvoker do
+        const vector<int> waiters = it->waiters;
+        m_sharedLaunches.erase(it);
+
+        for (vector<int>::const_iterator waiter = waiters.begin(); waiter != waiters.end(); waiter++)
+        {
+            sendInvokerMsg(*waiter, INVOKER_MSG_EXIT, status);
+            closeControlClient(*waiter);
+        }
+
+        return;
+    }
+}
+
+void Daemon::expireSharedLaunches()
+{
+    const int64_t now = monotonicMs();
+
+    // Closed after the list is updated, closing drops them from it
+    vector<int> closed;
+
+    SharedLaunchList::iterator it = m_sharedLaunches.begin();
+    while (it != m_sharedLaunches.end())
+    {
+        // A launch not launched in time failed, the processes sharing it
+        // see the connection closed and launch by themselves
+        if (it->failed || (!it->pid && now - it->startedAt >= m_sharedLaunchTimeoutMs))
+        {
+            closed.insert(closed.end(), it->waiters.begin(), it->waiters.end());
+            it = m_sharedLaunches.erase(it);
+        }
+        else if (it->pid && it->waiters.empty() && now - it->startedAt >= m_coalesceWindowMs)
+        {
+            it = m_sharedLaunches.erase(it);
+        }
+        else
+        {
+            it++;
+        }
+    }
+
+    for (vector<int>::const_iterator fd = closed.begin(); fd != closed.end(); fd++)
+        closeControlClient(*fd);
+}
+
+void Daemon::dropSharedLaunches(int fd)
+{
+    SharedLaunchList::iterator it = m_sharedLaunches.begin();
+    while (it != m_sharedLaunches.end())
+    {
+        // Closed without reporting the result, the launch failed
+        if (it->fd == fd)
+        {
+            it->fd = -1;
+            it->failed = !it->pid;
+        }
+
+        it->waiters.erase(std::remove(it->waiters.begin(), it->waiters.end(), fd), it->waiters.end());
+        it++;
+    }
+
+    expireSharedLaunches();
+}
+
+int64_t Daemon::sharedLaunchDeadline() const
+{
+    int64_t deadline = 0;
+    for (SharedLaunchList::const_iterator it = m_sharedLaunches.begin(); it != m_sharedLaunches.end(); it++)
+    {
+        const int64_t expiry = it->startedAt + m_sharedLaunchTimeoutMs;
+        if (!it->pid && (!deadline || expiry < deadline))
+            deadline = expiry;
+    }
+
+    return deadline;
+}
+
+void Daemon::startLaunchBoost(const LaunchReport & report)
+{
+    LaunchBoost & boost = m_launchBoosts[report.pid];
+    boost.until         = monotonicMs() + m_launchBoostMs;
+    boost.boost         = report.boost;
+    boost.boostNice     = report.boostNice;
+    boost.nice          = report.nice;
+    boost.uclampMin     = report.uclampMin;
+    boost.autogroupNice = report.autogroupNice;
+
+    // Boosters respawned while the application is boosted preload at
+    // the lowest priority. The one respawned for this launch was forked
+    // before the report, it's lowered here if it's preloading at nice 10.
+    m_launchBoostUntil = std::max(m_launchBoostUntil, boost.until);
+    for (BoosterPidMap::const_iterator it = m_boosterPids.begin(); it != m_boosterPids.end(); it++)
+    {
+        BoosterStatusMap::const_iterator status = m_boosterStatus.find(it->first);
+        if (!it->second || status == m_boosterStatus.end() || status->second->ready)
+            continue;
+
+        errno = 0;
+        if (getpriority(PRIO_PROCESS, it->second) == 10 && !errno)
+            setpriority(PRIO_PROCESS, it->second, 19);
+    }
+
+    m_boostedLaunches++;
+}
+
+void Daemon::endLaunchBoosts()
+{
+    const int64_t now = monotonicMs();
+
+    LaunchBoostMap::iterator it = m_launchBoosts.begin();
+    while (it != m_launchBoosts.end())
+    {
+        if (now < it->second.until)
+        {
+            it++;
+            continue;
+        }
+
+        const pid_t pid = it->first;
+        const LaunchBoost & boost = it->second;
+
+        // Threads started during the boost inherited it. Threads whose
+        // priority the application changed itself are left alone.
+        std::stringstream taskDir;
+        taskDir << "/proc/" << pid << "/task";
+        DIR * tasks = opendir(taskDir.str().c_str());
+        struct dirent * task;
+        while (tasks && (task = readdir(tasks)))
+        {
+            const pid_t tid = atoi(task->d_name);
+            if (tid <= 0)
+                continue;
+
+            errno = 0;
+            const int nice = getpriority(PRIO_PROCESS, tid);
+            if (errno || ((boost.boost & LAUNCH_BOOST_NICE) && nice != boost.boostNice))
+                continue;
+
+            if ((boost.boost & LAUNCH_BOOST_NICE) && setpriority(PRIO_PROCESS, tid, boost.nice) == -1)
+                Logger::logWarning("Daemon: couldn't end launch boost of %d: %s", tid, strerror(errno));
+
+            if ((boost.boost & LAUNCH_BOOST_UCLAMP) && util_clamp_set(tid, boost.uclampMin, -1) == -1)
+                Logger::logWarning("Daemon: couldn't end launch boost of %d: %s", tid, strerror(errno));
+        }
+
+        if (tasks)
+            closedir(tasks);
+
+        if ((boost.boost & LAUNCH_BOOST_AUTOGROUP) && autogroup_set_nice(pid, boost.autogroupNice) == -1)
+            Logger::logWarning("Daemon: couldn't end launch boost of %d: %s", pid, strerror(errno));
+
+        Logger::logDebug("Daemon: launch boost of %d ended", pid);
+        m_launchBoosts.erase(it++);
+    }
+}
+
+int64_t Daemon::launchBoostDeadline() const
+{
+    int64_t deadline = 0;
+    for (LaunchBoostMap::const_iterator it = m_launchBoosts.begin(); it != m_launchBoosts.end(); it++)
+    {
+        if (!deadline || it->second.until < deadline)
+            deadline = it->second.until;
+    }
+
+    return deadline;
+}
+
+void Daemon::handleAdmitRequest(int fd, const string & request)
+{
+    launcher_admit_request header;
+    if (request.size() <= sizeof(header))
+    {
+        Logger::logWarning("Daemon: malformed admit request");
+        closeControlClient(fd);
+        return;
+    }
+
+    memcpy(&header, request.data(), sizeof(header));
+
+    BackgroundLaunch launch;
+    launch.fd        = fd;
+    launch.slot      = request.substr(sizeof(header));
+    launch.queuedAt  = monotonicMs();
+    launch.maxWaitMs = header.max_wait_ms;
+    m_backgroundLaunches.push_back(launch);
+
+    runBackgroundLaunches();
+
+    if (!m_backgroundLaunches.empty() && m_backgroundLaunches.back().fd == fd)
+    {
+        Logger::logDebug("Daemon: background launch waits for booster '%s'", launch.slot.c_str());
+        m_deferredBackgroundLaunches++;
+    }
+}
+
+bool Daemon::boosterFreeForBackground(const string & slot)
+{
+    // Unknown readiness, let the invoker find out
+    BoosterStatusMap::const_iterator status = m_boosterStatus.find(slot);
+    if (status == m_boosterStatus.end())
+        return true;
+
+    const int64_t now = monotonicMs();
+    BackgroundSlot & state = m_backgroundSlots[slot];
+
+    if (!status->second->ready)
+    {
+        state.busySince = 0;
+        return false;
+    }
+
+    if (status->second->interactive)
+    {
+        // A ready booster accepts connecting invokers right away, the
+        // count is left over from invokers that died if it stays
+        if (!state.busySince)
+            state.busySince = now;
+        if (now - state.busySince < m_interactiveStaleMs)
+            return false;
+
+        Logger::logWarning("Daemon: %u interactive launches of booster '%s' never connected",
+                           status->second->interactive, slot.c_str());
+        status->second->interactive = 0;
+    }
+
+    state.busySince = 0;
+
+    for (ActivationList::const_iterator it = m_pendingActivations.begin(); it != m_pendingActivations.end(); it++)
+    {
+        if (it->type == slot && !(it->options & INVOKER_OPTION_BACKGROUND))
+            return false;
+    }
+
+    // The booster was given to a background launch that hasn't connected yet
+    BoosterPidMap::const_iterator booster = m_boosterPids.find(slot);
+    const pid_t pid = booster != m_boosterPids.end() ? booster->second : 0;
+    return state.admittedBooster != pid || now - state.admittedAt >= m_admissionHoldMs;
+}
+
+void Daemon::runBackgroundLaunches()
+{
+    const int64_t now = monotonicMs();
+
+    BackgroundLaunchList::iterator it = m_backgroundLaunches.begin();
+    while (it != m_backgroundLaunches.end())
+    {
+        launcher_admit_reply reply;
+        reply.header.type = LAUNCHER_CONTROL_ADMIT;
+
+        if (boosterFreeForBackground(it->slot))
+        {
+            BackgroundSlot & state = m_backgroundSlots[it->slot];
+            BoosterPidMap::const_iterator booster = m_boosterPids.find(it->slot);
+            state.admittedBooster = booster != m_boosterPids.end() ? booster->second : 0;
+            state.admittedAt      = now;
+
+            reply.status = LAUNCHER_ADMIT_GRANTED;
+        }
+        else if (it->maxWaitMs && now - it->queuedAt >= it->maxWaitMs)
+        {
+            reply.status = LAUNCHER_ADMIT_TIMEOUT;
+            m_expiredBackgroundLaunches++;
+        }
+        else if (!it->maxWaitMs && now - it->queuedAt >= LAUNCHER_ADMIT_MAX_WAIT_MS)
+        {
+            // The launch waits for the booster in the socket
+            reply.status = LAUNCHER_ADMIT_GRANTED;
+        }
+        else
+        {
+            it++;
+            continue;
+        }
+
+        if (send(it->fd, &reply, sizeof(reply), MSG_NOSIGNAL) == -1)
+            Logger::logWarning("Daemon: Failed to answer control request: %s", strerror(errno));
+
+        it = m_backgroundLaunches.erase(it);
+    }
+}
+
+int64_t Daemon::waitingLaunchDeadline() const
+{
+    int64_t deadline = 0;
+    set<string> slots;
+
+    for (ActivationList::const_iterator it = m_pendingActivations.begin(); it != m_pendingActivations.end(); it++)
+    {
+        const int64_t expiry = it->queuedAt + LAUNCHER_BATCH_MAX_WAIT_MS;
+        if (!deadline || expiry < deadline)
+            deadline = expiry;
+        if (it->options & INVOKER_OPTION_BACKGROUND)
+            slots.insert(it->type);
+    }
+
+    for (BackgroundLaunchList::const_iterator it = m_backgroundLaunches.begin(); it != m_backgroundLaunches.end(); it++)
+    {
+        const int64_t expiry = it->queuedAt + (it->maxWaitMs ? it->maxWaitMs : LAUNCHER_ADMIT_MAX_WAIT_MS);
+        if (!deadline || expiry < deadline)
+            deadline = expiry;
+        slots.insert(it->slot);
+    }
+
+    // A ready booster is kept from background launches for a while if
+    // interactive launches are connecting or it was just admitted
+    const int64_t now = monotonicMs();
+    for (set<string>::const_iterator it = slots.begin(); it != slots.end(); it++)
+    {
+        BackgroundSlotMap::const_iterator state = m_backgroundSlots.find(*it);
+        if (state == m_backgroundSlots.end())
+            continue;
+
+        const int64_t times[2] = {
+            state->second.busySince ? state->second.busySince + m_interactiveStaleMs : 0,
+            state->second.admittedAt ? state->second.admittedAt + m_admissionHoldMs : 0
+        };
+
+        for (int i = 0; i < 2; i++)
+        {
+            if (times[i] > now && (!deadline || times[i] < deadline))
+                deadline = times[i];
+        }
+    }
+
+    return deadline;
+}
+
+void Daemon::dropBackgroundLaunches(int fd)
+{
+    BackgroundLaunchList::iterator it = m_backgroundLaunches.begin();
+    while (it != m_backgroundLaunches.end())
+    {
+        if (it->fd == fd)
+            it = m_backgroundLaunches.erase(it);
+        else
+            it++;
+    }
+}
+
+void Daemon::addBooster(Booster * booster)
+{
+    const string & type = booster->boosterType();
+
+    if (m_boosters.find(type) != m_boosters.end())
+    {
+        Logger::logWarning("Daemon: Booster type '%s' already loaded", type.c_str());
+        delete booster;
+        return;
+    }
+
+    Logger::logDebug("Daemon: hosting booster type '%s'", type.c_str());
+    m_boosters[type] = booster;
+}
+
+void Daemon::loadBoosterPlugins(const string & dir)
+{
+    const string pattern = dir + "/*.so";
+
+    glob_t globResult;
+    if (glob(pattern.c_str(), 0, NULL, &globResult) == 0)
+    {
+        for (size_t i = 0; i < globResult.gl_pathc; i++)
+        {
+            const char * path = globResult.gl_pathv[i];
+
+            void * handle = dlopen(path, RTLD_NOW | RTLD_GLOBAL);
+            if (!handle)
+            {
+                Logger::logWarning("Daemon: dlopening booster plugin '%s' failed: %s", path, dlerror());
+                continue;
+            }
+
+            create_booster_func_t createBooster =
+                (create_booster_func_t)dlsym(handle, "createBooster");
+
+            if (!createBooster)
+            {
+                Logger::logWarning("Daemon: Invalid booster plugin: '%s'", path);
+                dlclose(handle);
+                continue;
+            }
+
+            addBooster(createBooster());
+        }
+    }
+    else
+    {
+        Logger::logWarning("Daemon: No booster plugins found in '%s'", dir.c_str());
+    }
+
+    globfree(&globResult);
+}
+
+void Daemon::preloadSharedLibraries()
+{
+    if (m_sharedPreloadFile.empty() || m_sharedLibrariesLoaded)
+        return;
+
+    m_sharedLibrariesLoaded = true;
+
+    m_sharedPreloadList = readPreloadList(m_sharedPreloadFile);
+
+    const vector<string> & libraries = m_sharedPreloadList;
+    for (vector<string>::const_iterator it = libraries.begin(); it != libraries.end(); it++)
+    {
+        // The daemon forks all boosters, so it must stay fork safe as well
+        if (m_strictPreload && !ForkSafetyAuditor::probeLibrary(*it, RTLD_NOW | RTLD_GLOBAL))
+        {
+            Logger::logWarning("Daemon: refused to preload fork-unsafe shared library '%s'", it->c_str());
+            continue;
+        }
+
+        if (!dlopen(it->c_str(), RTLD_NOW | RTLD_GLOBAL))
+            Logger::logWarning("Daemon: dlopening shared library '%s' failed: %s", it->c_str(), dlerror());
     }
-    else
+
+    Logger::logInfo("Daemon: preloaded %u shared libraries for all boosters",
+                    static_cast<unsigned int>(libraries.size()));
+}
+
+vector<string> Daemon::readPreloadList(const string & path)
+{
+    vector<string> libraries;
+
+    std::ifstream file(path.c_str());
+    if (!file)
     {
-        Logger::logError("Daemon: Nothing read from the socket\n");
-        // Critical error communicating with booster. Exiting applauncherd.
-        _exit(EXIT_FAILURE);
+        Logger::logWarning("Daemon: Couldn't read preload list '%s'", path.c_str());
+        return libraries;
     }
 
-    // 2nd param guarantees some time for the just launched application
-    // to start up before forking new booster. Not doing this would
-    // slow down the start-up significantly on single core CPUs.
+    // One library per line, empty lines and lines starting with # are skipped
+    string line;
+    while (std::getline(file, line))
+    {
+        size_t begin = line.find_first_not_of(" \t");
+        if (begin == string::npos || line[begin] == '#')
+            continue;
+
+        size_t end = line.find_last_not_of(" \t");
+        libraries.push_back(line.substr(begin, end - begin + 1));
+    }
 
-    forkBooster(delay);
+    return libraries;
 }
 
 void Daemon::killProcess(pid_t pid, int signal) const
 {
-    if (pid > 0)
+    // Pids restored after re-exec may have been reused
+    if (pid > 0 && pid != getpid())
     {
         Logger::logDebug("Daemon: Killing pid %d with %d", pid, signal);
         if (kill(pid, signal) != 0)
@@ -354,19 +2615,75 @@ void Daemon::loadSingleInstancePlugin()
     }
 }
 
-void Daemon::forkBooster(int sleepTime)
+void Daemon::forkBooster(const string & type, int sleepTime)
 {
-    if (!m_booster) {
+    Booster * booster = NULL;
+    const vector<string> * signatureEnv = NULL;
+
+    BoosterMap::iterator b = m_boosters.find(type);
+    if (b != m_boosters.end())
+    {
+        booster = b->second;
+    }
+    else
+    {
+        // Booster for an environment signature
+        SignatureBoosterMap::iterator s = m_signatureBoosters.find(type);
+        if (s != m_signatureBoosters.end())
+        {
+            booster      = m_boosters[s->second.type];
+            signatureEnv = &s->second.env;
+        }
+    }
+
+    if (!booster) {
         // Critical error unknown booster type. Exiting applauncherd.
         _exit(EXIT_FAILURE);
     }
 
     // Invalidate current booster pid
-    m_boosterPid = 0;
+    m_boosterPids[type] = 0;
+
+    // Back off from boosters that keep dying, and skip the preload
+    // altogether while the circuit breaker is open
+    BoosterHealth & health = m_boosterHealth[type];
+    if (health.degradedUntil && monotonicMs() >= health.degradedUntil)
+    {
+        Logger::logInfo("Daemon: trying a fully preloaded booster for '%s' again", type.c_str());
+        health.degradedUntil = 0;
+        health.probing       = true;
+    }
+
+    const bool minimal = health.degradedUntil != 0;
+    const int backoff  = health.failures ?
+        std::min(m_boosterSleepTime << std::min(health.failures - 1, 6u), m_maxRespawnBackoff) : 0;
+
+    // The new booster tells invokers when it expects to accept them
+    const int delay = backoff ? backoff : (!m_bootMode ? sleepTime : 0);
+    booster_status * status = boosterStatus(type);
+
+    // Pick the preload variant for the new booster. Boosters report
+    // their variant only while the experiment is running.
+    if (m_preloadExperiment)
+    {
+        int variant = m_preloadExperiment->nextVariant();
+        booster->setPreloadList(m_preloadLists[variant],
+                                m_preloadExperiment->winner() == -1 ? variant : -1);
+    }
+
+    // The booster unblocks SIGUSR1 when it is ready to upgrade itself
+    // to the normal mode, see enterNormalMode()
+    sigset_t upgradeSignal, oldMask;
+    sigemptyset(&upgradeSignal);
+    sigaddset(&upgradeSignal, SIGUSR1);
+    sigprocmask(SIG_BLOCK, &upgradeSignal, &oldMask);
 
     // Fork a new process
     pid_t newPid = fork();
 
+    if (newPid != 0)
+        sigprocmask(SIG_SETMASK, &oldMask, NULL);
+
     if (newPid == -1)
         throw std::runtime_error("Daemon: Forking while invoking");
 
@@ -385,6 +2702,25 @@ void Daemon::forkBooster(int sleepTime)
         close(m_sigPipeFd[0]);
         close(m_sigPipeFd[1]);
 
+        if (m_inotifyFd != -1)
+            close(m_inotifyFd);
+
+        if (m_profileWatchFd != -1)
+            close(m_profileWatchFd);
+
+        // Close the control socket and connections
+        if (m_controlSocket != -1)
+            close(m_controlSocket);
+
+        for (set<int>::const_iterator it = m_controlClients.begin(); it != m_controlClients.end(); it++)
+            close(*it);
+
+        // The session bus connection of the single instance plugin,
+        // closing only its fd would leave the plugin using it
+        SingleInstancePluginEntry * pluginEntry = m_singleInstance->pluginEntry();
+        if (pluginEntry && pluginEntry->closeActivationsFunc)
+            pluginEntry->closeActivationsFunc();
+
         // Close socket file descriptors
         FdMap::iterator i(m_boosterPidToInvokerFd.begin());
         while (i != m_boosterPidToInvokerFd.end())
@@ -399,24 +2735,38 @@ void Daemon::forkBooster(int sleepTime)
         if (setsid() < 0)
             Logger::logError("Daemon: Couldn't set session id\n");
 
+        // Preload under the environment of the signature
+        if (signatureEnv)
+        {
+            for (vector<string>::const_iterator it = m_envSignatureVars.begin(); it != m_envSignatureVars.end(); it++)
+                unsetenv(it->c_str());
+
+            for (vector<string>::const_iterator it = signatureEnv->begin(); it != signatureEnv->end(); it++)
+                putenv(strdup(it->c_str()));
+        }
+
+        booster->setStatus(status, delay);
+
         // Guarantee some time for the just launched application to
         // start up before initializing new booster if needed.
-        // Not done if in the boot mode.
-        if (!m_bootMode && sleepTime)
-            sleep(sleepTime);
+        // Not done if in the boot mode, unless backing off.
+        if (delay)
+            sleep(delay);
+
+        Logger::logDebug("Daemon: Running a new Booster of type '%s'", type.c_str());
 
-        Logger::logDebug("Daemon: Running a new Booster of type '%s'", m_booster->boosterType().c_str());
+        booster->setDeprioritizedPreload(monotonicMs() < m_launchBoostUntil);
 
         // Initialize and wait for commands from invoker
-        m_booster->initialize(m_initialArgc, m_initialArgv, m_boosterLauncherSocket[1],
-                              m_socketManager->findSocket(m_booster->boosterType().c_str()),
-                              m_singleInstance, m_bootMode);
+        booster->initialize(m_initialArgc, m_initialArgv, m_boosterLauncherSocket[1],
+                            m_socketManager->findSocket(type),
+                            m_singleInstance, m_bootMode || minimal);
 
         // Run the current Booster
-        int retval = m_booster->run(m_socketManager);
+        int retval = booster->run(m_socketManager);
 
         // Finish
-        delete m_booster;
+        delete booster;
 
         // _exit() instead of exit() to avoid situation when destructors
         // for static objects may be run incorrectly
@@ -429,7 +2779,11 @@ void Daemon::forkBooster(int sleepTime)
 
         // Set current process ID globally to the given booster type
         // so that we now which booster to restart when booster exits.
-        m_boosterPid = newPid;
+        m_boosterPids[type] = newPid;
+
+        // Watch the files of the new booster as well
+        if (m_inotifyFd != -1)
+            checkMappings(newPid);
     }
 }
 
@@ -455,16 +2809,29 @@ void Daemon::reapZombies()
             {
                 Logger::logDebug("Daemon: Terminated process had a mapping to an invoker pid");
 
-                if (WIFEXITED(status))
+                // Such invokers get the wait status also if the process
+                // was killed by a signal
+                const bool waitStatus = m_waitStatusPids.erase(pid);
+
+                if (WIFEXITED(status) || waitStatus)
                 {
-                    Logger::logInfo("Boosted process (pid=%d) exited with status %d\n", pid, WEXITSTATUS(status));
-                    Logger::logDebug("Daemon: child exited by exit(x), _exit(x) or return x\n");
-                    Logger::logDebug("Daemon: x == %d\n", WEXITSTATUS(status));
+                    if (WIFEXITED(status))
+                    {
+                        Logger::logInfo("Boosted process (pid=%d) exited with status %d\n", pid, WEXITSTATUS(status));
+                        Logger::logDebug("Daemon: child exited by exit(x), _exit(x) or return x\n");
+                        Logger::logDebug("Daemon: x == %d\n", WEXITSTATUS(status));
+                    }
+                    else
+                    {
+                        Logger::logInfo("Boosted process (pid=%d) was terminated due to signal %d\n",
+                                        pid, WTERMSIG(status));
+                    }
+
                     FdMap::iterator fd = m_boosterPidToInvokerFd.find(pid);
                     if (fd != m_boosterPidToInvokerFd.end())
                     {
                         write((*fd).second, &INVOKER_MSG_EXIT, sizeof(uint32_t));
-                        int exitStatus = WEXITSTATUS(status);
+                        int exitStatus = waitStatus ? status : WEXITSTATUS(status);
                         write((*fd).second, &exitStatus, sizeof(int));
                         close((*fd).second);
                         m_boosterPidToInvokerFd.erase(fd);
@@ -493,10 +2860,25 @@ void Daemon::reapZombies()
                 m_boosterPidToInvokerPid.erase(it);
             }
 
+            applicationExited(pid, status);
+            instanceExited(pid);
+            activatedAppExited(pid);
+            sharedLaunchExited(pid, status);
+            m_launchBoosts.erase(pid);
+
             // Check if pid belongs to a booster and restart the dead booster if needed
-            if (pid == m_boosterPid)
+            const string boosterType = boosterTypeOf(pid);
+            if (!boosterType.empty())
             {
-                forkBooster(m_boosterSleepTime);
+                // The dead booster may have been waiting for invokers
+                BoosterStatusMap::iterator page = m_boosterStatus.find(boosterType);
+                if (page != m_boosterStatus.end())
+                    page->second->ready = 0;
+
+                if (abnormalExit(status))
+                    boosterFailed(boosterType);
+
+                forkBooster(boosterType, m_boosterSleepTime);
             }
         }
         else
@@ -506,6 +2888,66 @@ void Daemon::reapZombies()
     }
 }
 
+void Daemon::boosterFailed(const string & slot)
+{
+    BoosterHealth & health = m_boosterHealth[slot];
+    health.failures++;
+
+    Logger::logWarning("Daemon: booster '%s' died before launching, %u failures in a row",
+                       slot.c_str(), health.failures);
+
+    if (health.degradedUntil)
+        return;
+
+    // Stop preloading when the preload keeps killing the booster
+    if (health.probing || health.failures >= m_maxBoosterFailures)
+    {
+        Logger::logWarning("Daemon: starting minimal boosters for '%s' for %d s",
+                           slot.c_str(), m_degradedPeriodMs / 1000);
+        health.degradedUntil = monotonicMs() + m_degradedPeriodMs;
+        health.failures      = 0;
+        health.probing       = false;
+    }
+}
+
+void Daemon::applicationExited(pid_t pid, int status)
+{
+    LaunchedAppMap::iterator it = m_launchedApps.find(pid);
+    if (it == m_launchedApps.end())
+        return;
+
+    const bool crashed = abnormalExit(status) &&
+        monotonicMs() - it->second.launchTime < m_crashWindowMs;
+
+    const unsigned int crashes = m_launchThrottle->addExit(it->second.app, crashed);
+    if (crashes >= LaunchThrottle::MIN_CRASHES)
+    {
+        Logger::logWarning("Daemon: %s crashed %u times in a row right after launch, throttling it",
+                           it->second.app.c_str(), crashes);
+    }
+
+    if (!it->second.cgroup.empty())
+        removeCgroup(it->second.cgroup);
+
+    m_launchedApps.erase(it);
+}
+
+void Daemon::removeCgroup(const string & dir)
+{
+    // The directories created below the fixed part of --cgroup are removed
+    // as they get empty, those of running applications are busy
+    const string::size_type variable = m_cgroupPath.find('%');
+    const string::size_type fixedLength = variable == string::npos ?
+        m_cgroupPath.size() : m_cgroupPath.rfind('/', variable);
+
+    string path = dir;
+    while (fixedLength != string::npos && path.size() > fixedLength && rmdir(path.c_str()) == 0)
+    {
+        Logger::logDebug("Daemon: removed cgroup '%s'", path.c_str());
+        path.erase(path.rfind('/'));
+    }
+}
+
 void Daemon::daemonize()
 {
     // Our process ID and Session ID
@@ -592,14 +3034,90 @@ void Daemon::parseArgs(const ArgVect & args)
         {
             usage(args[0].c_str(), EXIT_SUCCESS);
         }
-        else if ((*i) == "--re-exec")
+        else if ((*i).find("--re-exec=") == 0)
         {
+            m_stateFd = atoi((*i).substr(strlen("--re-exec=")).c_str());
             m_reExec = true;
         }
+        else if ((*i) == "--re-exec")
+        {
+            // Older launchers saved the state to a file, start from scratch
+            Logger::logWarning("Daemon: No saved state handed over, not restoring state");
+        }
         else if ((*i) == "--systemd")
         {
             m_notifySystemd = true;
         }
+        else if ((*i) == "--unload-unused")
+        {
+            m_unloadUnusedLibraries = true;
+        }
+        else if ((*i) == "--fast-exit")
+        {
+            m_fastExit = true;
+        }
+        else if ((*i) == "--audit-preload")
+        {
+            m_auditPreload = true;
+        }
+        else if ((*i) == "--strict-preload")
+        {
+            m_strictPreload = true;
+        }
+        else if ((*i) == "--warmup-libc")
+        {
+            m_warmupLibc = true;
+        }
+        else if ((*i) == "--recycle-stale")
+        {
+            m_recycleStale = true;
+        }
+        else if ((*i).find("--coalesce-window=") == 0)
+        {
+            m_coalesceWindowMs = std::max(atoi((*i).substr(strlen("--coalesce-window=")).c_str()), 0);
+        }
+        else if ((*i).find("--launch-boost=") == 0)
+        {
+            m_launchBoostMs = std::max(atoi((*i).substr(strlen("--launch-boost=")).c_str()), 0);
+        }
+        else if ((*i).find("--profiles=") == 0)
+        {
+            m_profileDir = (*i).substr(strlen("--profiles="));
+        }
+        else if ((*i).find("--cgroup=") == 0)
+        {
+            m_cgroupPath = (*i).substr(strlen("--cgroup="));
+        }
+        else if ((*i).find("--booster-plugins=") == 0)
+        {
+            m_boosterPluginDir = (*i).substr(strlen("--booster-plugins="));
+        }
+        else if ((*i).find("--shared-preload=") == 0)
+        {
+            m_sharedPreloadFile = (*i).substr(strlen("--shared-preload="));
+        }
+        else if ((*i).find("--env-signature=") == 0)
+        {
+            std::stringstream vars((*i).substr(strlen("--env-signature=")));
+            string var;
+            while (std::getline(vars, var, ','))
+            {
+                if (!var.empty())
+                    m_envSignatureVars.push_back(var);
+            }
+        }
+        else if ((*i).find("--preload=") == 0)
+        {
+            m_preloadListFile = (*i).substr(strlen("--preload="));
+        }
+        else if ((*i).find("--preload-experiment=") == 0)
+        {
+            m_experimentListFile = (*i).substr(strlen("--preload-experiment="));
+        }
+        else if ((*i).find("--keep-resident=") == 0)
+        {
+            m_residentLibraries.push_back((*i).substr(strlen("--keep-resident=")));
+        }
         else
         {
             if ((*i).find_first_not_of(' ') != string::npos)
@@ -623,6 +3141,57 @@ void Daemon::usage(const char *name, int status)
            "                   to the launcher.\n"
            "  -d, --daemon     Run as %s a daemon.\n"
            "  --systemd        Notify systemd when initialization is done\n"
+           "  --unload-unused  Release preloaded libraries that the launched\n"
+           "                   application does not depend on before calling main().\n"
+           "  --keep-resident=LIB\n"
+           "                   Never release LIB (file name or full path) with\n"
+           "                   --unload-unused. Can be given multiple times.\n"
+           "  --fast-exit      Skip exit-time cleanup of preloaded libraries in\n"
+           "                   launched applications.\n"
+           "  --audit-preload  Log threads, file descriptors, file locks and connected\n"
+           "                   sockets created while preloading.\n"
+           "  --strict-preload Like --audit-preload, but also refuse to preload\n"
+           "                   libraries that are not fork safe.\n"
+           "  --warmup-libc    Do NSS lookups and load locale, timezone and iconv\n"
+           "                   data in boosters before preloading.\n"
+           "  --booster-plugins=DIR\n"
+           "                   Host also the booster types loaded from the plugins\n"
+           "                   (*.so exporting createBooster()) in DIR.\n"
+           "  --shared-preload=FILE\n"
+           "                   Preload the libraries listed in FILE once in the\n"
+           "                   launcher so that all booster types share them.\n"
+           "  --env-signature=VAR[,VAR...]\n"
+           "                   Keep boosters preloaded under the values of these\n"
+           "                   environment variables that invocations have used.\n"
+           "  --preload=FILE   Preload the libraries listed in FILE, one per line,\n"
+           "                   in addition to the booster's own preloads.\n"
+           "  --preload-experiment=FILE\n"
+           "                   Compare FILE against the --preload list by starting\n"
+           "                   boosters alternately with each and measuring launch\n"
+           "                   latency and memory. The faster list is used once the\n"
+           "                   difference is significant.\n"
+           "  --recycle-stale  Restart waiting boosters that map libraries replaced\n"
+           "                   or deleted on disk, e.g. by a package upgrade. The\n"
+           "                   launcher re-executes itself if it maps such files.\n"
+           "  --coalesce-window=MS\n"
+           "                   Launches of the same application with the same\n"
+           "                   arguments within MS milliseconds share one instance\n"
+           "                   (default 500, 0 disables).\n"
+           "  --cgroup=PATH    Place launched applications into the cgroup PATH\n"
+           "                   before main() instead of only flipping to the boosted\n"
+           "                   group. %%u is replaced with the user ID and %%a with\n"
+           "                   the application name, which is appended to PATH if\n"
+           "                   %%a is not used. Missing directories are created.\n"
+           "  --launch-boost=MS\n"
+           "                   Run launched applications at a lower nice value and\n"
+           "                   a raised minimum utilization clamp for MS milliseconds\n"
+           "                   after main(). Boosters respawned meanwhile preload at\n"
+           "                   the lowest priority.\n"
+           "  --profiles=DIR   Apply the launch profiles in DIR (dlopen mode,\n"
+           "                   scheduling, CPU affinity, utilization clamps, OOM\n"
+           "                   score, nice and I/O priority) to launched\n"
+           "                   applications. Changes are applied without\n"
+           "                   restarting boosters.\n"
            "  --debug          Enable debug messages and log everything also to stdout.\n"
            "  -h, --help       Print this help.\n\n",
            name, name, name);
@@ -641,8 +3210,12 @@ void Daemon::enterNormalMode()
     {
         m_bootMode = false;
 
-        // Kill current boosters
-        killBoosters();
+        // New boosters inherit the shared libraries
+        preloadSharedLibraries();
+
+        // Waiting boosters preload in place instead of being restarted,
+        // so that a booster is available during the transition
+        upgradeBoosters();
 
         Logger::logInfo("Daemon: Exited boot mode.");
     }
@@ -669,12 +3242,30 @@ void Daemon::enterBootMode()
     }
 }
 
+void Daemon::upgradeBoosters()
+{
+    for (BoosterPidMap::iterator it = m_boosterPids.begin(); it != m_boosterPids.end(); it++)
+    {
+        // Minimal boosters of an open circuit breaker stay minimal, the
+        // full preload is what keeps killing them
+        BoosterHealthMap::const_iterator health = m_boosterHealth.find(it->first);
+        if (health != m_boosterHealth.end() && health->second.degradedUntil)
+            continue;
+
+        if (it->second)
+            killProcess(it->second, SIGUSR1);
+    }
+}
+
 void Daemon::killBoosters()
 {
-    if (m_boosterPid)
-        killProcess(m_boosterPid, SIGTERM);
+    for (BoosterPidMap::iterator it = m_boosterPids.begin(); it != m_boosterPids.end(); it++)
+    {
+        if (it->second)
+            killProcess(it->second, SIGTERM);
+    }
 
-    // NOTE!!: m_boosterPid must not be cleared
+    // NOTE!!: m_boosterPids must not be cleared
     // in order to automatically start new boosters.
 }
 
@@ -715,6 +3306,8 @@ Daemon::~Daemon()
 {
     delete m_socketManager;
     delete m_singleInstance;
+    delete m_launchThrottle;
+    delete m_appProfiles;
 
     Logger::closeLog();
 }
@@ -723,93 +3316,134 @@ void Daemon::reExec()
 {
     Logger::logInfo("Daemon: Re-exec requested.");
 
-    struct stat st;
-    if (stat(m_stateDir.c_str(), &st) != 0)
+    SavedState state;
+
+    // Save the pid to double check that the state is from this process
+    state.add(SavedState::PID, getpid());
+
+    // Save debug mode first, restoring it will enable debug logging.
+    // This way we get debug output from the re-execed daemon as early
+    // as possible.
+    state.add(SavedState::DEBUG_MODE, m_debugMode);
+
+    // The pids of the dead boosters are also passed as children, but
+    // this causes no harm.
+    for(PidVect::iterator it = m_children.begin(); it != m_children.end(); it++)
     {
-        Logger::logDebug("Daemon: State saving directory %s does not exist", m_stateDir.c_str());
-        Logger::logDebug("Daemon: Attempting to create it");
+        state.add(SavedState::CHILD, *it);
+    }
 
-        if (mkdir(m_stateDir.c_str(), S_IRUSR | S_IWUSR | S_IXUSR) != 0)
-        {
-            Logger::logDebug("Daemon: Failed to create directory, re-exec failed, exiting.");
-            _exit(1);
-        }
+    for(PidMap::iterator it = m_boosterPidToInvokerPid.begin(); it != m_boosterPidToInvokerPid.end(); it++)
+    {
+        state.add(SavedState::BOOSTER_INVOKER_PID, it->first, it->second);
     }
 
-    if (stat(m_stateDir.c_str(), &st) != 0)
+    for(FdMap::iterator it = m_boosterPidToInvokerFd.begin(); it != m_boosterPidToInvokerFd.end(); it++)
     {
-        Logger::logDebug("Daemon: Directory vanished, re-exec failed, exiting.");
-        _exit(1);
+        state.add(SavedState::BOOSTER_INVOKER_FD, it->first, it->second);
     }
-    if (!S_ISDIR(st.st_mode))
+
+    for(PidSet::iterator it = m_waitStatusPids.begin(); it != m_waitStatusPids.end(); it++)
     {
-        Logger::logDebug("Daemon: %s exists but it is not a directory, re-exec failed, exiting.", m_stateDir.c_str());
-        _exit(1);
+        state.add(SavedState::WAIT_STATUS_PID, *it);
     }
 
-    try {
-        std::ofstream ss(m_stateFile.c_str());
-        ss.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+    // Signature boosters are not restored
+    while (!m_signatureLru.empty())
+        removeSignatureBooster(m_signatureLru.front());
 
-        // dump the pid to double check that the state file is from this process
-        ss << "my-pid " << getpid() << std::endl;
+    for(BoosterPidMap::iterator it = m_boosterPids.begin(); it != m_boosterPids.end(); it++)
+    {
+        state.add(SavedState::BOOSTER_PID, it->second, it->first);
+    }
 
-        // Save debug mode first, restoring it will enable debug logging.
-        // This way we get debug output from the re-execed daemon as early
-        // as possible.
-        ss << "debug-mode " << m_debugMode << std::endl;
+    state.add(SavedState::LAUNCHER_SOCKET, m_boosterLauncherSocket[0], m_boosterLauncherSocket[1]);
 
-        // The pids of the dead boosters are also passed as children, but
-        // this causes no harm.
-        for(PidVect::iterator it = m_children.begin(); it != m_children.end(); it++)
-        {
-            ss << "child " << *it << std::endl;
-        }
+    state.add(SavedState::SIGPIPE_FD, m_sigPipeFd[0], m_sigPipeFd[1]);
 
-        for(PidMap::iterator it = m_boosterPidToInvokerPid.begin(); it != m_boosterPidToInvokerPid.end(); it++)
-        {
-            ss << "booster-invoker-pid " << it->first << " " << it->second << std::endl;
-        }
+    state.add(SavedState::BOOT_MODE, m_bootMode);
 
-        for(FdMap::iterator it = m_boosterPidToInvokerFd.begin(); it != m_boosterPidToInvokerFd.end(); it++)
-        {
-            ss << "booster-invoker-fd " << it->first << " " << it->second << std::endl;
-        }
+    // Reservations of starting instances are dropped, their invokers
+    // fall back to the lock of the single instance plugin
+    for (SingleInstanceMap::iterator it = m_singleInstanceApps.begin(); it != m_singleInstanceApps.end(); it++)
+    {
+        if (it->second.pid)
+            state.add(SavedState::SINGLE_INSTANCE_APP, it->second.pid, it->first);
+    }
 
-        ss << "booster-pid " << m_boosterPid << std::endl;
+    for (ActivatedAppMap::iterator it = m_activatedApps.begin(); it != m_activatedApps.end(); it++)
+    {
+        state.add(SavedState::ACTIVATED_APP, it->second, it->first);
+    }
 
-        ss << "launcher-socket " << m_boosterLauncherSocket[0] << " " << m_boosterLauncherSocket[1] << std::endl;
+    // The re-execed launcher removes the cgroups of the applications and
+    // counts their crashes
+    const int64_t now = monotonicMs();
+    for (LaunchedAppMap::iterator it = m_launchedApps.begin(); it != m_launchedApps.end(); it++)
+    {
+        vector<int32_t> values;
+        values.push_back(it->first);
+        values.push_back(std::min<int64_t>(now - it->second.launchTime, INT_MAX));
+        state.add(SavedState::LAUNCHED_APP, values, it->second.app + '\0' + it->second.cgroup);
+    }
 
-        ss << "sigpipe-fd " << m_sigPipeFd[0] << " " << m_sigPipeFd[1] << std::endl;
+    // The re-execed launcher ends the launch boosts
+    for (LaunchBoostMap::iterator it = m_launchBoosts.begin(); it != m_launchBoosts.end(); it++)
+    {
+        vector<int32_t> values;
+        values.push_back(it->first);
+        values.push_back(std::max<int64_t>(it->second.until - now, 0));
+        values.push_back(it->second.boost);
+        values.push_back(it->second.boostNice);
+        values.push_back(it->second.nice);
+        values.push_back(it->second.uclampMin);
+        values.push_back(it->second.autogroupNice);
+        state.add(SavedState::LAUNCH_BOOST, values);
+    }
 
-        ss << "boot-mode " << m_bootMode << std::endl;
+    // The re-execed launcher keeps the boosters if these match
+    state.add(SavedState::BINARY_FINGERPRINT, m_binaryFingerprint);
+    state.add(SavedState::CONFIG_FINGERPRINT, configFingerprint());
 
-        SocketManager::SocketHash s = m_socketManager->getState();
-        for(SocketManager::SocketHash::iterator it = s.begin(); it != s.end(); it++)
-        {
-            ss << "socket-hash " << it->first << " " << it->second << std::endl;
-        }
+    SocketManager::SocketHash s = m_socketManager->getState();
+    for(SocketManager::SocketHash::iterator it = s.begin(); it != s.end(); it++)
+    {
+        state.add(SavedState::SOCKET_HASH, it->second, it->first);
+    }
 
-        // when the new applauncherd reads this,
-        // it knows state saving was successful.
-        ss << "end" << std::endl;
-        ss.close();
+    // The state is handed over in a sealed memfd that survives execve()
+    const int stateFd = state.writeToMemfd();
+    if (stateFd == -1)
+    {
+        Logger::logError("Daemon: Failed to save state, re-exec failed.");
+        return;
     }
-    catch (std::ofstream::failure e)
+
+    std::stringstream reExecArg;
+    reExecArg << "--re-exec=" << stateFd;
+    const string reExecArgStr = reExecArg.str();
+
+    // Run the binary with the original arguments. The space-only argument
+    // reserves room for renaming the boosters.
+    vector<char *> argv;
+    argv.push_back(const_cast<char *>(m_executable.c_str()));
+    for (int i = 1; i < m_initialArgc; i++)
     {
-        Logger::logError("Daemon: Failed to save state, re-exec failed, exiting.");
-        _exit(1);
+        const string arg(m_initialArgv[i]);
+        if (arg == "--re-exec" || arg.find("--re-exec=") == 0 ||
+            arg == "--daemon" || arg == "-d" ||
+            arg.find_first_not_of(' ') == string::npos)
+            continue;
+
+        argv.push_back(m_initialArgv[i]);
     }
-    
-    char* argv[] = { const_cast<char*>("/usr/bin/applauncherd.bin"),
-                     const_cast<char*>("--re-exec"),
-                     const_cast<char*>("                                                  "),
-                     NULL};
+    argv.push_back(const_cast<char *>(reExecArgStr.c_str()));
+    argv.push_back(const_cast<char *>("                                                  "));
+    argv.push_back(NULL);
 
-    // The boosters have state which will become stale, so kill them.
-    // The dead boosters will be reaped when the re-execed applauncherd
-    // calls reapZombies after it has initialized.
-    killBoosters();
+    // Waiting boosters are left running, the re-execed launcher adopts
+    // them or restarts them if they are stale. Signature boosters were
+    // stopped above and are started again on demand.
 
     // Signal handlers are reset at exec(), so we will lose
     // the SIGHUP handling. However, ignoring a signal is preserved
@@ -818,158 +3452,298 @@ void Daemon::reExec()
     signal(SIGHUP, SIG_IGN);
 
     Logger::logDebug("Daemon: configuration saved succesfully, call execve() ");
-    execve(argv[0], argv, environ);
+    execve(argv[0], &argv[0], environ);
 
     // Not reached.
     Logger::logDebug("Daemon: Failed to execute execve(),  re-exec failed, exiting.");
     _exit(1);
 }
 
+// FNV-1a over the fields of a fingerprint
+static void fingerprintAdd(uint64_t & hash, const string & field)
+{
+    for (string::const_iterator it = field.begin(); it != field.end(); it++)
+        hash = (hash ^ static_cast<unsigned char>(*it)) * 1099511628211ULL;
+
+    hash = (hash ^ '\0') * 1099511628211ULL;
+}
+
+static string fingerprintString(uint64_t hash)
+{
+    std::stringstream ss;
+    ss << std::hex << hash;
+    return ss.str();
+}
+
+// Identity of a file, changes when the file is replaced or rewritten
+static void fingerprintFile(uint64_t & hash, const char * path)
+{
+    struct stat st;
+    if (stat(path, &st) == 0)
+    {
+        std::stringstream ss;
+        ss << path << ' ' << st.st_dev << ' ' << st.st_ino << ' '
+           << st.st_size << ' ' << st.st_mtime;
+        fingerprintAdd(hash, ss.str());
+    }
+}
+
+static int fingerprintLoadedObject(struct dl_phdr_info * info, size_t, void * data)
+{
+    // The main program has an empty name
+    fingerprintFile(*static_cast<uint64_t *>(data), *info->dlpi_name ? info->dlpi_name : "/proc/self/exe");
+    return 0;
+}
+
+static void fingerprintLibraries(uint64_t & hash, const vector<string> & libraries)
+{
+    // Libraries given by name are found by the dynamic linker, only
+    // their names are part of the configuration fingerprint
+    for (vector<string>::const_iterator it = libraries.begin(); it != libraries.end(); it++)
+    {
+        if ((*it)[0] == '/')
+            fingerprintFile(hash, it->c_str());
+    }
+}
+
+string Daemon::binaryFingerprint() const
+{
+    uint64_t hash = 14695981039346656037ULL;
+    dl_iterate_phdr(fingerprintLoadedObject, &hash);
+
+    // Boosters also run the libraries they preload themselves
+    for (int variant = 0; variant < 2; variant++)
+        fingerprintLibraries(hash, m_preloadLists[variant]);
+
+    fingerprintLibraries(hash, m_residentLibraries);
+
+    if (!m_sharedPreloadFile.empty())
+        fingerprintLibraries(hash, readPreloadList(m_sharedPreloadFile));
+
+    return fingerprintString(hash);
+}
+
+string Daemon::configFingerprint() const
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    // Options that change what boosters do before they accept a launch
+    fingerprintAdd(hash, m_bootMode ? "boot-mode" : "normal-mode");
+    fingerprintAdd(hash, m_unloadUnusedLibraries ? "unload-unused" : "");
+    fingerprintAdd(hash, m_fastExit ? "fast-exit" : "");
+    fingerprintAdd(hash, m_auditPreload ? "audit-preload" : "");
+    fingerprintAdd(hash, m_strictPreload ? "strict-preload" : "");
+    fingerprintAdd(hash, m_warmupLibc ? "warmup-libc" : "");
+    fingerprintAdd(hash, "cgroup " + m_cgroupPath);
+    fingerprintAdd(hash, "profiles " + m_profileDir);
+    fingerprintAdd(hash, m_launchBoostMs ? "launch-boost" : "");
+
+    for (vector<string>::const_iterator it = m_residentLibraries.begin(); it != m_residentLibraries.end(); it++)
+        fingerprintAdd(hash, "resident " + *it);
+
+    for (int variant = 0; variant < 2; variant++)
+    {
+        for (vector<string>::const_iterator it = m_preloadLists[variant].begin(); it != m_preloadLists[variant].end(); it++)
+            fingerprintAdd(hash, "preload " + *it);
+    }
+
+    for (vector<string>::const_iterator it = m_sharedPreloadList.begin(); it != m_sharedPreloadList.end(); it++)
+        fingerprintAdd(hash, "shared " + *it);
+
+    for (vector<string>::const_iterator it = m_envSignatureVars.begin(); it != m_envSignatureVars.end(); it++)
+        fingerprintAdd(hash, "env " + *it);
+
+    for (BoosterMap::const_iterator it = m_boosters.begin(); it != m_boosters.end(); it++)
+        fingerprintAdd(hash, "type " + it->first);
+
+    return fingerprintString(hash);
+}
+
+// Fingerprint of the compared preload lists, a saved winner applies
+// only to the same lists
+static string preloadExperimentFingerprint(const vector<string> lists[2])
+{
+    uint64_t hash = 14695981039346656037ULL;
+
+    for (int variant = 0; variant < 2; variant++)
+    {
+        fingerprintAdd(hash, "variant");
+        for (vector<string>::const_iterator it = lists[variant].begin(); it != lists[variant].end(); it++)
+            fingerprintAdd(hash, *it);
+    }
+
+    return fingerprintString(hash);
+}
+
+int Daemon::savedPreloadWinner() const
+{
+    std::ifstream in((m_socketManager->socketRootPath() + "preload-experiment").c_str());
+    string fingerprint;
+    char variant = 0;
+
+    if (in >> fingerprint >> variant &&
+        fingerprint == preloadExperimentFingerprint(m_preloadLists) &&
+        (variant == 'A' || variant == 'B'))
+        return variant - 'A';
+
+    return -1;
+}
+
+void Daemon::savePreloadWinner(int variant) const
+{
+    const string path = m_socketManager->socketRootPath() + "preload-experiment";
+    std::ofstream out(path.c_str());
+    out << preloadExperimentFingerprint(m_preloadLists) << ' ' << static_cast<char>('A' + variant) << '\n';
+
+    if (!out)
+        Logger::logWarning("Daemon: Couldn't save preload experiment result to '%s'", path.c_str());
+}
+
 void Daemon::restoreState()
 {
-    try
+    SavedState state;
+    const bool valid = state.readFromFd(m_stateFd);
+    close(m_stateFd);
+    m_stateFd = -1;
+
+    if (!valid)
     {
-        // We have saved state, try to restore it.
-        std::ifstream ss(m_stateFile.c_str());
-        ss.exceptions (std::ifstream::failbit | std::ifstream::badbit);
+        Logger::logError("Daemon: Failed to restore saved state, exiting.");
+        _exit(1);
+    }
 
-        std::string token;
+    const SavedState::RecordVect & records = state.records();
 
-        ss >> token;
+    // Bit of defensive programming. The first record is the pid of
+    // the process that saved the state. If it is different from my pid,
+    // then something is wrong, and we better exit.
+    if (records.empty() || records[0].tag != SavedState::PID)
+    {
+        Logger::logError("Daemon: malformed saved state, exiting.");
+        _exit(1);
+    }
+    else if (records[0].intAt(0) != getpid())
+    {
+        Logger::logError("Daemon: stale saved state, exiting.");
+        _exit(1);
+    }
 
-        // Bit of defensive programming. Read the pid of the process
-        // that left the state file. If it is different from my pid,
-        // then something is wrong, and we better exit.
-        if (token != "my-pid")
+    // Records of unknown tags are written by a newer launcher, skip them
+    for (SavedState::RecordVect::const_iterator it = records.begin() + 1; it != records.end(); it++)
+    {
+        switch (it->tag)
+        {
+        case SavedState::CHILD:
+            Logger::logDebug("Daemon: restored child %d", it->intAt(0));
+            m_children.push_back(it->intAt(0));
+            break;
+
+        case SavedState::BOOSTER_INVOKER_PID:
+            Logger::logDebug("Daemon: restored m_boosterPidToInvokerPid[%d] = %d", it->intAt(0), it->intAt(1));
+            m_boosterPidToInvokerPid[it->intAt(0)] = it->intAt(1);
+            break;
+
+        case SavedState::BOOSTER_INVOKER_FD:
+            Logger::logDebug("Daemon: restored m_boosterPidToInvokerFd[%d] = %d", it->intAt(0), it->intAt(1));
+            m_boosterPidToInvokerFd[it->intAt(0)] = it->intAt(1);
+            break;
+
+        case SavedState::BOOSTER_PID:
+            Logger::logDebug("Daemon: restored m_boosterPids[%s] = %d", it->text(1).c_str(), it->intAt(0));
+            m_boosterPids[it->text(1)] = it->intAt(0);
+            break;
+
+        case SavedState::LAUNCHER_SOCKET:
+            Logger::logDebug("Daemon: restored m_boosterLauncherSocket[] = {%d, %d}", it->intAt(0), it->intAt(1));
+            m_boosterLauncherSocket[0] = it->intAt(0);
+            m_boosterLauncherSocket[1] = it->intAt(1);
+            break;
+
+        case SavedState::SIGPIPE_FD:
+            Logger::logDebug("Daemon: restored m_sigPipeFd[] = {%d, %d}", it->intAt(0), it->intAt(1));
+            m_sigPipeFd[0] = it->intAt(0);
+            m_sigPipeFd[1] = it->intAt(1);
+            break;
+
+        case SavedState::SOCKET_HASH:
+            m_socketManager->addMapping(it->text(1), it->intAt(0));
+            Logger::logDebug("Daemon: restored socketHash[%s] = %d", it->text(1).c_str(), it->intAt(0));
+            break;
+
+        case SavedState::DEBUG_MODE:
+            m_debugMode = it->intAt(0);
+            Logger::setDebugMode(m_debugMode);
+            Logger::logDebug("Daemon: restored m_debugMode = %d", m_debugMode);
+            break;
+
+        case SavedState::BINARY_FINGERPRINT:
+            m_savedBinaryFingerprint = it->text(0);
+            Logger::logDebug("Daemon: restored binary fingerprint %s", m_savedBinaryFingerprint.c_str());
+            break;
+
+        case SavedState::CONFIG_FINGERPRINT:
+            m_savedConfigFingerprint = it->text(0);
+            Logger::logDebug("Daemon: restored config fingerprint %s", m_savedConfigFingerprint.c_str());
+            break;
+
+        case SavedState::BOOT_MODE:
+            m_bootMode = it->intAt(0);
+            Logger::logDebug("Daemon: restored m_bootMode = %d", m_bootMode);
+            break;
+
+        case SavedState::SINGLE_INSTANCE_APP:
         {
-            throw "Daemon: malformed state file, exiting.";
+            SingleInstanceApp & app = m_singleInstanceApps[it->text(1)];
+            app.pid        = it->intAt(0);
+            app.invokerPid = 0;
+            app.reservedAt = 0;
+            Logger::logDebug("Daemon: restored single instance %s = %d", it->text(1).c_str(), app.pid);
+            break;
         }
-        else
+
+        case SavedState::ACTIVATED_APP:
+            Logger::logDebug("Daemon: restored activated application %s = %d", it->text(1).c_str(), it->intAt(0));
+            m_activatedApps[it->text(1)] = it->intAt(0);
+            break;
+
+        case SavedState::LAUNCHED_APP:
         {
-            int pid;
-            ss >> pid;
-            if (pid != getpid())
-            {
-                throw "Daemon: stale state file, exiting.";
-            }
+            const string text = it->text(2);
+            const string::size_type separator = text.find('\0');
+            LaunchedApp & launched = m_launchedApps[it->intAt(0)];
+            launched.app        = text.substr(0, separator);
+            launched.launchTime = monotonicMs() - it->intAt(1);
+            launched.cgroup     = separator == string::npos ? string() : text.substr(separator + 1);
+            Logger::logDebug("Daemon: restored launched application %s = %d", launched.app.c_str(), it->intAt(0));
+            break;
         }
-        
-        // Do not check for eof, instead trigger an exception
-        // if reading past end of file. When state restore is
-        // successful we read the "end" token and return from
-        // this method.
-        while (true) 
+
+        case SavedState::LAUNCH_BOOST:
         {
-            ss >> token;
-            
-            if (token == "end")
-            {
-                // successfully restored state
-                ss.close();
+            LaunchBoost & boost = m_launchBoosts[it->intAt(0)];
+            boost.until         = monotonicMs() + it->intAt(1);
+            boost.boost         = it->intAt(2);
+            boost.boostNice     = it->intAt(3);
+            boost.nice          = it->intAt(4);
+            boost.uclampMin     = it->intAt(5);
+            boost.autogroupNice = it->intAt(6);
+
+            // Boosters respawn at the lowest priority until it ends
+            m_launchBoostUntil = std::max(m_launchBoostUntil, boost.until);
+            Logger::logDebug("Daemon: restored launch boost of %d", it->intAt(0));
+            break;
+        }
 
-                // In debug mode it is better to leave the file there
-                // so it can be examined.
-                if (!m_debugMode && remove(m_stateFile.c_str()) == -1)
-                {
-                    Logger::logError("Daemon: could not remove state file %s", m_stateFile.c_str());
-                }
-                Logger::logDebug("Daemon: state restore completed");
-                return;
-            } 
-            else if (token == "child")
-            {
-                int arg1;
-                ss >> arg1;
-                Logger::logDebug("Daemon: restored child %d", arg1);
-                m_children.push_back(arg1);
-            } 
-            else if (token == "booster-invoker-pid")
-            {
-                int arg1, arg2;
-                ss >> arg1;
-                ss >> arg2;
-                Logger::logDebug("Daemon: restored m_boosterPidToInvokerPid[%d] = %d", arg1, arg2);
-                m_boosterPidToInvokerPid[arg1] = arg2;
-            } 
-            else if (token == "booster-invoker-fd")
-            {
-                int arg1, arg2;
-                ss >> arg1;
-                ss >> arg2;
-                Logger::logDebug("Daemon: restored m_boosterPidToInvokerFd[%d] = %d", arg1, arg2);
-                m_boosterPidToInvokerFd[arg1] = arg2;
-            } 
-            else if (token == "booster-pid")
-            {
-                int arg1;
-                ss >> arg1;
-                Logger::logDebug("Daemon: restored m_boosterPid = %d", arg1);
+        case SavedState::WAIT_STATUS_PID:
+            Logger::logDebug("Daemon: restored wait status pid %d", it->intAt(0));
+            m_waitStatusPids.insert(it->intAt(0));
+            break;
 
-                m_boosterPid = arg1;
-            } 
-            else if (token == "launcher-socket")
-            {
-                int arg1, arg2;
-                ss >> arg1;
-                ss >> arg2;
-                Logger::logDebug("Daemon: restored m_boosterLauncherSocket[] = {%d, %d}", arg1, arg2);
-                m_boosterLauncherSocket[0] = arg1;
-                m_boosterLauncherSocket[1] = arg2;
-            } 
-            else if (token == "sigpipe-fd")
-            {
-                int arg1, arg2;
-                ss >> arg1;
-                ss >> arg2;
-                Logger::logDebug("Daemon: restored m_sigPipeFd[] = {%d, %d}", arg1, arg2);
-                m_sigPipeFd[0] = arg1;
-                m_sigPipeFd[1] = arg2;
-            } 
-            else if (token == "socket-hash")
-            {
-                std::string arg1;
-                int arg2;
-                ss >> arg1;
-                ss >> arg2;
-                m_socketManager->addMapping(arg1, arg2);
-                Logger::logDebug("Daemon: restored socketHash[%s] = %d", arg1.c_str(), arg2);
-            }
-            else if (token == "debug-mode")
-            {
-                bool arg1;
-                ss >> arg1;
-                m_debugMode = arg1;
-                Logger::setDebugMode(m_debugMode);
-                Logger::logDebug("Daemon: restored m_debugMode = %d", arg1);
-            }
-            else if (token == "boot-mode")
-            {
-                bool arg1;
-                ss >> arg1;
-                m_bootMode = arg1;
-                Logger::logDebug("Daemon: restored m_bootMode = %d", arg1);
-            }
+        default:
+            Logger::logDebug("Daemon: skipped unknown state record %u", it->tag);
+            break;
         }
-    } 
-    catch (std::ifstream::failure e)
-    {
-        // Ran out of saved state before "end" token
-        // or there was some other error in restoring the sate.
-        Logger::logError("Daemon: Failed to restore saved state, exiting."); 
-    }
-    catch (char *err)
-    {
-        // Some other error, e.g. stale state file
-        Logger::logError(err);
     }
 
-    // In debug mode it is better to leave the file there
-    // so it can be examined.
-    if (!m_debugMode && remove(m_stateFile.c_str()) == -1)
-    {
-        Logger::logError("Daemon: could not remove state file %s", m_stateFile.c_str());
-    }
-
-    // This is only reached if state restore was unsuccessful.
-    _exit(1);
+    Logger::logDebug("Daemon: state restore completed");
 }
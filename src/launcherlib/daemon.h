@@ -39,12 +39,28 @@ using std::vector;
 
 using std::map;
 
+#include <list>
+
+using std::list;
+
+#include <set>
+
+using std::set;
+
+#include <stdint.h>
+
 #include <signal.h>
 #include <sys/socket.h>
 
 class Booster;
 class SocketManager;
 class SingleInstance;
+class PreloadExperiment;
+class LaunchThrottle;
+class AppProfiles;
+struct EnvSignatureReport;
+struct LaunchReport;
+struct booster_status;
 
 /*!
  * \class Daemon.
@@ -75,6 +91,8 @@ public:
 
     /*!
      * \brief Run main loop and fork Boosters.
+     * \param booster Booster hosted in addition to the boosters loaded
+     *        with --booster-plugins, can be NULL if plugins are given.
      */
     void run(Booster *booster);
 
@@ -120,8 +138,260 @@ private:
     //! Fork process that kills boosters if needed
     void forkKiller();
 
-    //! Forks and initializes a new Booster
-    void forkBooster(int sleepTime = 0);
+    //! Forks and initializes a new Booster of the given type or
+    //! signature booster socket id
+    void forkBooster(const string & type, int sleepTime = 0);
+
+    //! Add a booster type hosted by this daemon
+    void addBooster(Booster * booster);
+
+    //! Load booster plugins from a directory
+    void loadBoosterPlugins(const string & dir);
+
+    //! Preload libraries shared by all booster types into the daemon
+    void preloadSharedLibraries();
+
+    //! Return the type of the waiting booster pid or an empty string
+    string boosterTypeOf(pid_t pid) const;
+
+    //! Count a signature hit or miss and start a booster for missed signatures
+    void handleEnvSignature(const EnvSignatureReport & report, size_t envSize);
+
+    //! Start a booster preloaded under the given environment
+    void addSignatureBooster(const string & slot, const string & type, const vector<string> & env);
+
+    //! Kill a signature booster and remove its socket
+    void removeSignatureBooster(const string & slot);
+
+    //! Write the signature variables for the invoker to the socket directory
+    //! and remove stale signature booster sockets
+    void publishEnvSignatureVars();
+
+    //! Log environment signature hit rate
+    void logEnvSignatureStats() const;
+
+    //! Return CLOCK_MONOTONIC time in milliseconds
+    static int64_t monotonicMs();
+
+    //! Start watching the files loaded into the launcher for changes
+    void watchLoadedFiles();
+
+    //! Return true if the process (0 is the launcher) maps code from
+    //! deleted or replaced files. Watches the directories of the files.
+    bool checkMappings(pid_t pid);
+
+    //! Watch the directory of file for replaced files
+    void watchDirOf(const string & file);
+
+    //! Drain inotify events and schedule a stale booster check
+    void readInotifyEvents();
+
+    //! Compile the launch profiles and watch their directory for changes
+    void loadAppProfiles();
+
+    //! Drain inotify events of the profile directory and recompile
+    void readProfileEvents();
+
+    //! Return the earliest pending stale booster timer or 0
+    int64_t staleTimerDeadline() const;
+
+    //! Run stale booster checks and recycling that are due
+    void runStaleTimers();
+
+    //! Find stale boosters, re-exec if the launcher itself is stale
+    void checkStaleBoosters();
+
+    //! Restart the next stale booster
+    void recycleStaleBooster();
+
+    //! Log launches served by stale boosters
+    void logStaleBoosterStats() const;
+
+    //! Return the readiness status page of a booster socket id, mapping
+    //! it on first use. NULL if it can't be created.
+    booster_status * boosterStatus(const string & slot);
+
+    //! Unmap and remove the status page of a booster socket id
+    void removeBoosterStatus(const string & slot);
+
+    //! Log invokers that executed applications directly
+    void logFallbackStats() const;
+
+    //! Create the socket for requests served by the launcher itself
+    void initControlSocket();
+
+    //! Accept a connection on the control socket
+    void acceptControlConnection();
+
+    //! Read and answer a request from a control connection
+    void readControlRequest(int fd);
+
+    //! Close a control connection and forget everything queued for it
+    void closeControlClient(int fd);
+
+    //! Answer whether a single instance application is already running.
+    //! Activates the running instance or reserves the name for the peer.
+    //! The answer waits while the instance is being launched.
+    void handleInstanceRequest(int fd, pid_t peerPid, const string & name);
+
+    //! Single instance request waiting for a starting instance
+    struct InstanceRequest
+    {
+        //! Control connection of the request
+        int fd;
+
+        //! Process asking
+        pid_t peerPid;
+
+        //! Application name
+        string name;
+    };
+
+    //! Answer the request unless its instance is being launched.
+    //! \return false if the request has to wait.
+    bool answerInstanceRequest(const InstanceRequest & request);
+
+    //! Answer the waiting requests whose instance started or failed to
+    void runInstanceRequests();
+
+    //! Forget the waiting requests of a closed control connection
+    void dropInstanceRequests(int fd);
+
+    //! Track the application launched for a single instance reservation
+    void instanceLaunched(pid_t invokerPid, pid_t appPid);
+
+    //! Forget the single instance application with the given pid
+    void instanceExited(pid_t pid);
+
+    //! Application to launch for an activation request
+    struct Activation
+    {
+        //! Control connection to answer
+        int fd;
+
+        //! Part of a batch request, answered with launcher_batch_reply
+        bool batch;
+
+        //! Index in the batch
+        uint32_t index;
+
+        string id;
+        string type;
+        string exec;
+        vector<string> argv;
+
+        //! Environment, shared by the applications of a batch
+        shared_ptr<vector<string> > env;
+
+        uint32_t options;
+        int32_t priority;
+
+        //! Standard I/O, owned by the activation while it is pending
+        vector<int> io;
+
+        //! Time the activation started waiting for a booster
+        int64_t queuedAt;
+    };
+
+    //! Launch an application through a booster for an activator and
+    //! answer its pid. fds become the standard I/O of the application.
+    void handleActivateRequest(int fd, const string & request, const vector<int> & fds);
+
+    //! Launch the applications of a batch request as boosters get ready
+    //! and answer each of them
+    void handleBatchRequest(int fd, const string & request, const vector<int> & fds);
+
+    //! Launch an activation if its booster is waiting. Returns
+    //! LAUNCHER_ACTIVATE_* or -errno, -EAGAIN if the booster is not ready.
+    int32_t launchActivation(const Activation & activation, pid_t & pid);
+
+    //! Send the result of an activation to its control connection
+    void answerActivation(const Activation & activation, int32_t status, pid_t pid);
+
+    //! Launch pending activations whose booster got ready
+    void runPendingActivations();
+
+    //! Forget the pending activations of a control connection
+    void dropActivations(int fd);
+
+    //! Close the descriptors of a pending activation
+    void closeActivation(const Activation & activation);
+
+    //! Forget the activated application with the given pid
+    void activatedAppExited(pid_t pid);
+
+    //! Return the key of identical launches: user, executable and arguments
+    static string launchKey(uid_t uid, const string & exec, const vector<string> & argv);
+
+    //! Let the peer share an identical launch started within the
+    //! coalescing window, or register the peer as launching it
+    void handleCoalesceRequest(int fd, uid_t uid, pid_t peerPid, const string & request);
+
+    //! Read the result of a launch registered for the control connection,
+    //! or of a single instance reserved for peerPid that it executes itself
+    void handleLaunchedReport(int fd, pid_t peerPid, const string & request);
+
+    //! Tell the processes sharing a launch the pid of the application, or
+    //! share the launch with key, launchKey() of it, if no process asked
+    void sharedLaunchStarted(pid_t invokerPid, pid_t appPid, const string & app, const string & key);
+
+    //! Tell the processes sharing a launch the wait status of the application
+    void sharedLaunchExited(pid_t pid, int status);
+
+    //! Drop expired launches and fail those not launched in time
+    void expireSharedLaunches();
+
+    //! Forget the launches of a closed control connection
+    void dropSharedLaunches(int fd);
+
+    //! Return the time the next unlaunched shared launch expires or 0
+    int64_t sharedLaunchDeadline() const;
+
+    //! Remember to end the launch boost of the reported application
+    void startLaunchBoost(const LaunchReport & report);
+
+    //! Return the applications of ended launch boosts to their normal
+    //! nice value and minimum utilization clamp
+    void endLaunchBoosts();
+
+    //! Return the time the next launch boost ends or 0
+    int64_t launchBoostDeadline() const;
+
+    //! Queue a background launch until its booster is free for it
+    void handleAdmitRequest(int fd, const string & request);
+
+    //! Return true if the waiting booster of the socket id can be given to
+    //! a background launch: no interactive launch connects to it or waits
+    //! for it, and no other background launch was given it
+    bool boosterFreeForBackground(const string & slot);
+
+    //! Admit queued background launches whose booster got free and time
+    //! out the rest
+    void runBackgroundLaunches();
+
+    //! Forget the background launches queued by a control connection
+    void dropBackgroundLaunches(int fd);
+
+    //! Return the next time a pending activation or background launch
+    //! times out or a busy booster may be given to it, or 0. Otherwise
+    //! these wait for a booster to tell it is ready.
+    int64_t waitingLaunchDeadline() const;
+
+    //! Return the fd of the window activation connection of the single
+    //! instance plugin or -1. wantWrite is set if requests are queued.
+    int activationFd(bool * wantWrite) const;
+
+    //! Count a booster that died while waiting and open the circuit
+    //! breaker if it keeps failing
+    void boosterFailed(const string & slot);
+
+    //! Record the exit of a launched application for crash loop detection
+    //! and remove its cgroup
+    void applicationExited(pid_t pid, int status);
+
+    //! Remove the cgroup of an exited application and its parents created
+    //! for it, as far as they are empty
+    void removeCgroup(const string & dir);
 
     //! Kill given pid with SIGKILL by default
     void killProcess(pid_t pid, int signal = SIGKILL) const;
@@ -132,21 +402,41 @@ private:
     //! Read and process data from a booster pipe
     void readFromBoosterSocket(int fd);
 
+    //! Read a preload list file, one library per line
+    static vector<string> readPreloadList(const string & path);
+
+    //! Return the preload variant an earlier run found for the same
+    //! preload lists, -1 if none
+    int savedPreloadWinner() const;
+
+    //! Remember the winning preload variant across launcher restarts
+    void savePreloadWinner(int variant) const;
+
     //! Enter normal mode (restart boosters with cache enabled)
     void enterNormalMode();
 
     //! Enter boot mode (restart boosters with cache disabled)
     void enterBootMode();
 
+    //! Ask waiting boot mode boosters to preload in place (SIGUSR1)
+    void upgradeBoosters();
+
     //! Kill all active boosters with -9
     void killBoosters();
 
     //! Prints the usage and exits with given status
     void usage(const char *name, int status);
 
-    //! Re-exec applauncherd.bin
+    //! Re-exec the launcher binary
     void reExec();
 
+    //! Return a fingerprint of the binaries loaded into the launcher
+    //! and of the libraries boosters preload
+    string binaryFingerprint() const;
+
+    //! Return a fingerprint of the configuration boosters are preloaded with
+    string configFingerprint() const;
+
     //! Restore state.
     void restoreState();
 
@@ -176,8 +466,14 @@ private:
     typedef map<pid_t, pid_t> FdMap;
     FdMap m_boosterPidToInvokerFd;
 
-    //! Current booster pid
-    pid_t m_boosterPid;
+    //! Boosted processes whose invoker gets the wait status instead of
+    //! being killed with the same signal
+    typedef set<pid_t> PidSet;
+    PidSet m_waitStatusPids;
+
+    //! Current waiting booster pid of each booster type
+    typedef map<string, pid_t> BoosterPidMap;
+    BoosterPidMap m_boosterPids;
 
     //! Socket pair used to tell the parent that a new booster is needed +
     //! some parameters.
@@ -211,15 +507,355 @@ private:
     //! True if re-execing
     bool m_reExec;
 
+    //! Memfd of the state saved before re-exec (--re-exec=FD)
+    int m_stateFd;
+
+    //! Path of the launcher binary, resolved at startup
+    string m_executable;
+
+    //! Fingerprint of the binaries boosters are forked from
+    string m_binaryFingerprint;
+
+    //! Fingerprints saved by the launcher before re-exec
+    string m_savedBinaryFingerprint;
+    string m_savedConfigFingerprint;
+
     //! True if systemd needs to be notified
     bool m_notifySystemd;
 
-    //! Booster instance
-    Booster * m_booster;
+    //! Booster instances by booster type
+    typedef map<string, Booster *> BoosterMap;
+    BoosterMap m_boosters;
+
+    //! Directory of booster plugins (--booster-plugins=DIR)
+    string m_boosterPluginDir;
+
+    //! Libraries preloaded into the daemon for all booster types
+    //! (--shared-preload=FILE)
+    string m_sharedPreloadFile;
+
+    //! Release unneeded preloaded libraries before launch (--unload-unused)
+    bool m_unloadUnusedLibraries;
+
+    //! Libraries never released before launch (--keep-resident=LIB)
+    vector<string> m_residentLibraries;
+
+    //! Skip exit-time cleanup of preloaded libraries (--fast-exit)
+    bool m_fastExit;
+
+    //! Audit the preload stage for fork safety (--audit-preload)
+    bool m_auditPreload;
+
+    //! Refuse to preload fork-unsafe libraries (--strict-preload)
+    bool m_strictPreload;
+
+    //! Warm up libc in boosters before preloading (--warmup-libc)
+    bool m_warmupLibc;
+
+    //! Cgroup of launched applications (--cgroup=PATH)
+    string m_cgroupPath;
+
+    //! Libraries preloaded by boosters (--preload=FILE)
+    string m_preloadListFile;
+
+    //! Alternative preload list compared against the default one
+    //! (--preload-experiment=FILE)
+    string m_experimentListFile;
+
+    //! Preload lists of the variants, index is the variant
+    vector<string> m_preloadLists[2];
+
+    //! Preload A/B experiment, NULL if not running
+    PreloadExperiment * m_preloadExperiment;
+
+    //! True once the --shared-preload libraries have been loaded
+    bool m_sharedLibrariesLoaded;
+
+    //! Libraries read from the --shared-preload file
+    vector<string> m_sharedPreloadList;
+
+    //! Environment variables boosters are keyed by (--env-signature=VARS)
+    vector<string> m_envSignatureVars;
+
+    //! Booster preloaded under a non-default environment
+    struct SignatureBooster
+    {
+        string type;
+        vector<string> env;
+    };
+
+    //! Signature boosters by socket id ("<type>.<signature>")
+    typedef map<string, SignatureBooster> SignatureBoosterMap;
+    SignatureBoosterMap m_signatureBoosters;
+
+    //! Socket ids of the signature boosters, most recently used first
+    list<string> m_signatureLru;
+
+    //! Launches served by a booster preloaded under the same signature
+    unsigned int m_signatureHits;
+
+    //! Launches served by a booster preloaded under a different signature
+    unsigned int m_signatureMisses;
+
+    //! Maximum number of signature boosters kept
+    static const unsigned int m_maxSignatureBoosters;
+
+    //! Restart boosters mapping replaced files (--recycle-stale)
+    bool m_recycleStale;
+
+    //! inotify fd watching the directories of mapped files, -1 if not used
+    int m_inotifyFd;
+
+    //! Directories watched with m_inotifyFd
+    set<string> m_watchedDirs;
+
+    //! Time of the next stale booster check and recycling, 0 if not scheduled
+    int64_t m_staleCheckTime;
+    int64_t m_recycleTime;
+
+    //! Waiting boosters found stale and not yet recycled
+    set<pid_t> m_staleBoosterPids;
+
+    //! Launches served by boosters found stale
+    unsigned int m_staleLaunches;
+
+    //! Number of stale boosters restarted
+    unsigned int m_recycledBoosters;
+
+    //! Quiet period after a file change before checking boosters
+    static const int m_staleDebounceMs;
+
+    //! Respawn state of a booster type or signature booster
+    struct BoosterHealth
+    {
+        BoosterHealth() : failures(0), degradedUntil(0), probing(false) {}
+
+        //! Boosters that died in a row before launching anything
+        unsigned int failures;
+
+        //! Minimal boosters are started until this time, 0 if not degraded
+        int64_t degradedUntil;
+
+        //! True if a full booster is tried after a degraded period
+        bool probing;
+    };
+
+    //! Respawn state by booster socket id
+    typedef map<string, BoosterHealth> BoosterHealthMap;
+    BoosterHealthMap m_boosterHealth;
+
+    //! Failures in a row before only minimal boosters are started
+    static const unsigned int m_maxBoosterFailures;
+
+    //! How long minimal boosters are started before retrying
+    static const int m_degradedPeriodMs;
+
+    //! Upper limit of the respawn backoff in seconds
+    static const int m_maxRespawnBackoff;
+
+    //! Launched application, its launch time and cgroup
+    struct LaunchedApp
+    {
+        string app;
+        int64_t launchTime;
+        string cgroup;
+    };
+
+    //! Launched applications by pid
+    typedef map<pid_t, LaunchedApp> LaunchedAppMap;
+    LaunchedAppMap m_launchedApps;
+
+    //! Crash counts of applications, shared with the boosters
+    LaunchThrottle * m_launchThrottle;
+
+    //! Duration of the launch boost (--launch-boost=MS), 0 if disabled
+    int m_launchBoostMs;
+
+    //! Boosters respawned before this time preload at the lowest priority
+    int64_t m_launchBoostUntil;
+
+    //! Boosted application, see LaunchReport
+    struct LaunchBoost
+    {
+        int64_t until;
+        uint32_t boost;
+        int boostNice;
+        int nice;
+        uint32_t uclampMin;
+        int autogroupNice;
+    };
+
+    //! Boosted applications by pid
+    typedef map<pid_t, LaunchBoost> LaunchBoostMap;
+    LaunchBoostMap m_launchBoosts;
+
+    //! Number of launches boosted
+    unsigned int m_boostedLaunches;
+
+    //! Directory of launch profiles (--profiles=DIR)
+    string m_profileDir;
+
+    //! Launch profiles shared with the boosters, NULL if not used
+    AppProfiles * m_appProfiles;
+
+    //! inotify fd watching m_profileDir, -1 if not used
+    int m_profileWatchFd;
+
+    //! Readiness status pages by booster socket id
+    typedef map<string, booster_status *> BoosterStatusMap;
+    BoosterStatusMap m_boosterStatus;
+
+    //! Exits within this time after launch count as crash loops
+    static const int m_crashWindowMs;
+
+    //! Time between restarting two stale boosters
+    static const int m_staleRecycleIntervalMs;
+
+    //! Listening control socket, -1 if not created
+    int m_controlSocket;
+
+    //! Connected control clients
+    set<int> m_controlClients;
+
+    //! Running or starting single instance application
+    struct SingleInstanceApp
+    {
+        //! Application pid, 0 while reserved for a starting instance
+        pid_t pid;
+
+        //! Process the name is reserved for
+        pid_t invokerPid;
+
+        //! Time of the reservation
+        int64_t reservedAt;
+    };
+
+    //! Single instance applications by name
+    typedef map<string, SingleInstanceApp> SingleInstanceMap;
+    SingleInstanceMap m_singleInstanceApps;
+
+    //! Reservations not followed by a launch in this time expire
+    static const int m_instanceReservationMs;
+
+    //! Single instance launches answered without a booster
+    unsigned int m_instanceActivations;
+
+    //! Requests waiting for a starting instance
+    typedef list<InstanceRequest> InstanceRequestList;
+    InstanceRequestList m_instanceRequests;
+
+    //! Interval of checking whether the launch of a waited instance
+    //! was given up, e.g. because its invoker died
+    static const int m_instancePollMs;
+
+    //! Applications launched for activation requests by application id
+    typedef map<string, pid_t> ActivatedAppMap;
+    ActivatedAppMap m_activatedApps;
+
+    //! Applications launched for activation requests
+    unsigned int m_activations;
+
+    //! Activations of batch requests waiting for a booster
+    typedef list<Activation> ActivationList;
+    ActivationList m_pendingActivations;
+
+    //! Time a booster taking an activation has to answer, the launcher
+    //! doesn't block longer in its main loop
+    static const int m_activationTimeoutMs;
+
+    //! Launch shared by identical invocations
+    struct SharedLaunch
+    {
+        //! launchKey() of the launch
+        string key;
+
+        string exec;
+
+        //! Control connection of the process launching the application,
+        //! -1 once it has reported the result
+        int fd;
+
+        //! Process launching the application
+        pid_t invokerPid;
+
+        //! Application pid, 0 until launched
+        pid_t pid;
+
+        //! Time the launch started
+        int64_t startedAt;
+
+        //! True if the process launching the application failed
+        bool failed;
+
+        //! Control connections of the coalesced launches
+        vector<int> waiters;
+    };
+
+    //! Launches started within the coalescing window or still shared
+    typedef list<SharedLaunch> SharedLaunchList;
+    SharedLaunchList m_sharedLaunches;
+
+    //! Identical launches within this time share one application, 0 to
+    //! disable (--coalesce-window=MS)
+    int m_coalesceWindowMs;
+
+    //! A shared launch not launched in this time failed, the processes
+    //! sharing it launch by themselves. Covers the default --max-wait.
+    static const int m_sharedLaunchTimeoutMs;
+
+    //! Launches that shared the application of an identical launch
+    unsigned int m_coalescedLaunches;
+
+    //! Background launch waiting for a booster
+    struct BackgroundLaunch
+    {
+        //! Control connection to answer
+        int fd;
+
+        //! Booster socket id
+        string slot;
+
+        int64_t queuedAt;
+
+        //! Time after which the launch is executed directly, 0 if it
+        //! waits for the booster
+        int64_t maxWaitMs;
+    };
+
+    //! Background launches in the order of arrival
+    typedef list<BackgroundLaunch> BackgroundLaunchList;
+    BackgroundLaunchList m_backgroundLaunches;
+
+    //! Background launch state of a booster socket id
+    struct BackgroundSlot
+    {
+        BackgroundSlot() : admittedBooster(0), admittedAt(0), busySince(0) {}
+
+        //! Booster last given to a background launch and when
+        pid_t admittedBooster;
+        int64_t admittedAt;
+
+        //! Time the booster was seen ready with interactive launches
+        //! connecting, 0 if not
+        int64_t busySince;
+    };
+
+    typedef map<string, BackgroundSlot> BackgroundSlotMap;
+    BackgroundSlotMap m_backgroundSlots;
+
+    //! Background launches that waited for interactive launches
+    unsigned int m_deferredBackgroundLaunches;
+
+    //! Background launches executed directly as no booster got free
+    unsigned int m_expiredBackgroundLaunches;
+
+    //! A booster given to a background launch is not given to another
+    //! one within this time
+    static const int m_admissionHoldMs;
 
-    //! Name of the state saving directory and file
-    static const std::string m_stateDir;
-    static const std::string m_stateFile;
+    //! Interactive launches counted this long while their booster is
+    //! ready are from invokers that died while connecting
+    static const int m_interactiveStaleMs;
 
 #ifdef UNIT_TEST
     friend class Ut_Daemon;
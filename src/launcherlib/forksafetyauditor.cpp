@@ -0,0 +1,225 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "forksafetyauditor.h"
+#include "logger.h"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <cstdio>
+#include <climits>
+#include <dirent.h>
+#include <dlfcn.h>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+// Peer of the socket opened by syslog(). The logger may open it at any time.
+static const char * const SYSLOG_SOCKET_PATH = "/dev/log";
+
+ForkSafetyAuditor::ForkSafetyAuditor()
+{
+    m_baseline.threads = 1;
+    m_baseline.locks   = 0;
+}
+
+void ForkSafetyAuditor::takeBaseline()
+{
+    m_baseline = currentState();
+}
+
+bool ForkSafetyAuditor::audit(const string & context) const
+{
+    const State state = currentState();
+    bool ok = true;
+
+    if (state.threads > m_baseline.threads)
+    {
+        Logger::logWarning("ForkSafetyAuditor: %s: %d thread(s) started",
+                           context.c_str(), state.threads - m_baseline.threads);
+        ok = false;
+    }
+
+    if (state.locks > m_baseline.locks)
+    {
+        Logger::logWarning("ForkSafetyAuditor: %s: %d file lock(s) taken",
+                           context.c_str(), state.locks - m_baseline.locks);
+        ok = false;
+    }
+
+    for (set<int>::const_iterator it = state.fds.begin(); it != state.fds.end(); it++)
+    {
+        if (m_baseline.fds.count(*it))
+            continue;
+
+        std::stringstream link;
+        link << "/proc/self/fd/" << *it;
+
+        char target[PATH_MAX];
+        ssize_t len = readlink(link.str().c_str(), target, sizeof(target) - 1);
+        target[len < 0 ? 0 : len] = '\0';
+
+        if (isSyslogSocket(*it))
+            continue;
+
+        if (isConnectedSocket(*it))
+        {
+            Logger::logWarning("ForkSafetyAuditor: %s: connected socket (fd=%d, %s)",
+                               context.c_str(), *it, target);
+        }
+        else
+        {
+            Logger::logWarning("ForkSafetyAuditor: %s: file descriptor left open (fd=%d, %s)",
+                               context.c_str(), *it, target);
+        }
+
+        ok = false;
+    }
+
+    return ok;
+}
+
+bool ForkSafetyAuditor::probeLibrary(const string & path, int flags)
+{
+    pid_t pid = fork();
+    if (pid == -1)
+    {
+        Logger::logError("ForkSafetyAuditor: Couldn't fork to probe '%s'", path.c_str());
+        return false;
+    }
+
+    if (pid == 0)
+    {
+        ForkSafetyAuditor auditor;
+        auditor.takeBaseline();
+
+        // Failing to load is reported by the caller
+        if (!dlopen(path.c_str(), flags))
+            _exit(EXIT_SUCCESS);
+
+        _exit(auditor.audit(path) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR);
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS;
+}
+
+ForkSafetyAuditor::State ForkSafetyAuditor::currentState()
+{
+    State state;
+    state.threads = threadCount();
+    state.locks   = lockCount();
+
+    DIR * dir = opendir("/proc/self/fd");
+    if (dir)
+    {
+        const int ownFd = dirfd(dir);
+        struct dirent * entry;
+        while ((entry = readdir(dir)) != NULL)
+        {
+            if (entry->d_name[0] == '.')
+                continue;
+
+            const int fd = atoi(entry->d_name);
+            if (fd != ownFd)
+                state.fds.insert(fd);
+        }
+
+        closedir(dir);
+    }
+
+    return state;
+}
+
+int ForkSafetyAuditor::threadCount()
+{
+    int count = 0;
+
+    DIR * dir = opendir("/proc/self/task");
+    if (dir)
+    {
+        struct dirent * entry;
+        while ((entry = readdir(dir)) != NULL)
+        {
+            if (entry->d_name[0] != '.')
+                count++;
+        }
+
+        closedir(dir);
+    }
+
+    return count;
+}
+
+int ForkSafetyAuditor::lockCount()
+{
+    // Lines look like "1: POSIX  ADVISORY  WRITE 1234 08:01:5678 0 EOF".
+    // Lines of blocked requests have an additional "->" token.
+    std::ifstream locks("/proc/locks");
+    const pid_t pid = getpid();
+    int count = 0;
+
+    string line;
+    while (std::getline(locks, line))
+    {
+        std::istringstream ss(line);
+        string id, type, mode, access;
+        pid_t owner = 0;
+
+        ss >> id >> type;
+        if (type == "->")
+            continue;
+
+        ss >> mode >> access >> owner;
+        if (owner == pid)
+            count++;
+    }
+
+    return count;
+}
+
+bool ForkSafetyAuditor::isConnectedSocket(int fd)
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISSOCK(st.st_mode))
+        return false;
+
+    struct sockaddr_un peer;
+    socklen_t len = sizeof(peer);
+    return getpeername(fd, reinterpret_cast<struct sockaddr *>(&peer), &len) == 0;
+}
+
+bool ForkSafetyAuditor::isSyslogSocket(int fd)
+{
+    struct sockaddr_un peer;
+    socklen_t len = sizeof(peer);
+    memset(&peer, 0, sizeof(peer));
+    if (getpeername(fd, reinterpret_cast<struct sockaddr *>(&peer), &len) != 0)
+        return false;
+
+    return peer.sun_family == AF_UNIX && strcmp(peer.sun_path, SYSLOG_SOCKET_PATH) == 0;
+}
@@ -0,0 +1,99 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef FORKSAFETYAUDITOR_H
+#define FORKSAFETYAUDITOR_H
+
+#include "launcherlib.h"
+
+#include <set>
+
+using std::set;
+
+#include <string>
+
+using std::string;
+
+/*!
+ * \class ForkSafetyAuditor
+ * \brief Checks that the booster process can still be safely forked.
+ *
+ * Threads, file locks and connected sockets don't survive fork() in a
+ * usable state. The auditor compares the current state of the process
+ * against a baseline and reports threads, file descriptors, file locks
+ * and connected sockets that have appeared since.
+ */
+class DECL_EXPORT ForkSafetyAuditor
+{
+public:
+
+    //! Constructor
+    ForkSafetyAuditor();
+
+    //! Store the current state of the process as the expected state.
+    void takeBaseline();
+
+    /*!
+     * \brief Compare the current state of the process against the baseline.
+     * Violations are logged as warnings.
+     * \param context Name of the audited step used in the log messages.
+     * \return true if the process is still in the expected state.
+     */
+    bool audit(const string & context) const;
+
+    /*!
+     * \brief Check if loading a library keeps the process fork safe.
+     * The library is dlopen()'d and audited in a forked child process,
+     * so the calling process is not affected.
+     * \param path Path of the library.
+     * \param flags Flags passed to dlopen().
+     * \return false if the library violates fork safety.
+     */
+    static bool probeLibrary(const string & path, int flags);
+
+private:
+
+    //! Snapshot of the fork-relevant state of the process
+    struct State
+    {
+        int threads;
+        set<int> fds;
+        int locks;
+    };
+
+    //! Read the current state of the process from /proc.
+    static State currentState();
+
+    //! Return the number of threads in the process.
+    static int threadCount();
+
+    //! Return the number of file locks held by the process.
+    static int lockCount();
+
+    //! Return true if fd is a socket connected to a peer.
+    static bool isConnectedSocket(int fd);
+
+    //! Return true if fd is the connection to syslog.
+    static bool isSyslogSocket(int fd);
+
+    //! State stored by takeBaseline()
+    State m_baseline;
+};
+
+#endif // FORKSAFETYAUDITOR_H
@@ -0,0 +1,121 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "launchthrottle.h"
+#include "logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "coverage.h"
+
+LaunchThrottle::LaunchThrottle(const string & path) :
+    m_table(NULL)
+{
+    // An existing table is reused after re-exec, the waiting boosters
+    // still map it
+    int fd = open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd == -1 || ftruncate(fd, TABLE_SIZE * sizeof(Entry)) == -1)
+    {
+        Logger::logError("LaunchThrottle: Couldn't create '%s': %s", path.c_str(), strerror(errno));
+        if (fd != -1)
+            close(fd);
+        return;
+    }
+
+    // Shared with the boosters forked after this
+    void * table = mmap(NULL, TABLE_SIZE * sizeof(Entry), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if (table == MAP_FAILED)
+        Logger::logError("LaunchThrottle: Couldn't map '%s': %s", path.c_str(), strerror(errno));
+    else
+        m_table = static_cast<Entry *>(table);
+}
+
+LaunchThrottle::~LaunchThrottle()
+{
+    if (m_table)
+        munmap(m_table, TABLE_SIZE * sizeof(Entry));
+}
+
+uint32_t LaunchThrottle::hashOf(const string & app)
+{
+    // FNV-1a, never 0 which marks a free entry
+    uint32_t hash = 2166136261u;
+    for (string::const_iterator it = app.begin(); it != app.end(); it++)
+        hash = (hash ^ static_cast<unsigned char>(*it)) * 16777619u;
+
+    return hash ? hash : 1;
+}
+
+LaunchThrottle::Entry * LaunchThrottle::entry(uint32_t hash, bool add) const
+{
+    if (!m_table)
+        return NULL;
+
+    // Entries are never freed, so a free entry ends the probe sequence
+    Entry * reusable = NULL;
+    unsigned int slot = hash % TABLE_SIZE;
+    for (unsigned int i = 0; i < TABLE_SIZE; i++)
+    {
+        Entry * e = &m_table[slot];
+        if (e->hash == hash)
+            return e;
+
+        if (!reusable && (!e->hash || !e->crashes))
+            reusable = e;
+
+        if (!e->hash)
+            break;
+
+        slot = (slot + 1) % TABLE_SIZE;
+    }
+
+    if (!add || !reusable)
+        return NULL;
+
+    reusable->hash    = hash;
+    reusable->crashes = 0;
+    return reusable;
+}
+
+unsigned int LaunchThrottle::addExit(const string & app, bool crashed)
+{
+    Entry * e = entry(hashOf(app), crashed);
+    if (!e)
+        return 0;
+
+    e->crashes = crashed ? e->crashes + 1 : 0;
+    return e->crashes;
+}
+
+int LaunchThrottle::delayMs(const string & app) const
+{
+    const Entry * e = entry(hashOf(app), false);
+    if (!e || e->crashes < MIN_CRASHES)
+        return 0;
+
+    // 1 s at MIN_CRASHES, doubled for every further crash
+    const unsigned int shift = e->crashes - MIN_CRASHES;
+    return shift < 5 ? 1000 << shift : MAX_DELAY_MS;
+}
@@ -0,0 +1,103 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef LAUNCHTHROTTLE_H
+#define LAUNCHTHROTTLE_H
+
+#include "launcherlib.h"
+
+#include <string>
+
+using std::string;
+
+#include <stdint.h>
+
+/*!
+ * \class LaunchThrottle
+ * \brief Slows down launches of applications that crash right after start.
+ *
+ * The launcher records how many times in a row each application crashed
+ * shortly after being launched. The counts live in a file mapped by the
+ * launcher and inherited by the boosters, which delay launches of crash
+ * looping applications. The file is mapped again after re-exec, so the
+ * counts survive it and boosters kept over it share them. The table is a fixed size hash table indexed by
+ * the application path with linear probing. Entries of applications that
+ * stopped crashing are reused; crashes are not counted while the table is
+ * full of crashing applications.
+ */
+class DECL_EXPORT LaunchThrottle
+{
+public:
+
+    //! Constructor, maps the table at path creating it if needed
+    explicit LaunchThrottle(const string & path);
+
+    //! Destructor
+    ~LaunchThrottle();
+
+    /*!
+     * \brief Record how a launched application exited.
+     * \param app Path of the application.
+     * \param crashed True if it died abnormally shortly after launch.
+     * \return The number of crashes in a row.
+     */
+    unsigned int addExit(const string & app, bool crashed);
+
+    //! Return the delay to apply before launching app in milliseconds.
+    int delayMs(const string & app) const;
+
+    //! Crashes in a row before launches are delayed
+    static const unsigned int MIN_CRASHES = 3;
+
+private:
+
+    //! Disable copy-constructor
+    LaunchThrottle(const LaunchThrottle & r);
+
+    //! Disable assignment operator
+    LaunchThrottle & operator= (const LaunchThrottle & r);
+
+    struct Entry
+    {
+        uint32_t hash;
+        uint32_t crashes;
+    };
+
+    /*!
+     * \brief Find the entry of the application.
+     * \param hash Hash of the application path.
+     * \param add Take a free or reusable entry if there is none.
+     * \return The entry or NULL.
+     */
+    Entry * entry(uint32_t hash, bool add) const;
+
+    //! Hash of the application path
+    static uint32_t hashOf(const string & app);
+
+    //! Number of entries in the table
+    static const unsigned int TABLE_SIZE = 256;
+
+    //! Upper limit of the launch delay
+    static const int MAX_DELAY_MS = 30000;
+
+    //! Shared table, NULL if mapping failed
+    Entry * m_table;
+};
+
+#endif // LAUNCHTHROTTLE_H
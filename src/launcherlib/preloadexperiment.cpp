@@ -0,0 +1,123 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "preloadexperiment.h"
+#include "logger.h"
+
+#include <cmath>
+
+const double PreloadExperiment::MIN_T = 3.0;
+
+PreloadExperiment::Stats::Stats() :
+    n(0),
+    mean(0),
+    m2(0)
+{}
+
+void PreloadExperiment::Stats::add(double value)
+{
+    n++;
+    double delta = value - mean;
+    mean += delta / n;
+    m2 += delta * (value - mean);
+}
+
+double PreloadExperiment::Stats::variance() const
+{
+    return n > 1 ? m2 / (n - 1) : 0;
+}
+
+PreloadExperiment::PreloadExperiment() :
+    m_lastVariant(NUM_VARIANTS - 1),
+    m_winner(-1)
+{}
+
+int PreloadExperiment::nextVariant()
+{
+    if (m_winner != -1)
+        return m_winner;
+
+    m_lastVariant = (m_lastVariant + 1) % NUM_VARIANTS;
+    return m_lastVariant;
+}
+
+void PreloadExperiment::addSample(int variant, uint32_t timeToMainUs, uint32_t rssKb, uint32_t pssKb)
+{
+    if (variant < 0 || variant >= NUM_VARIANTS)
+        return;
+
+    m_latency[variant].add(timeToMainUs);
+    m_rss[variant].add(rssKb);
+    m_pss[variant].add(pssKb);
+
+    if (m_winner != -1)
+        return;
+
+    for (int i = 0; i < NUM_VARIANTS; i++)
+    {
+        if (m_latency[i].n < MIN_SAMPLES)
+            return;
+    }
+
+    if (std::fabs(latencyT()) >= MIN_T)
+    {
+        m_winner = m_latency[0].mean <= m_latency[1].mean ? 0 : 1;
+
+        Logger::logInfo("PreloadExperiment: variant %c wins, using it for all boosters",
+                        'A' + m_winner);
+        logSummary();
+    }
+}
+
+int PreloadExperiment::winner() const
+{
+    return m_winner;
+}
+
+void PreloadExperiment::setWinner(int variant)
+{
+    if (variant >= 0 && variant < NUM_VARIANTS)
+        m_winner = variant;
+}
+
+double PreloadExperiment::latencyT() const
+{
+    double se = std::sqrt(m_latency[0].variance() / m_latency[0].n +
+                          m_latency[1].variance() / m_latency[1].n);
+
+    if (se == 0)
+        return 0;
+
+    return (m_latency[0].mean - m_latency[1].mean) / se;
+}
+
+void PreloadExperiment::logSummary() const
+{
+    for (int i = 0; i < NUM_VARIANTS; i++)
+    {
+        Logger::logInfo("PreloadExperiment: variant %c: %u launches, "
+                        "time to main %.0f us (sd %.0f), RSS %.0f kB, PSS %.0f kB",
+                        'A' + i, m_latency[i].n, m_latency[i].mean,
+                        std::sqrt(m_latency[i].variance()),
+                        m_rss[i].mean, m_pss[i].mean);
+    }
+
+    if (m_latency[0].n > 1 && m_latency[1].n > 1)
+        Logger::logInfo("PreloadExperiment: latency t = %.2f", latencyT());
+}
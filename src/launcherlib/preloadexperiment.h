@@ -0,0 +1,103 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef PRELOADEXPERIMENT_H
+#define PRELOADEXPERIMENT_H
+
+#include "launcherlib.h"
+
+#include <stdint.h>
+
+/*!
+ * \class PreloadExperiment
+ * \brief Compares two preload variants on live launches.
+ *
+ * Boosters are started alternately with preload variant A (0) and
+ * B (1). Launch latency (time to main()) and memory usage reported by
+ * the boosters are accumulated per variant. Once both variants have
+ * enough samples and the latency difference is significant, the
+ * variant with the lower mean latency is declared the winner and all
+ * further boosters use it.
+ */
+class DECL_EXPORT PreloadExperiment
+{
+public:
+
+    //! Number of compared variants
+    static const int NUM_VARIANTS = 2;
+
+    //! Constructor
+    PreloadExperiment();
+
+    //! Return the variant the next booster should be started with.
+    int nextVariant();
+
+    /*!
+     * \brief Add launch statistics reported by a booster.
+     * \param variant Preload variant of the booster.
+     * \param timeToMainUs Time from accepting the invocation to main().
+     * \param rssKb Resident set size before main().
+     * \param pssKb Proportional set size before main().
+     */
+    void addSample(int variant, uint32_t timeToMainUs, uint32_t rssKb, uint32_t pssKb);
+
+    //! Return the winning variant or -1 if the experiment is still running.
+    int winner() const;
+
+    //! Use variant found by an earlier run without experimenting.
+    void setWinner(int variant);
+
+    //! Log mean latency and memory usage of both variants.
+    void logSummary() const;
+
+private:
+
+    //! Running mean and variance (Welford's algorithm)
+    struct Stats
+    {
+        Stats();
+        void add(double value);
+        double variance() const;
+
+        unsigned int n;
+        double mean;
+        double m2;
+    };
+
+    //! Welch's t statistic of the latency difference between the variants.
+    double latencyT() const;
+
+    //! Samples needed from both variants before a winner can be declared
+    static const unsigned int MIN_SAMPLES = 30;
+
+    //! Minimum absolute t statistic for a significant difference
+    static const double MIN_T;
+
+    Stats m_latency[NUM_VARIANTS];
+    Stats m_rss[NUM_VARIANTS];
+    Stats m_pss[NUM_VARIANTS];
+
+    //! Variant given to the previous booster
+    int m_lastVariant;
+
+    //! Winning variant, -1 if not decided
+    int m_winner;
+};
+
+#endif // PRELOADEXPERIMENT_H
@@ -0,0 +1,265 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#include "savedstate.h"
+#include "logger.h"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "coverage.h"
+
+namespace
+{
+    const char STATE_MAGIC[4] = { 'A', 'L', 'S', 'T' };
+
+    struct StateHeader
+    {
+        char     magic[4];
+        uint16_t major;
+        uint16_t minor;
+        uint32_t size;
+        uint32_t checksum;
+    };
+
+    struct RecordHeader
+    {
+        uint16_t tag;
+        uint16_t reserved;
+        uint32_t length;
+    };
+
+    const int REQUIRED_SEALS = F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE;
+
+    string intValue(int32_t value)
+    {
+        return string(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+}
+
+int32_t SavedState::Record::intAt(unsigned int index, int32_t defaultValue) const
+{
+    int32_t result = defaultValue;
+    if ((index + 1) * sizeof(int32_t) <= value.size())
+        memcpy(&result, value.data() + index * sizeof(int32_t), sizeof(int32_t));
+
+    return result;
+}
+
+string SavedState::Record::text(unsigned int ints) const
+{
+    const size_t offset = ints * sizeof(int32_t);
+    return offset < value.size() ? value.substr(offset) : string();
+}
+
+void SavedState::add(uint16_t tag, int32_t value)
+{
+    addRecord(tag, intValue(value));
+}
+
+void SavedState::add(uint16_t tag, int32_t first, int32_t second)
+{
+    addRecord(tag, intValue(first) + intValue(second));
+}
+
+void SavedState::add(uint16_t tag, int32_t value, const string & text)
+{
+    addRecord(tag, intValue(value) + text);
+}
+
+void SavedState::add(uint16_t tag, const string & text)
+{
+    addRecord(tag, text);
+}
+
+void SavedState::add(uint16_t tag, const vector<int32_t> & values, const string & text)
+{
+    string value;
+    for (vector<int32_t>::const_iterator it = values.begin(); it != values.end(); it++)
+        value += intValue(*it);
+
+    addRecord(tag, value + text);
+}
+
+void SavedState::addRecord(uint16_t tag, const string & value)
+{
+    RecordHeader header;
+    header.tag = tag;
+    header.reserved = 0;
+    header.length = value.size();
+
+    m_data.append(reinterpret_cast<const char *>(&header), sizeof(header));
+    m_data.append(value);
+}
+
+uint32_t SavedState::checksum(const string & data)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    for (string::const_iterator it = data.begin(); it != data.end(); it++)
+        hash = (hash ^ static_cast<unsigned char>(*it)) * 16777619u;
+
+    return hash;
+}
+
+int SavedState::writeToMemfd() const
+{
+    StateHeader header;
+    memcpy(header.magic, STATE_MAGIC, sizeof(header.magic));
+    header.major = MAJOR_VERSION;
+    header.minor = MINOR_VERSION;
+    header.size = m_data.size();
+    header.checksum = checksum(m_data);
+
+    const string blob = string(reinterpret_cast<const char *>(&header), sizeof(header)) + m_data;
+
+    // Not close-on-exec, the re-executed launcher reads it
+    int fd = memfd_create("applauncherd-state", MFD_ALLOW_SEALING);
+    if (fd == -1)
+    {
+        Logger::logError("SavedState: memfd_create() failed: %s", strerror(errno));
+        return -1;
+    }
+
+    size_t written = 0;
+    while (written < blob.size())
+    {
+        ssize_t ret = write(fd, blob.data() + written, blob.size() - written);
+        if (ret == -1 && errno == EINTR)
+            continue;
+
+        if (ret <= 0)
+        {
+            Logger::logError("SavedState: failed to write state: %s", strerror(errno));
+            close(fd);
+            return -1;
+        }
+
+        written += ret;
+    }
+
+    if (fcntl(fd, F_ADD_SEALS, REQUIRED_SEALS | F_SEAL_SEAL) == -1)
+    {
+        Logger::logError("SavedState: failed to seal state: %s", strerror(errno));
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
+
+bool SavedState::readFromFd(int fd)
+{
+    m_records.clear();
+
+    // Only trust a state nobody can modify after validation
+    int seals = fcntl(fd, F_GET_SEALS);
+    if (seals == -1 || (seals & REQUIRED_SEALS) != REQUIRED_SEALS)
+    {
+        Logger::logError("SavedState: state fd %d is not a sealed memfd", fd);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) == -1 || st.st_size < static_cast<off_t>(sizeof(StateHeader)))
+    {
+        Logger::logError("SavedState: state is truncated");
+        return false;
+    }
+
+    void * map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED)
+    {
+        Logger::logError("SavedState: failed to map state: %s", strerror(errno));
+        return false;
+    }
+
+    const char * data = static_cast<const char *>(map);
+    StateHeader header;
+    memcpy(&header, data, sizeof(header));
+
+    bool valid = false;
+    if (memcmp(header.magic, STATE_MAGIC, sizeof(header.magic)) != 0)
+    {
+        Logger::logError("SavedState: bad state magic");
+    }
+    else if (header.major != MAJOR_VERSION)
+    {
+        Logger::logError("SavedState: unsupported state version %u.%u",
+                         header.major, header.minor);
+    }
+    else if (header.size != st.st_size - sizeof(header))
+    {
+        Logger::logError("SavedState: state size mismatch");
+    }
+    else if (header.checksum != checksum(string(data + sizeof(header), header.size)))
+    {
+        Logger::logError("SavedState: state checksum mismatch");
+    }
+    else
+    {
+        valid = true;
+
+        const char * pos = data + sizeof(header);
+        const char * end = pos + header.size;
+        while (pos < end)
+        {
+            RecordHeader recordHeader;
+            if (static_cast<size_t>(end - pos) < sizeof(recordHeader))
+            {
+                valid = false;
+                break;
+            }
+
+            memcpy(&recordHeader, pos, sizeof(recordHeader));
+            pos += sizeof(recordHeader);
+
+            if (static_cast<size_t>(end - pos) < recordHeader.length)
+            {
+                valid = false;
+                break;
+            }
+
+            Record record;
+            record.tag = recordHeader.tag;
+            record.value.assign(pos, recordHeader.length);
+            m_records.push_back(record);
+
+            pos += recordHeader.length;
+        }
+
+        if (!valid)
+        {
+            Logger::logError("SavedState: truncated state record");
+            m_records.clear();
+        }
+    }
+
+    munmap(map, st.st_size);
+    return valid;
+}
+
+const SavedState::RecordVect & SavedState::records() const
+{
+    return m_records;
+}
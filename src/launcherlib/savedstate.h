@@ -0,0 +1,132 @@
+/***************************************************************************
+**
+** Copyright (C) 2010 Nokia Corporation and/or its subsidiary(-ies).
+** All rights reserved.
+** Contact: Nokia Corporation (directui@nokia.com)
+**
+** This file is part of applauncherd
+**
+** If you have questions regarding the use of this file, please contact
+** Nokia at directui@nokia.com.
+**
+** This library is free software; you can redistribute it and/or
+** modify it under the terms of the GNU Lesser General Public
+** License version 2.1 as published by the Free Software Foundation
+** and appearing in the file LICENSE.LGPL included in the packaging
+** of this file.
+**
+****************************************************************************/
+
+#ifndef SAVEDSTATE_H
+#define SAVEDSTATE_H
+
+#include "launcherlib.h"
+
+#include <string>
+
+using std::string;
+
+#include <vector>
+
+using std::vector;
+
+#include <stdint.h>
+
+/*!
+ * \class SavedState
+ * \brief Launcher state handed over to the re-executed launcher.
+ *
+ * The state is a list of tagged records serialized into a memfd that is
+ * sealed against modification and inherited over execve(). The blob
+ * starts with a header holding a magic, the format version, the size of
+ * the records and their checksum. A record value is a sequence of 32-bit
+ * integers, optionally followed by a string.
+ *
+ * Readers skip records with unknown tags and ignore trailing data in
+ * known records, so fields can be added without changing the major
+ * version. Fields missing from a record read as their default value.
+ */
+class DECL_EXPORT SavedState
+{
+public:
+
+    //! Record tags. Never renumber or reuse a tag.
+    enum Tag
+    {
+        PID = 1,             //!< pid of the saving launcher
+        DEBUG_MODE,          //!< debug mode flag
+        CHILD,               //!< child pid
+        BOOSTER_INVOKER_PID, //!< booster pid, invoker pid
+        BOOSTER_INVOKER_FD,  //!< booster pid, invoker socket fd
+        BOOSTER_PID,         //!< waiting booster pid, booster type
+        LAUNCHER_SOCKET,     //!< booster <-> launcher socket pair
+        SIGPIPE_FD,          //!< signal pipe
+        BOOT_MODE,           //!< boot mode flag
+        SOCKET_HASH,         //!< invoker socket fd, socket id
+        BINARY_FINGERPRINT,  //!< fingerprint of the loaded binaries
+        CONFIG_FINGERPRINT,  //!< fingerprint of the booster configuration
+        SINGLE_INSTANCE_APP, //!< single instance application pid, name
+        WAIT_STATUS_PID,     //!< pid whose invoker gets the wait status
+        ACTIVATED_APP,       //!< activated application pid, application id
+        LAUNCHED_APP,        //!< application pid, ms since launch, path '\0' cgroup
+        LAUNCH_BOOST         //!< boosted pid, ms left, boost, its nice, nice, uclamp, autogroup nice
+    };
+
+    //! Record read from a saved state
+    struct Record
+    {
+        uint16_t tag;
+        string value;
+
+        //! Return the integer at index or defaultValue if the record is shorter
+        int32_t intAt(unsigned int index, int32_t defaultValue = 0) const;
+
+        //! Return the string following the given number of integers
+        string text(unsigned int ints) const;
+    };
+
+    typedef vector<Record> RecordVect;
+
+    //! Append a record of integers and an optional string
+    void add(uint16_t tag, int32_t value);
+    void add(uint16_t tag, int32_t first, int32_t second);
+    void add(uint16_t tag, int32_t value, const string & text);
+    void add(uint16_t tag, const string & text);
+    void add(uint16_t tag, const vector<int32_t> & values, const string & text = string());
+
+    /*!
+     * \brief Write the state into a new sealed memfd.
+     * \return The memfd, not closed on exec, or -1 on error.
+     */
+    int writeToMemfd() const;
+
+    /*!
+     * \brief Read and validate a state written by writeToMemfd().
+     * \param fd The memfd. It is not closed.
+     * \return true if the state is valid, records() is filled.
+     */
+    bool readFromFd(int fd);
+
+    //! Return the records read by readFromFd()
+    const RecordVect & records() const;
+
+private:
+
+    //! Append a record of the given value
+    void addRecord(uint16_t tag, const string & value);
+
+    //! Checksum of the serialized records
+    static uint32_t checksum(const string & data);
+
+    //! Version written to the header. Readers reject other major versions.
+    static const uint16_t MAJOR_VERSION = 1;
+    static const uint16_t MINOR_VERSION = 0;
+
+    //! Serialized records to be written
+    string m_data;
+
+    //! Records read from a memfd
+    RecordVect m_records;
+};
+
+#endif // SAVEDSTATE_H
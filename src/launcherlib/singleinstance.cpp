@@ -61,6 +61,20 @@ bool SingleInstance::validateAndRegisterPlugin(void * handle)
     m_pluginEntry->unlockFunc = unlock;
     m_pluginEntry->activateExistingInstanceFunc = activateExistingInstance;
 
+    // Asynchronous activation is optional, all four are needed
+    m_pluginEntry->queueActivationFunc = (activate_func_t)dlsym(handle, "queueActivation");
+    m_pluginEntry->activationFdFunc = (activation_fd_func_t)dlsym(handle, "activationFd");
+    m_pluginEntry->processActivationsFunc = (process_activations_func_t)dlsym(handle, "processActivations");
+    m_pluginEntry->closeActivationsFunc = (process_activations_func_t)dlsym(handle, "closeActivations");
+    if (!m_pluginEntry->queueActivationFunc || !m_pluginEntry->activationFdFunc ||
+        !m_pluginEntry->processActivationsFunc || !m_pluginEntry->closeActivationsFunc)
+    {
+        m_pluginEntry->queueActivationFunc = NULL;
+        m_pluginEntry->activationFdFunc = NULL;
+        m_pluginEntry->processActivationsFunc = NULL;
+        m_pluginEntry->closeActivationsFunc = NULL;
+    }
+
     return true;
 }
 
@@ -34,6 +34,12 @@ typedef void (*unlock_func_t)();
 // Function pointer type for activateExistingInstance(const char * binaryName)
 typedef bool (*activate_func_t)(const char *);
 
+// Function pointer type for activationFd(bool * wantWrite)
+typedef int (*activation_fd_func_t)(bool *);
+
+// Function pointer type for processActivations()
+typedef void (*process_activations_func_t)();
+
 //! Single instance plugin entry
 struct SingleInstancePluginEntry
 {
@@ -46,6 +52,18 @@ struct SingleInstancePluginEntry
     //! Activate existing instance
     activate_func_t activateExistingInstanceFunc;
 
+    //! Queue activation of existing instance, NULL if not supported
+    activate_func_t queueActivationFunc;
+
+    //! Fd of the activation connection, NULL if not supported
+    activation_fd_func_t activationFdFunc;
+
+    //! Write queued activations, NULL if not supported
+    process_activations_func_t processActivationsFunc;
+
+    //! Drop the activation connection in a forked child, NULL if not supported
+    process_activations_func_t closeActivationsFunc;
+
     //! Handle to the plugin
     void * handle;
 };
@@ -30,6 +30,7 @@
 #include <stdexcept>
 #include <errno.h>
 #include <sstream>
+#include <systemd/sd-daemon.h>
 
 SocketManager::SocketManager()
 {
@@ -48,6 +49,30 @@ SocketManager::SocketManager()
     }
 
     m_socketRootPath += '/';
+
+    // Listening sockets passed by systemd socket activation. Invokers
+    // connecting before the boosters are up queue on them.
+    const int count = sd_listen_fds(1);
+    for (int i = 0; i < count; i++)
+        m_activatedSockets.push_back(SD_LISTEN_FDS_START + i);
+
+    if (count > 0)
+        Logger::logDebug("SocketManager: %d sockets passed by systemd", count);
+}
+
+int SocketManager::takeActivatedSocket(const string & socketPath)
+{
+    for (vector<int>::iterator it = m_activatedSockets.begin(); it != m_activatedSockets.end(); it++)
+    {
+        if (sd_is_socket_unix(*it, SOCK_STREAM, 1, socketPath.c_str(), 0) > 0)
+        {
+            const int fd = *it;
+            m_activatedSockets.erase(it);
+            return fd;
+        }
+    }
+
+    return -1;
 }
 
 void SocketManager::initSocket(const string & socketId)
@@ -58,6 +83,15 @@ void SocketManager::initSocket(const string & socketId)
     // exist for that id / path.
     if (m_socketHash.find(socketId) == m_socketHash.end())
     {
+        // Use the socket bound by systemd if there is one for this path
+        const int activatedFd = takeActivatedSocket(socketPath);
+        if (activatedFd != -1)
+        {
+            Logger::logDebug("SocketManager: Using activated socket at '%s'", socketPath.c_str());
+            m_socketHash[socketId] = activatedFd;
+            return;
+        }
+
         Logger::logDebug("SocketManager: Initing socket at '%s'..", socketPath.c_str());
 
         // Create a new local socket
@@ -142,6 +176,17 @@ void SocketManager::closeAllSockets()
     m_socketHash.clear();
 }
 
+void SocketManager::closeActivatedSockets()
+{
+    for (vector<int>::iterator it = m_activatedSockets.begin(); it != m_activatedSockets.end(); it++)
+    {
+        Logger::logWarning("SocketManager: Closing socket (fd=%d) passed by systemd, no booster uses it", *it);
+        ::close(*it);
+    }
+
+    m_activatedSockets.clear();
+}
+
 int SocketManager::findSocket(const string & socketId)
 {
     SocketHash::iterator i(m_socketHash.find(socketId));
@@ -23,9 +23,11 @@
 #include "launcherlib.h"
 #include <map>
 #include <string>
+#include <vector>
 
 using std::map;
 using std::string;
+using std::vector;
 
 /*!
  * \class SocketManager
@@ -39,6 +41,8 @@ public:
     SocketManager();
 
     /*! \brief Initialize a file socket.
+     *  A listening socket passed by systemd socket activation is used
+     *  if it is bound to the path of the socket.
      *  \param socketId Path to the socket file.
      */
     void initSocket(const string & socketId);
@@ -51,6 +55,9 @@ public:
     //! \brief Close all open sockets.
     void closeAllSockets();
 
+    //! \brief Close the sockets passed by systemd that no booster uses.
+    void closeActivatedSockets();
+
     /*! \brief Return initialized socket.
      *  \param socketId Path to the socket file.
      *  \returns socket fd or -1 on failure.
@@ -76,8 +83,14 @@ public:
 
 private:
 
+    //! Remove and return the activated socket bound to the path, -1 if none
+    int takeActivatedSocket(const string & socketPath);
+
     SocketHash m_socketHash;
 
+    //! Sockets passed by systemd and not taken by initSocket()
+    vector<int> m_activatedSockets;
+
     //! Root path for booster sockets
     string m_socketRootPath;
 
@@ -30,9 +30,12 @@
 #include <fstream>
 #include <iostream>
 #include <sys/stat.h> 
+#include <sys/socket.h>
+#include <sys/un.h>
 extern "C" {
     #include "report.h"
 }
+#include "launchercontrol.h"
 #include <stdlib.h>
 
 #define DECL_EXPORT extern "C" __attribute__ ((__visibility__("default")))
@@ -40,6 +43,7 @@ extern "C" {
 namespace
 {
     int g_lockFd = -1;
+    DBusConnection * g_activationBus = NULL;
     const std::string LOCK_PATH_BASE(std::string(getenv("XDG_RUNTIME_DIR"))+"/single-instance-locks/");
     const std::string LOCK_FILE_NAME("instance.lock");
 }
@@ -69,6 +73,94 @@ static bool mkpath(const std::string & path)
     return true;
 }
 
+//! Build the window activation request for binaryName
+static DBusMessage * activationMessage(const char * binaryName)
+{
+    DBusMessage * msg = dbus_message_new_method_call("org.nemomobile.lipstick",
+                                                     "/WindowModel",
+                                                     "local.Lipstick.WindowModel",
+                                                     "launchProcess");
+    if (!msg)
+        return NULL;
+
+    DBusMessageIter args;
+    dbus_message_iter_init_append(msg, &args);
+    if (!dbus_message_iter_append_basic(&args, DBUS_TYPE_STRING, &binaryName))
+    {
+        dbus_message_unref(msg);
+        return NULL;
+    }
+
+    return msg;
+}
+
+//! Drop the activation connection, it is opened again on the next request
+static void closeActivationBus()
+{
+    if (g_activationBus)
+    {
+        dbus_connection_close(g_activationBus);
+        dbus_connection_unref(g_activationBus);
+        g_activationBus = NULL;
+    }
+}
+
+/*!
+ * \brief Ask applauncherd whether binaryName is already running.
+ *
+ * applauncherd activates an instance it tracks, or reserves the name for
+ * this process. The connection is returned in fd for reporting the launch.
+ *
+ * \return The LAUNCHER_INSTANCE_* status or -1 if applauncherd can't be asked.
+ */
+static int checkInstance(const char * binaryName, int * fd)
+{
+    const char * runtimeDir = getenv("XDG_RUNTIME_DIR");
+    const std::string path = std::string(runtimeDir && *runtimeDir ? runtimeDir : "/tmp") +
+        "/mapplauncherd/" + LAUNCHER_CONTROL_SOCKET;
+
+    struct sockaddr_un sun;
+    memset(&sun, 0, sizeof(sun));
+    sun.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(sun.sun_path))
+        return -1;
+
+    strcpy(sun.sun_path, path.c_str());
+
+    *fd = socket(PF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (*fd == -1)
+        return -1;
+
+    struct launcher_control_header header;
+    header.type = LAUNCHER_CONTROL_INSTANCE;
+    const std::string request = std::string(reinterpret_cast<const char *>(&header), sizeof(header)) + binaryName;
+
+    struct launcher_instance_reply reply;
+    if (connect(*fd, reinterpret_cast<struct sockaddr *>(&sun), sizeof(sun)) == -1 ||
+        request.size() > LAUNCHER_CONTROL_MAX_MSG ||
+        send(*fd, request.data(), request.size(), MSG_NOSIGNAL) == -1 ||
+        recv(*fd, &reply, sizeof(reply), 0) != sizeof(reply) ||
+        reply.header.type != LAUNCHER_CONTROL_INSTANCE)
+    {
+        close(*fd);
+        *fd = -1;
+        return -1;
+    }
+
+    return reply.status;
+}
+
+//! Tell applauncherd that this process executes the reserved instance
+static void reportLaunch(int fd, int status)
+{
+    struct launcher_launched_report launched;
+    launched.header.type = LAUNCHER_CONTROL_LAUNCHED;
+    launched.status      = status;
+
+    if (send(fd, &launched, sizeof(launched), MSG_NOSIGNAL) == -1)
+        report(report_warning, "Can't report launch to applauncherd: %s\n", strerror(errno));
+}
+
 //! Print help.
 static void printHelp()
 {
@@ -153,23 +245,12 @@ extern "C"
         }
 
         DBusMessage *msg;
-        DBusMessageIter args;
-
-        msg = dbus_message_new_method_call("org.nemomobile.lipstick",
-                                           "/WindowModel",
-                                           "local.Lipstick.WindowModel",
-                                           "launchProcess");
+        msg = activationMessage(binaryName);
         if (!msg) {
             report(report_error, "Can't allocate bus message");
             goto err;
         }
 
-        dbus_message_iter_init_append(msg, &args);
-        if (!dbus_message_iter_append_basic(&args, DBUS_TYPE_STRING, &binaryName)) {
-            report(report_error, "Can't allocate bus message");
-            goto err;
-        }
-
         if (!dbus_connection_send(bus, msg, NULL)) {
             report(report_error, "Can't send message");
             goto err;
@@ -183,6 +264,98 @@ err:
         dbus_error_free(&error);
         return false;
     }
+
+    /*!
+     * \brief Queue activation of an existing application without blocking.
+     *
+     * The request is sent over a private session bus connection kept open
+     * between calls. Only opening the connection blocks. The caller
+     * writes the queued requests out with processActivations() when the
+     * fd returned by activationFd() is ready.
+     *
+     * \param binaryName Full path to the binary.
+     * \return true if the request was queued.
+     */
+    DECL_EXPORT bool queueActivation(const char * binaryName)
+    {
+        if (!g_activationBus)
+        {
+            DBusError error;
+            dbus_error_init(&error);
+            g_activationBus = dbus_bus_get_private(DBUS_BUS_SESSION, &error);
+            if (!g_activationBus)
+            {
+                report(report_error, "Can't get session bus connection: %s\n", error.message);
+                dbus_error_free(&error);
+                return false;
+            }
+
+            dbus_connection_set_exit_on_disconnect(g_activationBus, FALSE);
+        }
+
+        DBusMessage * msg = activationMessage(binaryName);
+        if (!msg)
+        {
+            report(report_error, "Can't allocate bus message");
+            return false;
+        }
+
+        // Nobody waits for the reply
+        dbus_message_set_no_reply(msg, TRUE);
+
+        const bool queued = dbus_connection_send(g_activationBus, msg, NULL);
+        dbus_message_unref(msg);
+
+        if (!queued)
+            report(report_error, "Can't send message");
+
+        return queued;
+    }
+
+    /*!
+     * \brief Return the fd of the activation connection or -1 if not open.
+     * \param wantWrite Set to true if queued requests are waiting to be written.
+     */
+    DECL_EXPORT int activationFd(bool * wantWrite)
+    {
+        int fd = -1;
+        if (!g_activationBus || !dbus_connection_get_unix_fd(g_activationBus, &fd))
+            return -1;
+
+        *wantWrite = dbus_connection_has_messages_to_send(g_activationBus);
+        return fd;
+    }
+
+    //! Write queued activation requests and read incoming messages without blocking
+    DECL_EXPORT void processActivations()
+    {
+        if (!g_activationBus)
+            return;
+
+        dbus_connection_read_write(g_activationBus, 0);
+
+        // Nothing is expected from the bus, drop what comes in
+        while (dbus_connection_dispatch(g_activationBus) == DBUS_DISPATCH_DATA_REMAINS)
+            ;
+
+        if (!dbus_connection_get_is_connected(g_activationBus))
+        {
+            report(report_warning, "Session bus connection lost\n");
+            closeActivationBus();
+        }
+    }
+
+    /*!
+     * \brief Drop the activation connection in a forked child.
+     *
+     * Called in the child after fork(), the child must not write to the
+     * connection of the parent. Requests still queued are dropped with
+     * the child's copy of the connection.
+     */
+    DECL_EXPORT void closeActivations()
+    {
+        closeActivationBus();
+    }
 }
 
 //! The main function
@@ -200,23 +373,43 @@ int main(int argc, char **argv)
     }
     else
     {
-        if (!lock(argv[1]))
+        // applauncherd knows the instances it has launched, the lock
+        // files are needed only if it relies on them or can't be asked
+        int launcherFd = -1;
+        switch (checkInstance(argv[1], &launcherFd))
         {
-            bool success = activateExistingInstance(argv[1]);
-            if (!success)
+        case LAUNCHER_INSTANCE_ACTIVATED:
+            return EXIT_SUCCESS;
+
+        case LAUNCHER_INSTANCE_ACTIVATION_FAILED:
+            report(report_error, "Can't activate existing instance of %s\n", argv[1]);
+            return EXIT_FAILURE;
+
+        case LAUNCHER_INSTANCE_START:
+            break;
+
+        default:
+            if (!lock(argv[1]))
             {
-                return EXIT_FAILURE;
+                if (launcherFd != -1)
+                    reportLaunch(launcherFd, -EEXIST);
+
+                return activateExistingInstance(argv[1]) ? EXIT_SUCCESS : EXIT_FAILURE;
             }
+            break;
         }
-        else
+
+        // The pid stays the same over execve(), applauncherd tracks
+        // this process as the instance
+        if (launcherFd != -1)
+            reportLaunch(launcherFd, 0);
+
+        if (execve(argv[1], argv + 1, environ) == -1)
         {
-            if (execve(argv[1], argv + 1, environ) == -1)
-            {
-                report(report_error, "Failed to exec binary '%s' : %s\n", argv[1], strerror(errno));
-                unlock();
-                
-                return EXIT_FAILURE;
-            }
+            report(report_error, "Failed to exec binary '%s' : %s\n", argv[1], strerror(errno));
+            unlock();
+
+            return EXIT_FAILURE;
         }
     }
     